@@ -0,0 +1,61 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データの非同期読み込み（バックグラウンドでの読み込み・解析）
+**/
+
+
+#include "AsyncMotionLoader.h"
+
+
+
+// コンストラクタ
+AsyncMotionLoader::AsyncMotionLoader()
+{
+	num_tasks = 0;
+	num_finished_tasks = 0;
+}
+
+
+//
+//  BVHファイルから動作データを非同期に読み込み
+//  （動作ライブラリは複数のスレッドからの読み込みに対応しているため、複数のファイルを同時に読み込める）
+//
+shared_future< MotionHandle >  AsyncMotionLoader::LoadMotion( const char * bvh_file_name, MotionStorageEnum storage )
+{
+	string  file_name = bvh_file_name;
+	return  Run< MotionHandle >( bvh_file_name, [ file_name, storage ]()
+	{
+		return  MotionLibrary::GetInstance().LoadMotion( file_name.c_str(), storage );
+	} );
+}
+
+
+//
+//  最後に開始した処理の説明を取得
+//
+string  AsyncMotionLoader::GetStatus()
+{
+	lock_guard< mutex >  lock( status_mutex );
+	return  status;
+}
+
+
+//
+//  処理の開始・終了を記録
+//
+
+void  AsyncMotionLoader::BeginTask( const string & description )
+{
+	lock_guard< mutex >  lock( status_mutex );
+	status = description;
+}
+
+void  AsyncMotionLoader::EndTask()
+{
+	num_finished_tasks ++;
+}
@@ -0,0 +1,110 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データの非同期読み込み（バックグラウンドでの読み込み・解析）
+**/
+
+#ifndef  _ASYNC_MOTION_LOADER_H_
+#define  _ASYNC_MOTION_LOADER_H_
+
+
+#include <future>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <chrono>
+
+#include "SimpleHuman.h"
+#include "MotionLibrary.h"
+
+
+//
+//  動作データの読み込みや解析などの処理をバックグラウンドのスレッドで実行するクラス
+//  （各処理の結果は future として返す。アプリケーションは結果が揃うまで仮の画面を描画し、
+//    アイドル時の処理で future の状態を確認して、結果が揃ったら切り替える）
+//  （処理中に発生した例外は、future から結果を取得する際に送出される）
+//  （実行中の処理がある間は、このオブジェクトや処理が参照するデータを削除しないこと）
+//
+class  AsyncMotionLoader
+{
+  protected:
+	// 開始した処理・終了した処理の数
+	atomic< int >  num_tasks;
+	atomic< int >  num_finished_tasks;
+
+	// 最後に開始した処理の説明（進捗の表示用）
+	mutex  status_mutex;
+	string  status;
+
+  public:
+	// コンストラクタ
+	AsyncMotionLoader();
+
+	// BVHファイルから動作データを非同期に読み込み（動作ライブラリを通じて読み込む）
+	shared_future< MotionHandle >  LoadMotion( const char * bvh_file_name, MotionStorageEnum storage = MOTION_STORAGE_DECODED );
+
+	// 任意の処理（動作データの解析など）を非同期に実行
+	template< class T >
+	shared_future< T >  Run( const char * description, function< T () > task );
+
+	// 全ての処理が終了したかどうかを判定
+	bool  IsIdle() const { return  num_finished_tasks == num_tasks; }
+
+	// 進捗の取得（開始した処理・終了した処理の数、最後に開始した処理の説明）
+	int  GetNumTasks() const { return  num_tasks; }
+	int  GetNumFinishedTasks() const { return  num_finished_tasks; }
+	string  GetStatus();
+
+  protected:
+	// 処理の開始・終了を記録
+	void  BeginTask( const string & description );
+	void  EndTask();
+
+  private:
+	// コピーは禁止
+	AsyncMotionLoader( const AsyncMotionLoader & );
+	AsyncMotionLoader &  operator=( const AsyncMotionLoader & );
+};
+
+
+// future の結果が取得可能かどうかを判定（待機しない）
+template< class T >
+inline bool  IsFutureReady( const shared_future< T > & f )
+{
+	return  f.valid() && ( f.wait_for( chrono::seconds( 0 ) ) == future_status::ready );
+}
+
+
+//
+//  任意の処理を非同期に実行
+//
+template< class T >
+shared_future< T >  AsyncMotionLoader::Run( const char * description, function< T () > task )
+{
+	num_tasks ++;
+	string  name = description ? description : "";
+	return  async( launch::async, [ this, name, task ]()
+	{
+		// 処理が例外を送出した場合も終了を記録する（例外は future を通じて結果の取得時に送出される）
+		BeginTask( name );
+		try
+		{
+			T  result = task();
+			EndTask();
+			return  result;
+		}
+		catch ( ... )
+		{
+			EndTask();
+			throw;
+		}
+	} ).share();
+}
+
+
+#endif // _ASYNC_MOTION_LOADER_H_
@@ -5,10 +5,16 @@
 **/
 
 
-#include <fstream>
+#include <stdio.h>
 #include <string.h>
+#include <charconv>
+
+#ifdef  _WIN32
+	#include <windows.h>
+#endif
 
 #include "BVH.h"
+#include "MappedFile.h"
 
 
 // コントラクタ
@@ -43,7 +49,7 @@ void  BVH::Clear()
 	for ( i=0; i<joints.size(); i++ )
 		delete  joints[ i ];
 	if ( motion != NULL )
-		delete  motion;
+		delete[]  motion;
 
 	is_load_success = false;
 	
@@ -126,6 +132,9 @@ void  BVH::SetSkeleton( const char * name,
 // 動作データの設定
 void  BVH::SetMotion( int n_frame, double inter, const double * mo )
 {
+	if ( motion != NULL )
+		delete[]  motion;
+
 	num_frame = n_frame;
 	interval = inter;
 	motion = new double[ num_frame * num_channel ];
@@ -134,28 +143,170 @@ void  BVH::SetMotion( int n_frame, double inter, const double * mo )
 }
 
 
+//
+//  BVHファイルの字句解析の補助関数
+//  （ファイルの内容を直接走査するため、行単位の複製や行の長さの制限はない）
+//
+
+// 区切り文字かどうかを判定
+static inline bool  IsBVHSeparator( char c )
+{
+	return  ( c == ' ' ) || ( c == '\t' ) || ( c == ':' ) || ( c == ',' ) || ( c == '\r' ) || ( c == '\n' );
+}
+
+// 次の単語を取得（改行も読み飛ばす）
+static bool  NextBVHToken( const char * & cur, const char * end, const char * & token, size_t & length )
+{
+	while ( ( cur < end ) && IsBVHSeparator( *cur ) )
+		cur ++;
+	if ( cur >= end )
+		return  false;
+	token = cur;
+	while ( ( cur < end ) && !IsBVHSeparator( *cur ) )
+		cur ++;
+	length = cur - token;
+	return  true;
+}
+
+// 同じ行の次の単語を取得（行末に達したら失敗）
+static bool  NextBVHTokenInLine( const char * & cur, const char * end, const char * & token, size_t & length )
+{
+	while ( ( cur < end ) && ( *cur != '\n' ) && IsBVHSeparator( *cur ) )
+		cur ++;
+	if ( ( cur >= end ) || ( *cur == '\n' ) )
+		return  false;
+	token = cur;
+	while ( ( cur < end ) && !IsBVHSeparator( *cur ) )
+		cur ++;
+	length = cur - token;
+	return  true;
+}
+
+// 行末まで読み飛ばす
+static void  SkipBVHLine( const char * & cur, const char * end )
+{
+	const char *  next = (const char *) memchr( cur, '\n', end - cur );
+	cur = ( next != NULL ) ? next + 1 : end;
+}
+
+// 単語の比較
+static inline bool  IsBVHToken( const char * token, size_t length, const char * word )
+{
+	return  ( strlen( word ) == length ) && ( memcmp( token, word, length ) == 0 );
+}
+
+// 単語を実数値に変換
+static bool  ParseBVHValue( const char * token, const char * end, double & value, const char * & next )
+{
+	// from_chars は先頭の '+' を受け付けないので読み飛ばす
+	if ( ( token < end ) && ( *token == '+' ) )
+		token ++;
+	from_chars_result  result = from_chars( token, end, value );
+	if ( result.ec != errc() )
+		return  false;
+	next = result.ptr;
+	return  true;
+}
+
+// 単語を整数値に変換
+static bool  ParseBVHValue( const char * token, const char * end, int & value )
+{
+	if ( ( token < end ) && ( *token == '+' ) )
+		token ++;
+	from_chars_result  result = from_chars( token, end, value );
+	return  ( result.ec == errc() );
+}
+
+// 次の数値を読み込み（改行も読み飛ばす）
+static inline bool  NextBVHValue( const char * & cur, const char * end, double & value )
+{
+	while ( ( cur < end ) && IsBVHSeparator( *cur ) )
+		cur ++;
+	return  ParseBVHValue( cur, end, value, cur );
+}
+
+
 //
 //  BVHファイルのロード
 //
 void  BVH::Load( const char * bvh_file_name )
 {
-	#define  BUFFER_LENGTH  1024*4
+	// 初期化
+	Clear();
 
-	ifstream  file;
-	char      line[ BUFFER_LENGTH ];
-	char *    token;
-	char      separater[] = " :,\t";
-	vector< Joint * >   joint_stack;
-	Joint *   joint = NULL;
-	Joint *   new_joint = NULL;
-	bool      is_site = false;
-	double    x, y ,z;
-	int       i, j;
+	// ファイルの情報（ファイル名・動作名）の設定
+	SetFileName( bvh_file_name );
+
+	// ファイルをメモリ空間に割り当て
+	MappedFile  file;
+	if ( !file.Open( bvh_file_name ) )  return; // ファイルが開けなかったら終了
+
+	const char *  cur = file.GetData();
+	const char *  end = cur + file.GetSize();
+
+	// 階層情報・モーション情報の読み込み
+	if ( !ParseHierarchy( cur, end ) )
+		return;
+	if ( !ParseMotionHeader( cur, end ) )
+		return;
+
+	// モーションデータの読み込み（ファイルの内容から直接変換）
+	num_channel = channels.size();
+	motion = new double[ num_frame * num_channel ];
+	double *  value = motion;
+	double *  value_end = motion + num_frame * num_channel;
+	while ( value < value_end )
+	{
+		if ( !NextBVHValue( cur, end, *value ) )
+			return;
+		value ++;
+	}
+
+	// ロードの成功
+	is_load_success = true;
+
+	// ファイルは関数の終了時にクローズされる
+}
 
+
+//
+//  BVHファイルの階層情報・モーション情報のみをメモリ上のデータからロード
+//
+bool  BVH::LoadHeader( const char * bvh_file_name, const char * data, size_t size, int & num_frames_in_file, size_t & header_size )
+{
 	// 初期化
 	Clear();
 
 	// ファイルの情報（ファイル名・動作名）の設定
+	SetFileName( bvh_file_name );
+
+	// 階層情報・モーション情報の読み込み
+	const char *  cur = data;
+	const char *  end = data + size;
+	if ( !ParseHierarchy( cur, end ) )
+		return  false;
+	if ( !ParseMotionHeader( cur, end ) )
+		return  false;
+
+	// フレーム数・モーションデータの開始位置を出力（モーションデータは持たない）
+	num_channel = channels.size();
+	num_frames_in_file = num_frame;
+	num_frame = 0;
+	header_size = cur - data;
+
+	// ロードの成功
+	is_load_success = true;
+	return  true;
+}
+
+
+//
+//  ロードの補助関数
+//
+
+// ファイルの情報（ファイル名・動作名）の設定
+void  BVH::SetFileName( const char * bvh_file_name )
+{
 	file_name = bvh_file_name;
 	const char *  mn_first = bvh_file_name;
 	const char *  mn_last = bvh_file_name + strlen( bvh_file_name );
@@ -168,45 +319,44 @@ void  BVH::Load( const char * bvh_file_name )
 	if ( mn_last < mn_first )
 		mn_last = bvh_file_name + strlen( bvh_file_name );
 	motion_name.assign( mn_first, mn_last );
+}
 
-	// ファイルのオープン
-	file.open( bvh_file_name, ios::in );
-	if ( file.is_open() == 0 )  return; // ファイルが開けなかったら終了
-
-	// 階層情報の読み込み
-	while ( ! file.eof() )
-	{
-		// ファイルの最後まできてしまったら異常終了
-		if ( file.eof() )  goto bvh_error;
-
-		// １行読み込み、先頭の単語を取得
-		file.getline( line, BUFFER_LENGTH );
-		token = strtok( line, separater );
 
-		// 空行の場合は次の行へ
-		if ( token == NULL )  continue;
+// 階層情報の読み込み（MOTION の行まで）
+bool  BVH::ParseHierarchy( const char * & cur, const char * end )
+{
+	const char *  token;
+	size_t    length;
+	vector< Joint * >   joint_stack;
+	Joint *   joint = NULL;
+	Joint *   new_joint = NULL;
+	bool      is_site = false;
+	double    v[ 3 ];
+	int       i, n;
 
+	// 行の先頭の単語を順に処理
+	while ( NextBVHToken( cur, end, token, length ) )
+	{
 		// 関節ブロックの開始
-		if ( strcmp( token, "{" ) == 0 )
+		if ( IsBVHToken( token, length, "{" ) )
 		{
 			// 現在の関節をスタックに積む
 			joint_stack.push_back( joint );
 			joint = new_joint;
-			continue;
 		}
 		// 関節ブロックの終了
-		if ( strcmp( token, "}" ) == 0 )
+		else if ( IsBVHToken( token, length, "}" ) )
 		{
 			// 現在の関節をスタックから取り出す
+			if ( joint_stack.size() == 0 )
+				return  false;
 			joint = joint_stack.back();
 			joint_stack.pop_back();
 			is_site = false;
-			continue;
 		}
 
 		// 関節情報の開始
-		if ( ( strcmp( token, "ROOT" ) == 0 ) ||
-		     ( strcmp( token, "JOINT" ) == 0 ) )
+		else if ( IsBVHToken( token, length, "ROOT" ) || IsBVHToken( token, length, "JOINT" ) )
 		{
 			// 関節データの作成
 			new_joint = new Joint();
@@ -219,59 +369,70 @@ void  BVH::Load( const char * bvh_file_name )
 			if ( joint )
 				joint->children.push_back( new_joint );
 
-			// 関節名の読み込み
-			token = strtok( NULL, "" );
-			while ( *token == ' ' )  token ++;
-			new_joint->name = token;
+			// 関節名の読み込み（行末までの文字列から前後の空白を除く）
+			const char *  name_first = cur;
+			const char *  name_last = (const char *) memchr( cur, '\n', end - cur );
+			if ( name_last == NULL )
+				name_last = end;
+			while ( ( name_first < name_last ) && ( ( *name_first == ' ' ) || ( *name_first == '\t' ) ) )
+				name_first ++;
+			while ( ( name_last > name_first ) && ( ( name_last[ -1 ] == ' ' ) || ( name_last[ -1 ] == '\t' ) || ( name_last[ -1 ] == '\r' ) ) )
+				name_last --;
+			new_joint->name.assign( name_first, name_last );
 
 			// インデックスへ追加
 			joint_index[ new_joint->name ] = new_joint;
-			continue;
 		}
 
 		// 末端情報の開始
-		if ( ( strcmp( token, "End" ) == 0 ) )
+		else if ( IsBVHToken( token, length, "End" ) )
 		{
 			new_joint = joint;
 			is_site = true;
-			continue;
 		}
 
 		// 関節のオフセット or 末端位置の情報
-		if ( strcmp( token, "OFFSET" ) == 0 )
+		else if ( IsBVHToken( token, length, "OFFSET" ) )
 		{
+			if ( joint == NULL )
+				return  false;
+
 			// 座標値を読み込み
-			token = strtok( NULL, separater );
-			x = token ? atof( token ) : 0.0;
-			token = strtok( NULL, separater );
-			y = token ? atof( token ) : 0.0;
-			token = strtok( NULL, separater );
-			z = token ? atof( token ) : 0.0;
-			
-			// 関節のオフセットに座標値を設定
+			for ( i=0; i<3; i++ )
+			{
+				v[ i ] = 0.0;
+				if ( NextBVHTokenInLine( cur, end, token, length ) )
+					ParseBVHValue( token, end, v[ i ], token );
+			}
+
+			// 末端位置に座標値を設定
 			if ( is_site )
 			{
 				joint->has_site = true;
-				joint->site[0] = x;
-				joint->site[1] = y;
-				joint->site[2] = z;
+				joint->site[0] = v[ 0 ];
+				joint->site[1] = v[ 1 ];
+				joint->site[2] = v[ 2 ];
 			}
 			else
-			// 末端位置に座標値を設定
+			// 関節のオフセットに座標値を設定
 			{
-				joint->offset[0] = x;
-				joint->offset[1] = y;
-				joint->offset[2] = z;
+				joint->offset[0] = v[ 0 ];
+				joint->offset[1] = v[ 1 ];
+				joint->offset[2] = v[ 2 ];
 			}
-			continue;
 		}
 
 		// 関節のチャンネル情報
-		if ( strcmp( token, "CHANNELS" ) == 0 )
+		else if ( IsBVHToken( token, length, "CHANNELS" ) )
 		{
+			if ( joint == NULL )
+				return  false;
+
 			// チャンネル数を読み込み
-			token = strtok( NULL, separater );
-			joint->channels.resize( token ? atoi( token ) : 0 );
+			n = 0;
+			if ( NextBVHTokenInLine( cur, end, token, length ) )
+				ParseBVHValue( token, end, n );
+			joint->channels.resize( n );
 
 			// チャンネル情報を読み込み
 			for ( i=0; i<joint->channels.size(); i++ )
@@ -284,146 +445,192 @@ void  BVH::Load( const char * bvh_file_name )
 				joint->channels[ i ] = channel;
 
 				// チャンネルの種類の判定
-				token = strtok( NULL, separater );
-				if ( strcmp( token, "Xrotation" ) == 0 )
+				if ( !NextBVHTokenInLine( cur, end, token, length ) )
+					return  false;
+				if ( IsBVHToken( token, length, "Xrotation" ) )
 					channel->type = X_ROTATION;
-				else if ( strcmp( token, "Yrotation" ) == 0 )
+				else if ( IsBVHToken( token, length, "Yrotation" ) )
 					channel->type = Y_ROTATION;
-				else if ( strcmp( token, "Zrotation" ) == 0 )
+				else if ( IsBVHToken( token, length, "Zrotation" ) )
 					channel->type = Z_ROTATION;
-				else if ( strcmp( token, "Xposition" ) == 0 )
+				else if ( IsBVHToken( token, length, "Xposition" ) )
 					channel->type = X_POSITION;
-				else if ( strcmp( token, "Yposition" ) == 0 )
+				else if ( IsBVHToken( token, length, "Yposition" ) )
 					channel->type = Y_POSITION;
-				else if ( strcmp( token, "Zposition" ) == 0 )
+				else if ( IsBVHToken( token, length, "Zposition" ) )
 					channel->type = Z_POSITION;
 			}
 		}
 
 		// Motionデータのセクションへ移る
-		if ( strcmp( token, "MOTION" ) == 0 )
-			break;
+		else if ( IsBVHToken( token, length, "MOTION" ) )
+		{
+			SkipBVHLine( cur, end );
+			return  ( joints.size() > 0 );
+		}
+
+		// 行の残りは読み飛ばす
+		SkipBVHLine( cur, end );
 	}
 
+	// ファイルの最後まできてしまったら異常終了
+	return  false;
+}
 
-	// モーション情報の読み込み
-	while ( ! file.eof() )
+
+// モーション情報（フレーム数・フレーム間隔）の読み込み
+bool  BVH::ParseMotionHeader( const char * & cur, const char * end )
+{
+	const char *  token;
+	size_t    length;
+	double    value;
+
+	// フレーム数の読み込み
+	while ( true )
 	{
-		file.getline( line, BUFFER_LENGTH );
-		token = strtok( line, separater );
-		if ( !token )
-			continue;
-		if ( strcmp( token, "Frames" ) == 0 )
+		if ( !NextBVHToken( cur, end, token, length ) )
+			return  false;
+		if ( IsBVHToken( token, length, "Frames" ) )
 			break;
+		SkipBVHLine( cur, end );
 	}
-	if ( file.eof() )  goto bvh_error;
-	token = strtok( NULL, separater );
-	if ( token == NULL )  goto bvh_error;
-	num_frame = atoi( token );
+	if ( !NextBVHTokenInLine( cur, end, token, length ) || !ParseBVHValue( token, end, num_frame ) )
+		return  false;
+	SkipBVHLine( cur, end );
 
-	while ( ! file.eof() )
+	// フレーム間隔の読み込み
+	while ( true )
 	{
-		file.getline( line, BUFFER_LENGTH );
-		token = strtok( line, ":" );
-		if ( !token )
-			continue;
-		if ( strcmp( token, "Frame Time" ) == 0 )
+		if ( !NextBVHToken( cur, end, token, length ) )
+			return  false;
+		if ( IsBVHToken( token, length, "Frame" ) &&
+		     NextBVHTokenInLine( cur, end, token, length ) && IsBVHToken( token, length, "Time" ) )
 			break;
+		SkipBVHLine( cur, end );
 	}
-	if ( file.eof() )  goto bvh_error;
-	token = strtok( NULL, separater );
-	if ( token == NULL )  goto bvh_error;
-	interval = atof( token );
+	if ( !NextBVHTokenInLine( cur, end, token, length ) || !ParseBVHValue( token, end, value, token ) )
+		return  false;
+	interval = value;
+	SkipBVHLine( cur, end );
 
-	num_channel = channels.size();
-	motion = new double[ num_frame * num_channel ];
+	return  ( num_frame >= 0 );
+}
 
-	// モーションデータの読み込み
-	for ( i=0; i<num_frame; i++ )
-	{
-		file.getline( line, BUFFER_LENGTH );
-		token = strtok( line, separater );
-		for ( j=0; j<num_channel; j++ )
-		{
-			if ( token == NULL )
-				goto bvh_error;
-			motion[ i*num_channel + j ] = atof( token );
-			token = strtok( NULL, separater );
-		}
-	}
 
-	// ファイルのクローズ
-	file.close();
+//
+//  セーブの補助関数
+//
 
-	// ロードの成功
-	is_load_success = true;
+// 数値を文字列に追加（小数点以下６桁の固定小数点形式）
+static inline void  AppendBVHValue( string & text, double value )
+{
+	char  str[ 400 ]; // double の最大値も固定小数点形式で出力できる長さ
+	to_chars_result  result = to_chars( str, str + sizeof( str ), value, chars_format::fixed, 6 );
+	text.append( str, result.ptr );
+}
 
-	return;
+// 整数値を文字列に追加
+static inline void  AppendBVHValue( string & text, int value )
+{
+	char  str[ 16 ];
+	to_chars_result  result = to_chars( str, str + sizeof( str ), value );
+	text.append( str, result.ptr );
+}
 
-bvh_error:
-	file.close();
+// ファイルの置き換え（置き換え先のファイルが存在する場合も、置き換えを一度に行う）
+static bool  ReplaceBVHFile( const char * src_file_name, const char * dest_file_name )
+{
+#ifdef  _WIN32
+	return  MoveFileExA( src_file_name, dest_file_name, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+	return  rename( src_file_name, dest_file_name ) == 0;
+#endif
 }
 
 
 //
 //  セーブ
 //
-void  BVH::Save( const char * bvh_file_name )
+bool  BVH::Save( const char * bvh_file_name, bool use_temp_file ) const
+{
+	return  Save( bvh_file_name, num_frame, interval, motion, use_temp_file );
+}
+
+
+//
+//  階層構造と指定された動作データをセーブ
+//
+bool  BVH::Save( const char * bvh_file_name, int n_frame, double inter, const double * mo, bool use_temp_file ) const
 {
 	int  i, j;
-	ofstream  file;
+
+	// ファイルの内容を全てバッファに出力してから、一度にファイルに書き込む
+	string  text;
 
 	// モーションデータを出力するチャンネルの順番
 	vector< int >   channel_order;
 
-	// ファイルのオープン
-	file.open( bvh_file_name, ios::out );
-	if ( file.is_open() == 0 )  return; // ファイルが開けなかったら終了
-
-	// 出力フォーマットの設定
-	file.flags( ios::showpoint | ios::fixed );
-	file.precision( 6 );
-//	int  value_widht = 11;
-
 	// 階層構造の出力
-	file << "HIERARCHY" << endl;
-	OutputHierarchy( file, joints[ 0 ], 0, channel_order );
+	text += "HIERARCHY\n";
+	if ( joints.size() > 0 )
+		OutputHierarchy( text, joints[ 0 ], 0, channel_order );
 
 	// モーションデータの出力
-	file << "MOTION" << endl;
-	file << "Frames: " << num_frame << endl;
-	file << "Frame Time: " << interval << endl;
-	for ( i=0; i<num_frame; i++ )
+	text += "MOTION\n";
+	text += "Frames: ";
+	AppendBVHValue( text, n_frame );
+	text += "\nFrame Time: ";
+	AppendBVHValue( text, inter );
+	text += "\n";
+
+	// バッファを確保（１つの値はおよそ１２文字程度）
+	text.reserve( text.size() + (size_t) n_frame * channel_order.size() * 12 );
+	for ( i=0; i<n_frame; i++ )
 	{
+		const double *  frame = mo + i * num_channel;
 		for ( j=0; j<channel_order.size(); j++ )
 		{
-			// 数値を固定幅で出力する場合は文字幅を設定
-//			if ( value_widht > 0 )
-//				file.width( value_widht );
-
 			// モーションデータを出力
-			file << GetMotion( i, channel_order[ j ] );
+			AppendBVHValue( text, frame[ channel_order[ j ] ] );
 
 			// 空白か行末記号を出力
 			if ( j != channel_order.size() - 1 )
-				file << "  ";
+				text += "  ";
 			else
-				file << endl;
+				text += "\n";
 		}
 	}
 
-	// ファイルのクローズ
-	file.close();
-}
+	// 一時ファイルを使用する場合は、一時ファイルに書き込んでから置き換える（書き込み途中のファイルが残らないようにする）
+	string  write_file_name = bvh_file_name;
+	if ( use_temp_file )
+		write_file_name += ".tmp";
+
+	// ファイルに書き込み（テキストモードで書き込み、改行記号は環境に合わせて出力する）
+	FILE *  fp = fopen( write_file_name.c_str(), "w" );
+	if ( !fp )  return  false; // ファイルが開けなかったら終了
+	size_t  written = fwrite( text.data(), 1, text.size(), fp );
+	if ( ( fclose( fp ) != 0 ) || ( written != text.size() ) )
+	{
+		if ( use_temp_file )
+			remove( write_file_name.c_str() );
+		return  false;
+	}
 
+	// 一時ファイルを置き換え
+	if ( use_temp_file && !ReplaceBVHFile( write_file_name.c_str(), bvh_file_name ) )
+	{
+		remove( write_file_name.c_str() );
+		return  false;
+	}
+
+	return  true;
+}
 
-//
-//  セーブの補助関数
-//
 
 // 階層構造を再帰的に出力
 void  BVH::OutputHierarchy( 
-	ofstream & file, const Joint * joint, int indent_level, vector< int > & channel_list )
+	string & text, const Joint * joint, int indent_level, vector< int > & channel_list ) const
 {
 	int  i;
 	string  indent, space;
@@ -435,45 +642,47 @@ void  BVH::OutputHierarchy(
 
 	// 関節名（ルート名）の出力
 	if ( joint->parent )
-		file << indent << "JOINT" << space << joint->name << endl;
+		text += indent + "JOINT" + space + joint->name + "\n";
 	else
-		file << indent << "ROOT" << space << joint->name << endl;
+		text += indent + "ROOT" + space + joint->name + "\n";
 
 	// 関節ブロックの開始
-	file << indent << "{" << endl;
+	text += indent + "{\n";
 	indent_level ++;
 	indent.assign( indent_level * 4, ' ' );
 
 	// オフセット位置の出力
-	file << indent << "OFFSET" << space;
-	file << joint->offset[0] << space;
-	file << joint->offset[1] << space;
-	file << joint->offset[2] << endl;
+	text += indent + "OFFSET" + space;
+	AppendBVHValue( text, joint->offset[0] );  text += space;
+	AppendBVHValue( text, joint->offset[1] );  text += space;
+	AppendBVHValue( text, joint->offset[2] );  text += "\n";
 
 	// チャンネル情報の出力
-	file << indent << "CHANNELS"  << space << joint->channels.size() << space;
+	text += indent + "CHANNELS" + space;
+	AppendBVHValue( text, (int) joint->channels.size() );
+	text += space;
 	for ( i=0; i<joint->channels.size(); i++ )
 	{
 		channel = joint->channels[ i ];
 		switch ( channel->type )
 		{
 		  case X_ROTATION:
-			file << "Xrotation";  break;
+			text += "Xrotation";  break;
 		  case Y_ROTATION:
-			file << "Yrotation";  break;
+			text += "Yrotation";  break;
 		  case Z_ROTATION:
-			file << "Zrotation";  break;
+			text += "Zrotation";  break;
 		  case X_POSITION:
-			file << "Xposition";  break;
+			text += "Xposition";  break;
 		  case Y_POSITION:
-			file << "Yposition";  break;
+			text += "Yposition";  break;
 		  case Z_POSITION:
-			file << "Zposition";  break;
+			text += "Zposition";  break;
 		}
 		if ( i != joint->channels.size() - 1 )
-			file << space;
+			text += space;
 		else
-			file << endl;
+			text += "\n";
 
 		// 出力チャンネルのリストに追加
 		channel_list.push_back( channel->index );
@@ -482,34 +691,34 @@ void  BVH::OutputHierarchy(
 	// 末端位置の情報を出力
 	if ( joint->has_site )
 	{
-		file << indent << "End Site" << endl;
-		file << indent << "{" << endl;
+		text += indent + "End Site\n";
+		text += indent + "{\n";
 
 		indent_level ++;
 		indent.assign( indent_level * 4, ' ' );
 
 		// オフセット位置の出力
-		file << indent << "OFFSET" << space;
-		file << joint->site[0] << space;
-		file << joint->site[1] << space;
-		file << joint->site[2] << endl;
+		text += indent + "OFFSET" + space;
+		AppendBVHValue( text, joint->site[0] );  text += space;
+		AppendBVHValue( text, joint->site[1] );  text += space;
+		AppendBVHValue( text, joint->site[2] );  text += "\n";
 
 		indent_level --;
 		indent.assign( indent_level * 4, ' ' );
 
-		file << indent << "}" << endl;
+		text += indent + "}\n";
 	}
 
 	// 全ての子関節を再帰的に出力
 	for ( i=0; i<joint->children.size(); i++ )
 	{
-		OutputHierarchy( file, joint->children[ i ], indent_level, channel_list );
+		OutputHierarchy( text, joint->children[ i ], indent_level, channel_list );
 	}
 
 	// 関節ブロックの終了
 	indent_level --;
 	indent.assign( indent_level * 4, ' ' );
-	file << indent << "}" << endl;
+	text += indent + "}\n";
 }
 
 
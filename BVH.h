@@ -116,8 +116,15 @@ class  BVH
 	// BVHファイルのロード
 	void  Load( const char * bvh_file_name );
 
-	// BVHファイルのセーブ
-	void  Save( const char * bvh_file_name );
+	// BVHファイルのセーブ（一時ファイルに書き込んでから置き換えることもできる）
+	bool  Save( const char * bvh_file_name, bool use_temp_file = false ) const;
+
+	// 階層構造と指定された動作データ（チャンネル数は階層構造と同じ）をBVHファイルにセーブ
+	bool  Save( const char * bvh_file_name, int n_frame, double interval, const double * mo, bool use_temp_file = false ) const;
+
+	// BVHファイルの階層情報・モーション情報のみをメモリ上のデータからロード
+	// （ファイルのフレーム数とモーションデータの開始位置を出力する。モーションデータは読み込まず、フレーム数は０となる）
+	bool  LoadHeader( const char * bvh_file_name, const char * data, size_t size, int & num_frames_in_file, size_t & header_size );
 
   public:
 	/*  データアクセス関数  */
@@ -146,16 +153,28 @@ class  BVH
 	int     GetNumFrame() const { return  num_frame; }
 	double  GetInterval() const { return  interval; }
 	double  GetMotion( int f, int c ) const { return  motion[ f*num_channel + c ]; }
+	const double *  GetFrameData( int f ) const { return  motion + f*num_channel; }
 
 	// モーションデータの情報の変更
 	void  SetMotion( int f, int c, double v ) { motion[ f*num_channel + c ] = v; }
 
   protected:
+	/*  ロードの補助関数  */
+
+	// ファイルの情報（ファイル名・動作名）の設定
+	void  SetFileName( const char * bvh_file_name );
+
+	// 階層情報の読み込み（MOTION の行まで）
+	bool  ParseHierarchy( const char * & cur, const char * end );
+
+	// モーション情報（フレーム数・フレーム間隔）の読み込み
+	bool  ParseMotionHeader( const char * & cur, const char * end );
+
 	/*  セーブの補助関数  */
 	
 	// 階層構造を再帰的に出力
-	void  OutputHierarchy( ofstream & file, const Joint * joint, int indent_level,
-		vector< int > & channel_list );
+	void  OutputHierarchy( string & text, const Joint * joint, int indent_level,
+		vector< int > & channel_list ) const;
   
   public:
 	/*  姿勢の描画関数  */
@@ -0,0 +1,370 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  BVHファイルの逐次読み込み（一定フレーム数ずつ読み込む）
+**/
+
+
+#include "BVHStream.h"
+#include "ParallelFor.h"
+
+#include <string.h>
+#include <charconv>
+
+
+
+// １回に読み込むフレーム数のデフォルト値
+const int  bvh_stream_window_size = 256;
+
+// ファイルの読み込みバッファのサイズ（１回の読み込みのバイト数）
+static const size_t  bvh_stream_buffer_size = 64 * 1024;
+
+
+
+//
+//  読み込みの補助関数
+//
+
+// 区切り文字かどうかを判定（BVH::Load() と同じ）
+static inline bool  IsBVHStreamSeparator( char c )
+{
+	return  ( c == ' ' ) || ( c == '\t' ) || ( c == ':' ) || ( c == ',' ) || ( c == '\r' ) || ( c == '\n' );
+}
+
+// 文字列を探索
+static const char *  FindBVHStreamText( const char * begin, const char * end, const char * text )
+{
+	size_t  length = strlen( text );
+	while ( begin + length <= end )
+	{
+		const char *  p = (const char *) memchr( begin, text[ 0 ], end - begin - length + 1 );
+		if ( !p )
+			return  NULL;
+		if ( memcmp( p, text, length ) == 0 )
+			return  p;
+		begin = p + 1;
+	}
+	return  NULL;
+}
+
+// モーション情報（フレーム数・フレーム間隔の行）まで読み込まれているかを判定
+static bool  HasBVHMotionHeader( const char * begin, const char * end )
+{
+	const char *  p = FindBVHStreamText( begin, end, "MOTION" );
+	if ( p )
+		p = FindBVHStreamText( p, end, "Time" );
+	if ( p )
+		p = (const char *) memchr( p, '\n', end - p );
+	return  ( p != NULL );
+}
+
+// ファイルの読み込み位置を設定（2GB以上のファイルにも対応）
+static bool  SeekBVHStream( FILE * fp, long long offset )
+{
+#ifdef  _WIN32
+	return  ( _fseeki64( fp, offset, SEEK_SET ) == 0 );
+#else
+	return  ( fseeko( fp, (off_t) offset, SEEK_SET ) == 0 );
+#endif
+}
+
+
+
+// コンストラクタ
+BVHStream::BVHStream()
+{
+	file = NULL;
+	body = NULL;
+	owns_body = false;
+	Close();
+}
+
+// コンストラクタ
+BVHStream::BVHStream( const char * bvh_file_name, int window_size )
+{
+	file = NULL;
+	body = NULL;
+	owns_body = false;
+	Close();
+
+	Open( bvh_file_name, window_size );
+}
+
+// デストラクタ
+BVHStream::~BVHStream()
+{
+	Close();
+}
+
+
+//
+//  ファイルを開く（階層構造の情報を読み込む）
+//
+bool  BVHStream::Open( const char * bvh_file_name, int w_size )
+{
+	// 初期化
+	Close();
+
+	// ファイルを開く
+	file = fopen( bvh_file_name, "rb" );
+	if ( !file )
+		return  false;
+	buffer.resize( bvh_stream_buffer_size );
+
+	// モーション情報の行までを読み込んで、階層構造の情報を解析
+	size_t  header_size = 0;
+	while ( true )
+	{
+		bool  has_more = FillBuffer();
+		if ( HasBVHMotionHeader( buffer.data(), buffer.data() + buffer_end ) || !has_more )
+		{
+			if ( !bvh.LoadHeader( bvh_file_name, buffer.data(), buffer_end, num_frames, header_size ) )
+			{
+				Close();
+				return  false;
+			}
+			break;
+		}
+	}
+	interval = bvh.GetInterval();
+	data_offset = header_size;
+	buffer_pos = header_size;
+
+	// チャンネルと姿勢の対応情報を初期化
+	InitBVHChannelLayout( &bvh, layout );
+
+	// ウィンドウの初期化
+	window_size = ( w_size > 0 ) ? w_size : 1;
+	window_values.resize( window_size * layout.num_channels );
+
+	return  true;
+}
+
+
+//
+//  ファイルを閉じる
+//
+void  BVHStream::Close()
+{
+	if ( file )
+		fclose( file );
+	file = NULL;
+
+	if ( owns_body && body )
+		delete  body;
+	body = NULL;
+	owns_body = false;
+
+	bvh.Clear();
+	num_frames = 0;
+	interval = 0.0f;
+	data_offset = 0;
+	layout.num_channels = 0;
+	layout.joints.clear();
+	layout.rotation_channels.clear();
+
+	buffer.clear();
+	buffer_pos = 0;
+	buffer_end = 0;
+	is_eof = false;
+	is_error = false;
+
+	window_size = 0;
+	window_begin = 0;
+	window_num_frames = 0;
+	window_values.clear();
+	window_postures.clear();
+}
+
+
+//
+//  最初のフレームから読み込み直す
+//
+bool  BVHStream::Rewind()
+{
+	if ( !file )
+		return  false;
+
+	// モーションデータの開始位置に移動
+	if ( !SeekBVHStream( file, data_offset ) )
+	{
+		is_error = true;
+		return  false;
+	}
+	buffer_pos = 0;
+	buffer_end = 0;
+	is_eof = false;
+	is_error = false;
+
+	window_begin = 0;
+	window_num_frames = 0;
+
+	return  true;
+}
+
+
+//
+//  次のウィンドウのチャンネルの値を読み込み
+//
+int  BVHStream::ReadWindow()
+{
+	// 前のウィンドウの次のフレームから読み込み
+	window_begin += window_num_frames;
+	window_num_frames = 0;
+	if ( !file || is_error || ( window_begin >= num_frames ) )
+		return  0;
+
+	int  num = num_frames - window_begin;
+	if ( num > window_size )
+		num = window_size;
+
+	// チャンネルの値を読み込み（途中で失敗した場合は、読み込めたフレームまでとする）
+	int  num_values = num * layout.num_channels;
+	for ( int i = 0; i < num_values; i++ )
+	{
+		if ( !NextValue( window_values[ i ] ) )
+		{
+			is_error = true;
+			num = i / layout.num_channels;
+			break;
+		}
+	}
+
+	window_num_frames = num;
+	return  num;
+}
+
+
+//
+//  次のウィンドウを読み込んで姿勢に変換
+//
+int  BVHStream::ReadPostureWindow()
+{
+	// 姿勢の骨格モデルを取得
+	const Skeleton *  posture_body = GetSkeleton();
+	if ( !posture_body )
+		return  0;
+
+	// 次のウィンドウのチャンネルの値を読み込み
+	int  num = ReadWindow();
+	if ( num == 0 )
+		return  0;
+
+	// 姿勢の配列を初期化（前のウィンドウの姿勢を再利用する）
+	if ( (int) window_postures.size() < num )
+	{
+		int  old_size = (int) window_postures.size();
+		window_postures.resize( num );
+		for ( int i = old_size; i < num; i++ )
+			window_postures[ i ].Init( posture_body );
+	}
+
+	// 各フレームの姿勢を変換（CoustructBVHMotion() と同様に並列に処理）
+	ParallelFor( 0, num, bvh_decode_chunk_size, [ & ]( int begin, int end )
+	{
+		for ( int i = begin; i < end; i++ )
+			DecodeBVHPosture( layout, GetFrameData( i ), window_postures[ i ] );
+	} );
+
+	return  num;
+}
+
+
+//
+//  姿勢の骨格モデルを設定
+//
+void  BVHStream::SetSkeleton( const Skeleton * bvh_body )
+{
+	if ( owns_body && body )
+		delete  body;
+	body = bvh_body;
+	owns_body = false;
+	window_postures.clear();
+}
+
+
+//
+//  姿勢の骨格モデルを取得（必要であれば生成）
+//
+const Skeleton *  BVHStream::GetSkeleton()
+{
+	if ( !body && file )
+	{
+		body = CoustructBVHSkeleton( &bvh );
+		owns_body = ( body != NULL );
+	}
+	return  body;
+}
+
+
+//
+//  読み込みの補助関数
+//
+
+// 未処理のデータをバッファの先頭に移動して、続きを読み込み
+bool  BVHStream::FillBuffer()
+{
+	// 未処理のデータをバッファの先頭に移動
+	if ( buffer_pos > 0 )
+	{
+		memmove( buffer.data(), buffer.data() + buffer_pos, buffer_end - buffer_pos );
+		buffer_end -= buffer_pos;
+		buffer_pos = 0;
+	}
+
+	// バッファに空きがなければ拡張（非常に長い単語や階層構造の読み込み時のみ）
+	if ( buffer_end == buffer.size() )
+		buffer.resize( buffer.size() * 2 );
+
+	// ファイルの続きを読み込み
+	if ( is_eof )
+		return  false;
+	size_t  size = fread( buffer.data() + buffer_end, 1, buffer.size() - buffer_end, file );
+	if ( size == 0 )
+	{
+		is_eof = true;
+		return  false;
+	}
+	buffer_end += size;
+	return  true;
+}
+
+
+// 次の数値を読み込み
+bool  BVHStream::NextValue( double & value )
+{
+	while ( true )
+	{
+		// 区切り文字を読み飛ばす
+		const char *  data = buffer.data();
+		while ( ( buffer_pos < buffer_end ) && IsBVHStreamSeparator( data[ buffer_pos ] ) )
+			buffer_pos ++;
+		if ( buffer_pos == buffer_end )
+		{
+			if ( !FillBuffer() )
+				return  false;
+			continue;
+		}
+
+		// 単語の途中でバッファの最後に達した場合は、続きを読み込んでからやり直す
+		size_t  token_end = buffer_pos;
+		while ( ( token_end < buffer_end ) && !IsBVHStreamSeparator( data[ token_end ] ) )
+			token_end ++;
+		if ( ( token_end == buffer_end ) && FillBuffer() )
+			continue;
+
+		// 単語を実数値に変換（from_chars は先頭の '+' を受け付けないので読み飛ばす）
+		const char *  token = data + buffer_pos;
+		if ( *token == '+' )
+			token ++;
+		std::from_chars_result  result = std::from_chars( token, data + token_end, value );
+		if ( result.ec != std::errc() )
+			return  false;
+		buffer_pos = result.ptr - data;
+		return  true;
+	}
+}
@@ -0,0 +1,133 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  BVHファイルの逐次読み込み（一定フレーム数ずつ読み込む）
+**/
+
+#ifndef  _BVH_STREAM_H_
+#define  _BVH_STREAM_H_
+
+
+#include <stdio.h>
+
+#include "SimpleHuman.h"
+#include "BVH.h"
+
+
+// １回に読み込むフレーム数のデフォルト値
+extern const int  bvh_stream_window_size;
+
+
+//
+//  BVHファイルのモーションデータを先頭から一定フレーム数（ウィンドウ）ずつ読み込むためのクラス
+//  （ファイル全体を読み込まないため、長時間の動作データでも使用メモリ量は一定となる）
+//  （各ウィンドウのデータは、チャンネルの値のまま、または、姿勢に変換して取得できる）
+//
+class  BVHStream
+{
+  protected:
+	// 読み込み中のファイル
+	FILE *  file;
+
+	// 階層構造の情報（モーションデータは持たない）
+	BVH  bvh;
+
+	// ファイルのフレーム数・フレーム間隔
+	int  num_frames;
+	float  interval;
+
+	// モーションデータの開始位置（ファイル先頭からのバイト数）
+	long long  data_offset;
+
+	// チャンネルと姿勢の対応情報
+	BVHChannelLayout  layout;
+
+	// 姿勢の骨格モデル（最初に姿勢を取得する時に生成）
+	const Skeleton *  body;
+	bool  owns_body;
+
+	// ファイルの読み込みバッファ（[buffer_pos, buffer_end) が未処理のデータ）
+	vector< char >  buffer;
+	size_t  buffer_pos;
+	size_t  buffer_end;
+	bool  is_eof;
+
+	// 読み込みエラーが発生したかどうかのフラグ
+	bool  is_error;
+
+	// 現在のウィンドウの情報（最大フレーム数・先頭のフレーム番号・フレーム数）
+	int  window_size;
+	int  window_begin;
+	int  window_num_frames;
+
+	// 現在のウィンドウのチャンネルの値 [フレーム番号][チャンネル番号]
+	vector< double >  window_values;
+
+	// 現在のウィンドウの姿勢（ReadPostureWindow() で変換）
+	vector< Posture >  window_postures;
+
+  public:
+	// コンストラクタ・デストラクタ
+	BVHStream();
+	BVHStream( const char * bvh_file_name, int window_size = bvh_stream_window_size );
+	~BVHStream();
+
+	// ファイルを開く（階層構造の情報を読み込む）・閉じる
+	bool  Open( const char * bvh_file_name, int window_size = bvh_stream_window_size );
+	void  Close();
+
+	// 最初のフレームから読み込み直す
+	bool  Rewind();
+
+	// 次のウィンドウのチャンネルの値を読み込み（読み込んだフレーム数を返す、最後まで読み込んだら 0 を返す）
+	int  ReadWindow();
+
+	// 次のウィンドウを読み込んで姿勢に変換（読み込んだフレーム数を返す、最後まで読み込んだら 0 を返す）
+	int  ReadPostureWindow();
+
+	// 姿勢の骨格モデルを設定（設定しない場合は BVH の階層構造から生成）
+	void  SetSkeleton( const Skeleton * bvh_body );
+
+  public:
+	/*  データアクセス関数  */
+
+	// ファイルの情報の取得
+	bool  IsOpen() const { return  file != NULL; }
+	bool  IsError() const { return  is_error; }
+	const BVH *  GetBVH() const { return  &bvh; }
+	int  GetNumFrames() const { return  num_frames; }
+	float  GetInterval() const { return  interval; }
+	const BVHChannelLayout &  GetChannelLayout() const { return  layout; }
+
+	// 姿勢の骨格モデルを取得（必要であれば生成）
+	const Skeleton *  GetSkeleton();
+
+	// 現在のウィンドウの情報の取得
+	int  GetWindowBegin() const { return  window_begin; }
+	int  GetWindowNumFrames() const { return  window_num_frames; }
+
+	// 現在のウィンドウの各フレームのデータの取得（ウィンドウ内のフレーム番号で指定）
+	const double *  GetFrameData( int i ) const { return  &window_values[ i * layout.num_channels ]; }
+	const Posture &  GetPosture( int i ) const { return  window_postures[ i ]; }
+
+  protected:
+	/*  読み込みの補助関数  */
+
+	// 未処理のデータをバッファの先頭に移動して、続きを読み込み（データが増えなければ false を返す）
+	bool  FillBuffer();
+
+	// 次の数値を読み込み
+	bool  NextValue( double & value );
+
+  private:
+	// コピーは禁止
+	BVHStream( const BVHStream & );
+	BVHStream &  operator=( const BVHStream & );
+};
+
+
+#endif // _BVH_STREAM_H_
@@ -0,0 +1,512 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データの圧縮（回転の量子化・ルート位置の差分符号化）
+**/
+
+
+#include "CompressedMotion.h"
+
+#include <math.h>
+#include <algorithm>
+
+
+// SIMD命令（SSE2）を使用
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __SSE2__ )
+	#define  USE_SSE2_QUATERNION
+	#include <emmintrin.h>
+#endif
+
+
+
+//
+//  四元数の量子化（smallest three）
+//  （絶対値が最大の成分を正にして除き、残りの３成分を [-1/√2, 1/√2] の範囲で 15bit に量子化する）
+//  （除いた成分の番号 2bit は、１・２番目の値の最上位ビットに格納する。１成分あたりの誤差は 2.2e-5 以下）
+//
+
+// 量子化する成分の範囲・最大値
+static const float  quat_component_range = 0.707106781f;
+static const int  quat_component_max = 0x7fff;
+
+// 量子化した値から成分への変換係数
+static const float  quat_component_scale = 2.0f * quat_component_range / quat_component_max;
+
+
+// 回転行列から四元数 (x, y, z, w) を計算
+static void  MatrixToQuaternion( const Matrix3f & m, double * q )
+{
+	double  trace = (double) m.m00 + m.m11 + m.m22;
+	if ( trace > 0.0 )
+	{
+		double  s = sqrt( trace + 1.0 ) * 2.0;
+		q[ 3 ] = 0.25 * s;
+		q[ 0 ] = ( m.m21 - m.m12 ) / s;
+		q[ 1 ] = ( m.m02 - m.m20 ) / s;
+		q[ 2 ] = ( m.m10 - m.m01 ) / s;
+	}
+	else if ( ( m.m00 > m.m11 ) && ( m.m00 > m.m22 ) )
+	{
+		double  s = sqrt( 1.0 + m.m00 - m.m11 - m.m22 ) * 2.0;
+		q[ 3 ] = ( m.m21 - m.m12 ) / s;
+		q[ 0 ] = 0.25 * s;
+		q[ 1 ] = ( m.m01 + m.m10 ) / s;
+		q[ 2 ] = ( m.m02 + m.m20 ) / s;
+	}
+	else if ( m.m11 > m.m22 )
+	{
+		double  s = sqrt( 1.0 + m.m11 - m.m00 - m.m22 ) * 2.0;
+		q[ 3 ] = ( m.m02 - m.m20 ) / s;
+		q[ 0 ] = ( m.m01 + m.m10 ) / s;
+		q[ 1 ] = 0.25 * s;
+		q[ 2 ] = ( m.m12 + m.m21 ) / s;
+	}
+	else
+	{
+		double  s = sqrt( 1.0 + m.m22 - m.m00 - m.m11 ) * 2.0;
+		q[ 3 ] = ( m.m10 - m.m01 ) / s;
+		q[ 0 ] = ( m.m02 + m.m20 ) / s;
+		q[ 1 ] = ( m.m12 + m.m21 ) / s;
+		q[ 2 ] = 0.25 * s;
+	}
+
+	double  length = sqrt( q[ 0 ] * q[ 0 ] + q[ 1 ] * q[ 1 ] + q[ 2 ] * q[ 2 ] + q[ 3 ] * q[ 3 ] );
+	for ( int i = 0; i < 4; i++ )
+		q[ i ] /= length;
+}
+
+// 四元数 (x, y, z, w) から回転行列を計算
+static inline void  QuaternionToMatrix( const float * q, Matrix3f & m )
+{
+	float  x = q[ 0 ], y = q[ 1 ], z = q[ 2 ], w = q[ 3 ];
+	m.m00 = 1.0f - 2.0f * ( y * y + z * z );
+	m.m01 = 2.0f * ( x * y - w * z );
+	m.m02 = 2.0f * ( x * z + w * y );
+	m.m10 = 2.0f * ( x * y + w * z );
+	m.m11 = 1.0f - 2.0f * ( x * x + z * z );
+	m.m12 = 2.0f * ( y * z - w * x );
+	m.m20 = 2.0f * ( x * z - w * y );
+	m.m21 = 2.0f * ( y * z + w * x );
+	m.m22 = 1.0f - 2.0f * ( x * x + y * y );
+}
+
+// ２つの四元数の間の回転角度を計算
+static inline double  QuaternionAngle( const double * q0, const double * q1 )
+{
+	double  dot = fabs( q0[ 0 ] * q1[ 0 ] + q0[ 1 ] * q1[ 1 ] + q0[ 2 ] * q1[ 2 ] + q0[ 3 ] * q1[ 3 ] );
+	return  2.0 * acos( ( dot < 1.0 ) ? dot : 1.0 );
+}
+
+// 四元数を量子化
+static void  EncodeQuaternion( const double * q, uint16_t * values )
+{
+	// 絶対値が最大の成分を判定（その成分が正になるように符号を揃える）
+	int  largest = 0;
+	for ( int i = 1; i < 4; i++ )
+		if ( fabs( q[ i ] ) > fabs( q[ largest ] ) )
+			largest = i;
+	double  sign = ( q[ largest ] < 0.0 ) ? -1.0 : 1.0;
+
+	// 残りの３成分を量子化
+	int  n = 0;
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( i == largest )
+			continue;
+		double  v = ( sign * q[ i ] + quat_component_range ) / ( 2.0 * quat_component_range ) * quat_component_max;
+		int  qv = (int) floor( v + 0.5 );
+		values[ n ++ ] = (uint16_t) std::min( std::max( qv, 0 ), quat_component_max );
+	}
+
+	// 除いた成分の番号を格納
+	values[ 0 ] |= ( largest & 1 ) << 15;
+	values[ 1 ] |= ( largest >> 1 ) << 15;
+}
+
+// 量子化した四元数を復元（SIMD版と同じ計算を行う）
+static inline void  DecodeQuaternion( const uint16_t * values, float * q )
+{
+	int  largest = ( values[ 0 ] >> 15 ) | ( ( values[ 1 ] >> 15 ) << 1 );
+	float  a = ( values[ 0 ] & quat_component_max ) * quat_component_scale - quat_component_range;
+	float  b = ( values[ 1 ] & quat_component_max ) * quat_component_scale - quat_component_range;
+	float  c = ( values[ 2 ] & quat_component_max ) * quat_component_scale - quat_component_range;
+	float  d2 = 1.0f - a * a - b * b - c * c;
+	float  d = sqrtf( ( d2 > 0.0f ) ? d2 : 0.0f );
+
+	q[ 0 ] = ( largest == 0 ) ? d : a;
+	q[ 1 ] = ( largest == 0 ) ? a : ( largest == 1 ) ? d : b;
+	q[ 2 ] = ( largest <= 1 ) ? b : ( largest == 2 ) ? d : c;
+	q[ 3 ] = ( largest == 3 ) ? d : c;
+}
+
+
+#ifdef  USE_SSE2_QUATERNION
+
+// マスクに応じて値を選択
+static inline __m128  SelectSSE2( __m128 mask, __m128 a, __m128 b )
+{
+	return  _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+// 量子化した４つの四元数を復元して回転行列を計算
+static inline void  DecodeQuaternionMatricesSSE2( const uint16_t * values, Matrix3f * const * dest )
+{
+	// 量子化した値を取り出し
+	alignas( 16 ) int32_t  ia[ 4 ], ib[ 4 ], ic[ 4 ], ik[ 4 ];
+	for ( int i = 0; i < 4; i++ )
+	{
+		const uint16_t *  v = values + i * 3;
+		ia[ i ] = v[ 0 ] & quat_component_max;
+		ib[ i ] = v[ 1 ] & quat_component_max;
+		ic[ i ] = v[ 2 ] & quat_component_max;
+		ik[ i ] = ( v[ 0 ] >> 15 ) | ( ( v[ 1 ] >> 15 ) << 1 );
+	}
+
+	// ３成分を復元して、残りの成分を計算
+	const __m128  scale = _mm_set1_ps( quat_component_scale );
+	const __m128  offset = _mm_set1_ps( quat_component_range );
+	const __m128  one = _mm_set1_ps( 1.0f );
+	const __m128  two = _mm_set1_ps( 2.0f );
+	__m128  a = _mm_sub_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_load_si128( (const __m128i *) ia ) ), scale ), offset );
+	__m128  b = _mm_sub_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_load_si128( (const __m128i *) ib ) ), scale ), offset );
+	__m128  c = _mm_sub_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_load_si128( (const __m128i *) ic ) ), scale ), offset );
+	__m128  d2 = _mm_sub_ps( _mm_sub_ps( _mm_sub_ps( one, _mm_mul_ps( a, a ) ), _mm_mul_ps( b, b ) ), _mm_mul_ps( c, c ) );
+	__m128  d = _mm_sqrt_ps( _mm_max_ps( d2, _mm_setzero_ps() ) );
+
+	// 除いた成分の番号に応じて各成分を選択
+	__m128i  k = _mm_load_si128( (const __m128i *) ik );
+	__m128  k0 = _mm_castsi128_ps( _mm_cmpeq_epi32( k, _mm_set1_epi32( 0 ) ) );
+	__m128  k1 = _mm_castsi128_ps( _mm_cmpeq_epi32( k, _mm_set1_epi32( 1 ) ) );
+	__m128  k2 = _mm_castsi128_ps( _mm_cmpeq_epi32( k, _mm_set1_epi32( 2 ) ) );
+	__m128  k3 = _mm_castsi128_ps( _mm_cmpeq_epi32( k, _mm_set1_epi32( 3 ) ) );
+	__m128  x = SelectSSE2( k0, d, a );
+	__m128  y = SelectSSE2( k0, a, SelectSSE2( k1, d, b ) );
+	__m128  z = SelectSSE2( _mm_or_ps( k0, k1 ), b, SelectSSE2( k2, d, c ) );
+	__m128  w = SelectSSE2( k3, d, c );
+
+	// 回転行列を計算
+	__m128  xx = _mm_mul_ps( x, x ), yy = _mm_mul_ps( y, y ), zz = _mm_mul_ps( z, z );
+	__m128  xy = _mm_mul_ps( x, y ), xz = _mm_mul_ps( x, z ), yz = _mm_mul_ps( y, z );
+	__m128  wx = _mm_mul_ps( w, x ), wy = _mm_mul_ps( w, y ), wz = _mm_mul_ps( w, z );
+	alignas( 16 ) float  m[ 9 ][ 4 ];
+	_mm_store_ps( m[ 0 ], _mm_sub_ps( one, _mm_mul_ps( two, _mm_add_ps( yy, zz ) ) ) );
+	_mm_store_ps( m[ 1 ], _mm_mul_ps( two, _mm_sub_ps( xy, wz ) ) );
+	_mm_store_ps( m[ 2 ], _mm_mul_ps( two, _mm_add_ps( xz, wy ) ) );
+	_mm_store_ps( m[ 3 ], _mm_mul_ps( two, _mm_add_ps( xy, wz ) ) );
+	_mm_store_ps( m[ 4 ], _mm_sub_ps( one, _mm_mul_ps( two, _mm_add_ps( xx, zz ) ) ) );
+	_mm_store_ps( m[ 5 ], _mm_mul_ps( two, _mm_sub_ps( yz, wx ) ) );
+	_mm_store_ps( m[ 6 ], _mm_mul_ps( two, _mm_sub_ps( xz, wy ) ) );
+	_mm_store_ps( m[ 7 ], _mm_mul_ps( two, _mm_add_ps( yz, wx ) ) );
+	_mm_store_ps( m[ 8 ], _mm_sub_ps( one, _mm_mul_ps( two, _mm_add_ps( xx, yy ) ) ) );
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		float *  r = &dest[ i ]->m00;
+		for ( int j = 0; j < 9; j++ )
+			r[ j ] = m[ j ][ i ];
+	}
+}
+
+#endif // USE_SSE2_QUATERNION
+
+
+// 量子化した複数の四元数を復元して回転行列を計算
+static void  DecodeQuaternionMatrices( const uint16_t * values, Matrix3f * const * dest, int num )
+{
+	int  i = 0;
+#ifdef  USE_SSE2_QUATERNION
+	for ( ; i + 4 <= num; i += 4 )
+		DecodeQuaternionMatricesSSE2( values + i * 3, dest + i );
+#endif
+	for ( ; i < num; i++ )
+	{
+		float  q[ 4 ];
+		DecodeQuaternion( values + i * 3, q );
+		QuaternionToMatrix( q, *dest[ i ] );
+	}
+}
+
+
+// 姿勢の回転（関節の回転、または、ルートの向き）を取得
+static inline Matrix3f &  GetTrackRotation( Posture & p, int track )
+{
+	return  ( track < p.body->num_joints ) ? p.joint_rotations[ track ] : p.root_ori;
+}
+
+static inline const Matrix3f &  GetTrackRotation( const Posture & p, int track )
+{
+	return  ( track < p.body->num_joints ) ? p.joint_rotations[ track ] : p.root_ori;
+}
+
+
+
+//
+//  動作データの圧縮の設定
+//
+
+// コンストラクタ（0.1mm 単位の位置、0.0005 ラジアン（約 0.03 度）以下の変化は一定とみなす）
+MotionCompressionSettings::MotionCompressionSettings()
+{
+	position_precision = 0.0001f;
+	rotation_tolerance = 0.0005f;
+	key_interval = 32;
+}
+
+
+
+//
+//  圧縮した動作データから姿勢を生成
+//
+
+// コンストラクタ
+CompressedFrameDecoder::CompressedFrameDecoder()
+{
+	num_frames = 0;
+	num_tracks = 0;
+	num_animated_tracks = 0;
+	position_precision = 0.0f;
+	error.max_rotation_error = 0.0f;
+	error.max_position_error = 0.0f;
+}
+
+
+//
+//  動作データを圧縮
+//
+bool  CompressedFrameDecoder::Compress( const Motion * motion, const MotionCompressionSettings & settings )
+{
+	// 初期化
+	track_slots.clear();
+	animated_values.clear();
+	animated_tracks.clear();
+	constant_rotations.clear();
+	root_key_frames.clear();
+	root_keys.clear();
+	root_deltas.clear();
+	num_animated_tracks = 0;
+	error.max_rotation_error = 0.0f;
+	error.max_position_error = 0.0f;
+
+	if ( !motion || !motion->body || ( motion->num_frames <= 0 ) )
+		return  false;
+
+	num_frames = motion->num_frames;
+	num_tracks = motion->body->num_joints + 1;
+	position_precision = ( settings.position_precision > 0.0f ) ? settings.position_precision : 0.0001f;
+	int  key_interval = ( settings.key_interval > 0 ) ? settings.key_interval : 1;
+
+	// 全フレームの回転・ルート位置を量子化
+	// （各回転の最初のフレームからの変化の最大値と、量子化による誤差の最大値を記録）
+	vector< uint16_t >  values( (size_t) num_frames * num_tracks * 3 );
+	vector< int32_t >  positions( (size_t) num_frames * 3 );
+	vector< double >  first_quats( num_tracks * 4 );
+	vector< double >  first_errors( num_tracks, 0.0 );
+	vector< double >  max_changes( num_tracks, 0.0 );
+	vector< double >  max_errors( num_tracks, 0.0 );
+	double  max_position_error = 0.0;
+	for ( int f = 0; f < num_frames; f++ )
+	{
+		const Posture *  frame = motion->GetFrame( f );
+		if ( !frame )
+			return  false;
+
+		for ( int t = 0; t < num_tracks; t++ )
+		{
+			double  q[ 4 ];
+			MatrixToQuaternion( GetTrackRotation( *frame, t ), q );
+
+			uint16_t *  encoded = &values[ ( (size_t) f * num_tracks + t ) * 3 ];
+			EncodeQuaternion( q, encoded );
+
+			float  decoded[ 4 ];
+			DecodeQuaternion( encoded, decoded );
+			double  dq[ 4 ] = { decoded[ 0 ], decoded[ 1 ], decoded[ 2 ], decoded[ 3 ] };
+			double  e = QuaternionAngle( q, dq );
+			max_errors[ t ] = std::max( max_errors[ t ], e );
+
+			if ( f == 0 )
+			{
+				for ( int i = 0; i < 4; i++ )
+					first_quats[ t * 4 + i ] = q[ i ];
+				first_errors[ t ] = e;
+			}
+			else
+				max_changes[ t ] = std::max( max_changes[ t ], QuaternionAngle( q, &first_quats[ t * 4 ] ) );
+		}
+
+		const float *  pos = &frame->root_pos.x;
+		for ( int i = 0; i < 3; i++ )
+		{
+			int32_t  qv = (int32_t) floor( pos[ i ] / position_precision + 0.5 );
+			positions[ f * 3 + i ] = qv;
+			float  decoded = qv * position_precision;
+			max_position_error = std::max( max_position_error, fabs( (double) decoded - pos[ i ] ) );
+		}
+	}
+
+	// 変化が許容誤差以下の回転は、最初のフレームの回転のみを保持
+	// （誤差は、最初のフレームからの変化と最初のフレームの量子化誤差の和を上限とする）
+	double  max_rotation_error = 0.0;
+	track_slots.resize( num_tracks );
+	for ( int t = 0; t < num_tracks; t++ )
+	{
+		if ( max_changes[ t ] <= settings.rotation_tolerance )
+		{
+			track_slots[ t ] = -1 - (int) constant_rotations.size();
+			float  q[ 4 ];
+			DecodeQuaternion( &values[ t * 3 ], q );
+			Matrix3f  rot;
+			QuaternionToMatrix( q, rot );
+			constant_rotations.push_back( rot );
+			max_rotation_error = std::max( max_rotation_error, max_changes[ t ] + first_errors[ t ] );
+		}
+		else
+		{
+			track_slots[ t ] = (int) animated_tracks.size();
+			animated_tracks.push_back( t );
+			max_rotation_error = std::max( max_rotation_error, max_errors[ t ] );
+		}
+	}
+	num_animated_tracks = animated_tracks.size();
+
+	// 変化する回転の量子化した値を保持
+	animated_values.resize( (size_t) num_frames * num_animated_tracks * 3 );
+	for ( int f = 0; f < num_frames; f++ )
+	{
+		for ( int i = 0; i < num_animated_tracks; i++ )
+		{
+			const uint16_t *  src = &values[ ( (size_t) f * num_tracks + animated_tracks[ i ] ) * 3 ];
+			uint16_t *  dest = &animated_values[ ( (size_t) f * num_animated_tracks + i ) * 3 ];
+			dest[ 0 ] = src[ 0 ];
+			dest[ 1 ] = src[ 1 ];
+			dest[ 2 ] = src[ 2 ];
+		}
+	}
+
+	// ルート位置を一定間隔の基準フレームと前のフレームからの差分として保持
+	// （差分が 16bit で表せない場合は、そのフレームを基準フレームとする）
+	root_deltas.assign( (size_t) num_frames * 3, 0 );
+	int  last_key = 0;
+	for ( int f = 0; f < num_frames; f++ )
+	{
+		bool  is_key = ( f == 0 ) || ( f - last_key >= key_interval );
+		for ( int i = 0; !is_key && ( i < 3 ); i++ )
+		{
+			int32_t  delta = positions[ f * 3 + i ] - positions[ ( f - 1 ) * 3 + i ];
+			if ( ( delta < INT16_MIN ) || ( delta > INT16_MAX ) )
+				is_key = true;
+		}
+
+		if ( is_key )
+		{
+			root_key_frames.push_back( f );
+			for ( int i = 0; i < 3; i++ )
+				root_keys.push_back( positions[ f * 3 + i ] );
+			last_key = f;
+		}
+		else
+		{
+			for ( int i = 0; i < 3; i++ )
+				root_deltas[ f * 3 + i ] = (int16_t)( positions[ f * 3 + i ] - positions[ ( f - 1 ) * 3 + i ] );
+		}
+	}
+
+	// 圧縮による誤差を記録
+	error.max_rotation_error = max_rotation_error;
+	error.max_position_error = max_position_error;
+
+	return  true;
+}
+
+
+//
+//  指定フレームの姿勢を生成
+//
+void  CompressedFrameDecoder::DecodeFrame( int no, Posture & p ) const
+{
+	// 変化する回転を復元（出力先の回転行列の配列はスレッドごとに再利用する）
+	static thread_local vector< Matrix3f * >  dest;
+	dest.resize( num_animated_tracks );
+	for ( int i = 0; i < num_animated_tracks; i++ )
+		dest[ i ] = &GetTrackRotation( p, animated_tracks[ i ] );
+	DecodeQuaternionMatrices( &animated_values[ (size_t) no * num_animated_tracks * 3 ], dest.data(), num_animated_tracks );
+
+	// 一定の回転を設定
+	for ( int t = 0; t < num_tracks; t++ )
+		if ( track_slots[ t ] < 0 )
+			GetTrackRotation( p, t ) = constant_rotations[ -1 - track_slots[ t ] ];
+
+	// ルート位置を直前の基準フレームから差分を加算して復元
+	int  k = std::upper_bound( root_key_frames.begin(), root_key_frames.end(), no ) - root_key_frames.begin() - 1;
+	int32_t  pos[ 3 ] = { root_keys[ k * 3 ], root_keys[ k * 3 + 1 ], root_keys[ k * 3 + 2 ] };
+	for ( int f = root_key_frames[ k ] + 1; f <= no; f++ )
+	{
+		pos[ 0 ] += root_deltas[ f * 3 ];
+		pos[ 1 ] += root_deltas[ f * 3 + 1 ];
+		pos[ 2 ] += root_deltas[ f * 3 + 2 ];
+	}
+	p.root_pos.set( pos[ 0 ] * position_precision, pos[ 1 ] * position_precision, pos[ 2 ] * position_precision );
+}
+
+
+//
+//  保持しているデータのサイズを取得
+//
+size_t  CompressedFrameDecoder::GetDataSize() const
+{
+	return  track_slots.size() * sizeof( int ) +
+		animated_values.size() * sizeof( uint16_t ) +
+		animated_tracks.size() * sizeof( int ) +
+		constant_rotations.size() * sizeof( Matrix3f ) +
+		root_key_frames.size() * sizeof( int ) +
+		root_keys.size() * sizeof( int32_t ) +
+		root_deltas.size() * sizeof( int16_t );
+}
+
+
+
+//
+//  動作データを圧縮した動作データを生成
+//
+Motion *  CompressMotion( const Motion * motion, const MotionCompressionSettings & settings, MotionCompressionError * error, int cache_size )
+{
+	CompressedFrameDecoder *  decoder = new CompressedFrameDecoder();
+	if ( !decoder->Compress( motion, settings ) )
+	{
+		delete  decoder;
+		return  NULL;
+	}
+
+	if ( error )
+		*error = decoder->GetError();
+
+	Motion *  compressed = new Motion();
+	compressed->InitLazy( motion->body, motion->num_frames, decoder, cache_size );
+	compressed->interval = motion->interval;
+	compressed->name = motion->name;
+	return  compressed;
+}
+
+
+//
+//  BVHファイルを読み込んで、圧縮した動作データ（＋骨格モデル）を生成
+//  （チャンネルの値のみを保持する動作データとして読み込み、各フレームを順に圧縮する）
+//
+Motion *  LoadAndCoustructCompressedBVHMotion( const char * bvh_file_name, const Skeleton * bvh_body,
+	const MotionCompressionSettings & settings, MotionCompressionError * error )
+{
+	Motion *  lazy_motion = LoadAndCoustructLazyBVHMotion( bvh_file_name, bvh_body, 1 );
+	if ( !lazy_motion )
+		return  NULL;
+
+	Motion *  motion = CompressMotion( lazy_motion, settings, error );
+	if ( !motion && ( lazy_motion->body != bvh_body ) )
+		delete  lazy_motion->body;
+	delete  lazy_motion;
+
+	return  motion;
+}
@@ -0,0 +1,118 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データの圧縮（回転の量子化・ルート位置の差分符号化）
+**/
+
+#ifndef  _COMPRESSED_MOTION_H_
+#define  _COMPRESSED_MOTION_H_
+
+
+#include <stdint.h>
+
+#include "SimpleHuman.h"
+#include "LazyMotion.h"
+
+
+//
+//  動作データの圧縮の設定
+//
+struct  MotionCompressionSettings
+{
+	// ルート位置の量子化の単位（m）
+	float  position_precision;
+
+	// 回転が一定とみなす誤差（ラジアン、全フレームの回転の変化がこれ以下の関節は１つの回転のみを保持する）
+	float  rotation_tolerance;
+
+	// ルート位置の差分の基準とするフレームの間隔（任意のフレームの復元時に加算する差分の最大数）
+	int  key_interval;
+
+	// コンストラクタ（デフォルトの設定）
+	MotionCompressionSettings();
+};
+
+
+//
+//  動作データの圧縮による誤差（圧縮時に全フレームで計測した最大誤差）
+//
+struct  MotionCompressionError
+{
+	// 回転の最大誤差（ラジアン）
+	float  max_rotation_error;
+
+	// ルート位置の最大誤差（m）
+	float  max_position_error;
+};
+
+
+//
+//  圧縮した動作データから姿勢を生成
+//  （回転は最大の成分を除いた３成分を量子化した四元数（１関節あたり 48bit）として保持する）
+//  （ルート位置は固定小数点数として、一定間隔の基準フレームからの各フレームの差分を保持する）
+//
+class  CompressedFrameDecoder : public MotionFrameDecoder
+{
+  protected:
+	// フレーム数・回転数（関節数＋ルートの向き）
+	int  num_frames;
+	int  num_tracks;
+
+	// 各回転の保持方法（0以上は変化する回転の番号、-1以下は一定の回転の番号 (-1-番号)）
+	vector< int >  track_slots;
+
+	// 変化する回転の量子化した値 [フレーム番号][変化する回転の番号][3]
+	int  num_animated_tracks;
+	vector< uint16_t >  animated_values;
+
+	// 変化する回転の回転番号 [変化する回転の番号]
+	vector< int >  animated_tracks;
+
+	// 一定の回転 [一定の回転の番号]
+	vector< Matrix3f >  constant_rotations;
+
+	// ルート位置の量子化の単位
+	float  position_precision;
+
+	// ルート位置の基準フレームのフレーム番号・量子化した値 [基準フレームの番号][3]
+	vector< int >  root_key_frames;
+	vector< int32_t >  root_keys;
+
+	// ルート位置の前のフレームからの差分 [フレーム番号][3]
+	vector< int16_t >  root_deltas;
+
+	// 圧縮による誤差
+	MotionCompressionError  error;
+
+  public:
+	// コンストラクタ
+	CompressedFrameDecoder();
+
+	// 動作データを圧縮（姿勢を必要に応じて生成する動作データも圧縮できる）
+	bool  Compress( const Motion * motion, const MotionCompressionSettings & settings = MotionCompressionSettings() );
+
+	// 圧縮による誤差を取得
+	const MotionCompressionError &  GetError() const { return  error; }
+
+	// 指定フレームの姿勢を生成
+	virtual void  DecodeFrame( int no, Posture & p ) const;
+
+	// 保持しているデータのサイズを取得
+	virtual size_t  GetDataSize() const;
+};
+
+
+// 動作データを圧縮した動作データ（姿勢を必要に応じて生成する動作データ）を生成
+Motion *  CompressMotion( const Motion * motion, const MotionCompressionSettings & settings = MotionCompressionSettings(),
+	MotionCompressionError * error = NULL, int cache_size = motion_frame_cache_size );
+
+// BVHファイルを読み込んで、圧縮した動作データ（＋骨格モデル）を生成
+Motion *  LoadAndCoustructCompressedBVHMotion( const char * bvh_file_name, const Skeleton * bvh_body = NULL,
+	const MotionCompressionSettings & settings = MotionCompressionSettings(), MotionCompressionError * error = NULL );
+
+
+#endif // _COMPRESSED_MOTION_H_
@@ -0,0 +1,203 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  オイラー角と回転行列の相互変換（回転順序ごとに特殊化した計算）
+**/
+
+
+#include "EulerRotation.h"
+
+
+// SIMD命令（SSE2）を使用
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __SSE2__ )
+	#define  USE_SSE2_SINCOS
+	#include <emmintrin.h>
+#endif
+
+
+
+//
+//  sin, cos の多項式近似（Cephes の単精度版と同じ方法）
+//  （π/4 単位で範囲を縮小してから多項式で近似する。誤差は ±8192 ラジアンの範囲で 1e-7 程度）
+//
+
+// 範囲縮小のための定数
+static const float  sincos_four_over_pi = 1.27323954473516f;
+static const float  sincos_dp1 = 0.78515625f;
+static const float  sincos_dp2 = 2.4187564849853515625e-4f;
+static const float  sincos_dp3 = 3.77489497744594108e-8f;
+
+// 多項式の係数
+static const float  sincos_sin_p0 = -1.9515295891e-4f;
+static const float  sincos_sin_p1 = 8.3321608736e-3f;
+static const float  sincos_sin_p2 = -1.6666654611e-1f;
+static const float  sincos_cos_p0 = 2.443315711809948e-5f;
+static const float  sincos_cos_p1 = -1.388731625493765e-3f;
+static const float  sincos_cos_p2 = 4.166664568298827e-2f;
+
+
+// １つの角度の sin, cos を計算（SIMD版と同じ計算を行う）
+static inline void  SinCosScalar( float x, float & s, float & c )
+{
+	// 符号を分離して範囲を縮小
+	bool  sign_sin = ( x < 0.0f );
+	if ( sign_sin )
+		x = -x;
+	int  j = (int)( x * sincos_four_over_pi );
+	j = ( j + 1 ) & ~1;
+	float  y = (float) j;
+	x = ( ( x - y * sincos_dp1 ) - y * sincos_dp2 ) - y * sincos_dp3;
+
+	// 象限に応じた符号・多項式の選択
+	if ( j & 4 )
+		sign_sin = !sign_sin;
+	bool  sign_cos = ( ( ( j - 2 ) & 4 ) == 0 );
+	bool  swap = ( ( j & 2 ) != 0 );
+
+	// 多項式近似
+	float  z = x * x;
+	float  poly_cos = ( ( sincos_cos_p0 * z + sincos_cos_p1 ) * z + sincos_cos_p2 ) * z * z - 0.5f * z + 1.0f;
+	float  poly_sin = ( ( sincos_sin_p0 * z + sincos_sin_p1 ) * z + sincos_sin_p2 ) * z * x + x;
+
+	s = swap ? poly_cos : poly_sin;
+	c = swap ? poly_sin : poly_cos;
+	if ( sign_sin )
+		s = -s;
+	if ( sign_cos )
+		c = -c;
+}
+
+
+#ifdef  USE_SSE2_SINCOS
+
+// ４つの角度の sin, cos をまとめて計算
+static inline void  SinCosSSE2( __m128 x, __m128 & s, __m128 & c )
+{
+	const __m128  sign_mask = _mm_castsi128_ps( _mm_set1_epi32( (int) 0x80000000 ) );
+	const __m128i  one = _mm_set1_epi32( 1 );
+	const __m128i  two = _mm_set1_epi32( 2 );
+	const __m128i  four = _mm_set1_epi32( 4 );
+
+	// 符号を分離して範囲を縮小
+	__m128  sign_sin = _mm_and_ps( x, sign_mask );
+	x = _mm_andnot_ps( sign_mask, x );
+	__m128i  j = _mm_cvttps_epi32( _mm_mul_ps( x, _mm_set1_ps( sincos_four_over_pi ) ) );
+	j = _mm_andnot_si128( one, _mm_add_epi32( j, one ) );
+	__m128  y = _mm_cvtepi32_ps( j );
+	x = _mm_sub_ps( x, _mm_mul_ps( y, _mm_set1_ps( sincos_dp1 ) ) );
+	x = _mm_sub_ps( x, _mm_mul_ps( y, _mm_set1_ps( sincos_dp2 ) ) );
+	x = _mm_sub_ps( x, _mm_mul_ps( y, _mm_set1_ps( sincos_dp3 ) ) );
+
+	// 象限に応じた符号・多項式の選択
+	sign_sin = _mm_xor_ps( sign_sin, _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( j, four ), 29 ) ) );
+	__m128  sign_cos = _mm_castsi128_ps( _mm_slli_epi32( _mm_andnot_si128( _mm_sub_epi32( j, two ), four ), 29 ) );
+	__m128  swap = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( j, two ), two ) );
+
+	// 多項式近似
+	__m128  z = _mm_mul_ps( x, x );
+	__m128  poly_cos = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( sincos_cos_p0 ), z ), _mm_set1_ps( sincos_cos_p1 ) );
+	poly_cos = _mm_add_ps( _mm_mul_ps( poly_cos, z ), _mm_set1_ps( sincos_cos_p2 ) );
+	poly_cos = _mm_mul_ps( _mm_mul_ps( poly_cos, z ), z );
+	poly_cos = _mm_sub_ps( poly_cos, _mm_mul_ps( z, _mm_set1_ps( 0.5f ) ) );
+	poly_cos = _mm_add_ps( poly_cos, _mm_set1_ps( 1.0f ) );
+	__m128  poly_sin = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( sincos_sin_p0 ), z ), _mm_set1_ps( sincos_sin_p1 ) );
+	poly_sin = _mm_add_ps( _mm_mul_ps( poly_sin, z ), _mm_set1_ps( sincos_sin_p2 ) );
+	poly_sin = _mm_add_ps( _mm_mul_ps( _mm_mul_ps( poly_sin, z ), x ), x );
+
+	s = _mm_or_ps( _mm_and_ps( swap, poly_cos ), _mm_andnot_ps( swap, poly_sin ) );
+	c = _mm_or_ps( _mm_and_ps( swap, poly_sin ), _mm_andnot_ps( swap, poly_cos ) );
+	s = _mm_xor_ps( s, sign_sin );
+	c = _mm_xor_ps( c, sign_cos );
+}
+
+#endif // USE_SSE2_SINCOS
+
+
+
+//
+//  ３つの回転軸から回転順序を取得
+//
+EulerOrder  GetEulerOrder( int axis0, int axis1, int axis2 )
+{
+	if ( ( axis0 == 0 ) && ( axis1 == 1 ) && ( axis2 == 2 ) )  return  EULER_XYZ;
+	if ( ( axis0 == 0 ) && ( axis1 == 2 ) && ( axis2 == 1 ) )  return  EULER_XZY;
+	if ( ( axis0 == 1 ) && ( axis1 == 0 ) && ( axis2 == 2 ) )  return  EULER_YXZ;
+	if ( ( axis0 == 1 ) && ( axis1 == 2 ) && ( axis2 == 0 ) )  return  EULER_YZX;
+	if ( ( axis0 == 2 ) && ( axis1 == 0 ) && ( axis2 == 1 ) )  return  EULER_ZXY;
+	if ( ( axis0 == 2 ) && ( axis1 == 1 ) && ( axis2 == 0 ) )  return  EULER_ZYX;
+	return  EULER_UNKNOWN;
+}
+
+
+//
+//  複数の角度の sin, cos をまとめて計算
+//
+void  SinCosArray( const float * angles, float * sin_values, float * cos_values, int num )
+{
+	int  i = 0;
+#ifdef  USE_SSE2_SINCOS
+	for ( ; i + 4 <= num; i += 4 )
+	{
+		__m128  s, c;
+		SinCosSSE2( _mm_loadu_ps( angles + i ), s, c );
+		_mm_storeu_ps( sin_values + i, s );
+		_mm_storeu_ps( cos_values + i, c );
+	}
+#endif
+	for ( ; i < num; i++ )
+		SinCosScalar( angles[ i ], sin_values[ i ], cos_values[ i ] );
+}
+
+
+//
+//  オイラー角から回転行列を計算
+//
+void  EulerToMatrix( EulerOrder order, const float * s, const float * c, Matrix3f & rot )
+{
+	switch ( order )
+	{
+	  case EULER_XYZ:
+		EulerToMatrixKernel< 0, 1, 2 >( s[ 0 ], c[ 0 ], s[ 1 ], c[ 1 ], s[ 2 ], c[ 2 ], rot );  break;
+	  case EULER_XZY:
+		EulerToMatrixKernel< 0, 2, 1 >( s[ 0 ], c[ 0 ], s[ 1 ], c[ 1 ], s[ 2 ], c[ 2 ], rot );  break;
+	  case EULER_YXZ:
+		EulerToMatrixKernel< 1, 0, 2 >( s[ 0 ], c[ 0 ], s[ 1 ], c[ 1 ], s[ 2 ], c[ 2 ], rot );  break;
+	  case EULER_YZX:
+		EulerToMatrixKernel< 1, 2, 0 >( s[ 0 ], c[ 0 ], s[ 1 ], c[ 1 ], s[ 2 ], c[ 2 ], rot );  break;
+	  case EULER_ZXY:
+		EulerToMatrixKernel< 2, 0, 1 >( s[ 0 ], c[ 0 ], s[ 1 ], c[ 1 ], s[ 2 ], c[ 2 ], rot );  break;
+	  case EULER_ZYX:
+		EulerToMatrixKernel< 2, 1, 0 >( s[ 0 ], c[ 0 ], s[ 1 ], c[ 1 ], s[ 2 ], c[ 2 ], rot );  break;
+	  default:
+		rot.setIdentity();
+	}
+}
+
+
+//
+//  回転行列からオイラー角を計算
+//
+void  MatrixToEuler( EulerOrder order, const Matrix3f & rot, double * angles )
+{
+	switch ( order )
+	{
+	  case EULER_XYZ:
+		MatrixToEulerKernel< 0, 1, 2 >( rot, angles[ 0 ], angles[ 1 ], angles[ 2 ] );  break;
+	  case EULER_XZY:
+		MatrixToEulerKernel< 0, 2, 1 >( rot, angles[ 0 ], angles[ 1 ], angles[ 2 ] );  break;
+	  case EULER_YXZ:
+		MatrixToEulerKernel< 1, 0, 2 >( rot, angles[ 0 ], angles[ 1 ], angles[ 2 ] );  break;
+	  case EULER_YZX:
+		MatrixToEulerKernel< 1, 2, 0 >( rot, angles[ 0 ], angles[ 1 ], angles[ 2 ] );  break;
+	  case EULER_ZXY:
+		MatrixToEulerKernel< 2, 0, 1 >( rot, angles[ 0 ], angles[ 1 ], angles[ 2 ] );  break;
+	  case EULER_ZYX:
+		MatrixToEulerKernel< 2, 1, 0 >( rot, angles[ 0 ], angles[ 1 ], angles[ 2 ] );  break;
+	  default:
+		angles[ 0 ] = angles[ 1 ] = angles[ 2 ] = 0.0;
+	}
+}
@@ -0,0 +1,118 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  オイラー角と回転行列の相互変換（回転順序ごとに特殊化した計算）
+**/
+
+#ifndef  _EULER_ROTATION_H_
+#define  _EULER_ROTATION_H_
+
+
+#include <Matrix3.h>
+#include <math.h>
+
+
+//
+//  オイラー角の回転順序（BVHのチャンネルの並び順、R = R_A0 * R_A1 * R_A2 の順に掛ける）
+//
+enum  EulerOrder
+{
+	EULER_XYZ,
+	EULER_XZY,
+	EULER_YXZ,
+	EULER_YZX,
+	EULER_ZXY,
+	EULER_ZYX,
+
+	NUM_EULER_ORDERS,
+
+	// 回転順序が特定できない（３軸が揃っていない）場合
+	EULER_UNKNOWN = -1
+};
+
+
+// ３つの回転軸（0:X, 1:Y, 2:Z）から回転順序を取得
+EulerOrder  GetEulerOrder( int axis0, int axis1, int axis2 );
+
+// 複数の角度（ラジアン）の sin, cos をまとめて計算（SIMD命令が利用できる場合は４つずつ計算）
+void  SinCosArray( const float * angles, float * sin_values, float * cos_values, int num );
+
+// オイラー角（各軸の角度の sin, cos をチャンネルの順に指定）から回転行列を計算
+void  EulerToMatrix( EulerOrder order, const float * s, const float * c, Matrix3f & rot );
+
+// 回転行列からオイラー角（度数法、チャンネルの順に出力）を計算
+void  MatrixToEuler( EulerOrder order, const Matrix3f & rot, double * angles );
+
+
+
+//
+//  回転順序ごとに特殊化した計算
+//  （I, J, K は１番目・２番目・３番目の回転軸、R = R_I(a) * R_J(b) * R_K(c) ）
+//  （回転軸の並びが X→Y→Z の巡回順であれば e = 1、逆順であれば e = -1 として、全順序の計算を共通の式で表す）
+//
+//      R[I][I] =  cb*cc                R[I][J] = -e*cb*sc              R[I][K] =  e*sb
+//      R[J][I] =  sa*sb*cc + e*ca*sc   R[J][J] =  ca*cc - e*sa*sb*sc   R[J][K] = -e*sa*cb
+//      R[K][I] = -e*ca*sb*cc + sa*sc   R[K][J] =  ca*sb*sc + e*sa*cc   R[K][K] =  ca*cb
+//
+
+// オイラー角から回転行列を計算
+template< int I, int J, int K >
+inline void  EulerToMatrixKernel( float sa, float ca, float sb, float cb, float sc, float cc, Matrix3f & rot )
+{
+	const float  e = ( J == ( I + 1 ) % 3 ) ? 1.0f : -1.0f;
+	float *  m = &rot.m00;
+
+	const float  sa_sb = sa * sb;
+	const float  ca_sb = ca * sb;
+
+	m[ I * 3 + I ] = cb * cc;
+	m[ I * 3 + J ] = -e * cb * sc;
+	m[ I * 3 + K ] = e * sb;
+	m[ J * 3 + I ] = sa_sb * cc + e * ca * sc;
+	m[ J * 3 + J ] = ca * cc - e * sa_sb * sc;
+	m[ J * 3 + K ] = -e * sa * cb;
+	m[ K * 3 + I ] = -e * ca_sb * cc + sa * sc;
+	m[ K * 3 + J ] = ca_sb * sc + e * sa * cc;
+	m[ K * 3 + K ] = ca * cb;
+}
+
+
+// 回転行列からオイラー角（度数法）を計算
+template< int I, int J, int K >
+inline void  MatrixToEulerKernel( const Matrix3f & rot, double & a, double & b, double & c )
+{
+	const double  e = ( J == ( I + 1 ) % 3 ) ? 1.0 : -1.0;
+	const float *  m = &rot.m00;
+
+	// ２番目の軸の回転角度
+	double  sb = e * m[ I * 3 + K ];
+	if ( sb > 1.0 )  sb = 1.0;
+	if ( sb < -1.0 )  sb = -1.0;
+	b = asin( sb );
+
+	// cos(b) が 0 でない場合
+	if ( fabs( sb ) < 0.9999999 )
+	{
+		a = atan2( -e * m[ J * 3 + K ], (double) m[ K * 3 + K ] );
+		c = atan2( -e * m[ I * 3 + J ], (double) m[ I * 3 + I ] );
+	}
+	// ジンバルロック時の処理（３番目の軸の回転を 0 とする）
+	else
+	{
+		a = atan2( e * m[ K * 3 + J ], (double) m[ J * 3 + J ] );
+		c = 0.0;
+	}
+
+	// ラジアンから度数法へ変換
+	const double  rad_to_deg = 180.0 / 3.14159265358979323846;
+	a *= rad_to_deg;
+	b *= rad_to_deg;
+	c *= rad_to_deg;
+}
+
+
+#endif // _EULER_ROTATION_H_
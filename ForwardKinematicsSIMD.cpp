@@ -0,0 +1,124 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  SIMD命令を使用した順運動学計算（アフィン変換による計算）
+**/
+
+
+#include "ForwardKinematicsSIMD.h"
+
+// SIMD命令（SSE2）を使用
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __SSE2__ )
+	#define  USE_SSE2_FORWARD_KINEMATICS
+	#include <emmintrin.h>
+#endif
+
+
+
+#ifdef  USE_SSE2_FORWARD_KINEMATICS
+
+//
+//  アフィン変換の各列（回転の３列・平行移動）
+//  （配列の要素として __m128 の整列を保つため、構造体にまとめて保持する）
+//
+struct  AffineColumns
+{
+	__m128  columns[ 4 ];
+};
+
+
+//
+//  アフィン変換の各列を変換行列に設定
+//
+static inline void  StoreAffineColumns( const __m128 * columns, Matrix4f & frame )
+{
+	float  v[ 16 ];
+	_mm_storeu_ps( &v[ 0 ], columns[ 0 ] );
+	_mm_storeu_ps( &v[ 4 ], columns[ 1 ] );
+	_mm_storeu_ps( &v[ 8 ], columns[ 2 ] );
+	_mm_storeu_ps( &v[ 12 ], columns[ 3 ] );
+
+	frame.m00 = v[ 0 ];  frame.m01 = v[ 4 ];  frame.m02 = v[ 8 ];   frame.m03 = v[ 12 ];
+	frame.m10 = v[ 1 ];  frame.m11 = v[ 5 ];  frame.m12 = v[ 9 ];   frame.m13 = v[ 13 ];
+	frame.m20 = v[ 2 ];  frame.m21 = v[ 6 ];  frame.m22 = v[ 10 ];  frame.m23 = v[ 14 ];
+	frame.m30 = 0.0f;    frame.m31 = 0.0f;    frame.m32 = 0.0f;     frame.m33 = 1.0f;
+}
+
+
+//
+//  アフィン変換による順運動学計算（SSE2）
+//  （各体節の変換を列ごとに保持し、行列とベクトルの積をスカラー倍と加算の組み合わせで計算する）
+//
+void  ForwardKinematicsAffine( const Posture & posture, int link_begin, int link_end, Matrix4f * seg_frame_array, Point3f * joi_pos_array )
+{
+	const Skeleton *  body = posture.body;
+	const vector< SegmentLink > &  links = body->segment_links;
+	if ( link_begin >= link_end )
+		return;
+
+	// 各体節の変換の列 [体節番号]（スレッドごとに再利用する）
+	static thread_local vector< AffineColumns >  frames;
+	frames.resize( body->num_segments );
+
+	// 範囲の最初の体節のルート側の体節（全身の場合はルート体節）の変換を設定
+	// （範囲内の他の体節のルート側の体節は、この体節か範囲内で先に計算される体節となる）
+	const Matrix4f &  root = seg_frame_array[ links[ link_begin ].parent_segment ];
+	__m128 *  columns = frames[ links[ link_begin ].parent_segment ].columns;
+	columns[ 0 ] = _mm_setr_ps( root.m00, root.m10, root.m20, 0.0f );
+	columns[ 1 ] = _mm_setr_ps( root.m01, root.m11, root.m21, 0.0f );
+	columns[ 2 ] = _mm_setr_ps( root.m02, root.m12, root.m22, 0.0f );
+	columns[ 3 ] = _mm_setr_ps( root.m03, root.m13, root.m23, 0.0f );
+
+	for ( int i = link_begin; i < link_end; i++ )
+	{
+		const SegmentLink &  link = links[ i ];
+		const __m128 *  p = frames[ link.parent_segment ].columns;
+		__m128 *  g = frames[ link.segment ].columns;
+		const Matrix3f &  r = posture.joint_rotations[ link.joint ];
+
+		// ルート側の体節の座標系から、接続関節の位置を計算
+		__m128  joint_pos = _mm_add_ps( p[ 3 ], _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( p[ 0 ], _mm_set1_ps( link.parent_offset.x ) ),
+			_mm_mul_ps( p[ 1 ], _mm_set1_ps( link.parent_offset.y ) ) ),
+			_mm_mul_ps( p[ 2 ], _mm_set1_ps( link.parent_offset.z ) ) ) );
+
+		// 関節の回転をかける（ルート側の体節の回転と関節の回転の積の各列）
+		g[ 0 ] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( p[ 0 ], _mm_set1_ps( r.m00 ) ), _mm_mul_ps( p[ 1 ], _mm_set1_ps( r.m10 ) ) ), _mm_mul_ps( p[ 2 ], _mm_set1_ps( r.m20 ) ) );
+		g[ 1 ] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( p[ 0 ], _mm_set1_ps( r.m01 ) ), _mm_mul_ps( p[ 1 ], _mm_set1_ps( r.m11 ) ) ), _mm_mul_ps( p[ 2 ], _mm_set1_ps( r.m21 ) ) );
+		g[ 2 ] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( p[ 0 ], _mm_set1_ps( r.m02 ) ), _mm_mul_ps( p[ 1 ], _mm_set1_ps( r.m12 ) ) ), _mm_mul_ps( p[ 2 ], _mm_set1_ps( r.m22 ) ) );
+
+		// 関節の座標系から、体節の座標系への平行移動をかける
+		g[ 3 ] = _mm_sub_ps( joint_pos, _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( g[ 0 ], _mm_set1_ps( link.offset.x ) ),
+			_mm_mul_ps( g[ 1 ], _mm_set1_ps( link.offset.y ) ) ),
+			_mm_mul_ps( g[ 2 ], _mm_set1_ps( link.offset.z ) ) ) );
+
+		// 関節の位置・体節の変換行列を設定
+		if ( joi_pos_array )
+		{
+			float  v[ 4 ];
+			_mm_storeu_ps( v, joint_pos );
+			joi_pos_array[ link.joint ].set( v[ 0 ], v[ 1 ], v[ 2 ] );
+		}
+		StoreAffineColumns( g, seg_frame_array[ link.segment ] );
+	}
+}
+
+
+#else // USE_SSE2_FORWARD_KINEMATICS
+
+
+//
+//  アフィン変換による順運動学計算（SSE2 が使えない環境では、通常の体節の接続情報を使った計算を行う）
+//
+void  ForwardKinematicsAffine( const Posture & posture, int link_begin, int link_end, Matrix4f * seg_frame_array, Point3f * joi_pos_array )
+{
+	ForwardKinematicsLinks( posture, link_begin, link_end, seg_frame_array, joi_pos_array );
+}
+
+
+#endif // USE_SSE2_FORWARD_KINEMATICS
@@ -0,0 +1,27 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  SIMD命令を使用した順運動学計算（アフィン変換による計算）
+**/
+
+#ifndef  _FORWARD_KINEMATICS_SIMD_H_
+#define  _FORWARD_KINEMATICS_SIMD_H_
+
+
+#include "SimpleHuman.h"
+
+
+//
+//  アフィン変換（回転＋平行移動、3×4行列）による順運動学計算
+//  （各体節の変換を列ごとにSIMDレジスタに保持し、体節の接続情報の順に計算する。SSE2 が使えない環境では ForwardKinematicsLinks() で計算する）
+//  （体節の接続情報の範囲 [link_begin, link_end) の体節を計算する。範囲は link_begin の体節とその末端側の体節（全身の場合は [0, 接続情報の数)）とし、
+//    link_begin のルート側の体節の変換行列は計算済みであること。骨格の体節の接続情報が初期化されている必要がある）
+//
+void  ForwardKinematicsAffine( const Posture & posture, int link_begin, int link_end, Matrix4f * seg_frame_array, Point3f * joi_pos_array = NULL );
+
+
+#endif // _FORWARD_KINEMATICS_SIMD_H_
@@ -12,6 +12,7 @@
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
 #include "HumanBody.h"
+#include "InverseKinematicsLimb.h"
 
 
 //
@@ -41,6 +42,8 @@ HumanBody::HumanBody( const Skeleton * body ) : HumanBody()
 //
 HumanBody::~HumanBody()
 {
+	for ( int i = 0; i < NUM_LIMBS; i++ )
+		delete  limbs[ i ];
 	if ( segment_weights )
 		delete  segment_weights;
 	if ( segment_inertia )
@@ -118,10 +121,37 @@ void  HumanBody::SetPrimaryJoint( PrimaryJointType joint, const char * name )
 //
 void  HumanBody::SetLimbParameter( LimbType limb, LimbParameter * info )
 {
+	if ( limbs[ limb ] != info )
+		delete  limbs[ limb ];
 	limbs[ limb ] = info;
 }
 
 
+//
+//  逆運動学計算（解析的手法）のための手足の情報を、主要関節の番号と骨格から設定
+//
+void  HumanBody::InitLimbParameters()
+{
+	// 各手足の付け根・中間・末端の主要関節
+	static const PrimaryJointType  limb_joints[ NUM_LIMBS ][ 3 ] = {
+		{ JOI_R_HIP, JOI_R_KNEE, JOI_R_ANKLE },
+		{ JOI_L_HIP, JOI_L_KNEE, JOI_L_ANKLE },
+		{ JOI_R_SHOULDER, JOI_R_ELBOW, JOI_R_WRIST },
+		{ JOI_L_SHOULDER, JOI_L_ELBOW, JOI_L_WRIST } };
+
+	for ( int i = 0; i < NUM_LIMBS; i++ )
+	{
+		LimbParameter *  limb = new LimbParameter();
+		if ( !InitLimbParameter( skeleton, primary_joints[ limb_joints[ i ][ 0 ] ], primary_joints[ limb_joints[ i ][ 1 ] ], primary_joints[ limb_joints[ i ][ 2 ] ], *limb ) )
+		{
+			delete  limb;
+			limb = NULL;
+		}
+		SetLimbParameter( (LimbType) i, limb );
+	}
+}
+
+
 //
 //  体節の質量・慣性モーメント行列の設定
 //
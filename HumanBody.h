@@ -144,9 +144,13 @@ class  HumanBody
 	void  SetPrimarySegment( PrimarySegmentType segment, const char * name );
 	void  SetPrimaryJoint( PrimaryJointType joint, const char * name );
 
-	// 逆運動学計算（解析的手法）のための手足の情報の設定
+	// 逆運動学計算（解析的手法）のための手足の情報の設定（設定した情報はこのオブジェクトが削除する）
 	void  SetLimbParameter( LimbType limb, LimbParameter * info );
 
+	// 逆運動学計算（解析的手法）のための手足の情報を、主要関節の番号と骨格から設定
+	// （主要関節の設定後に呼び出す。関節が順に接続されていない手足の情報は NULL となる）
+	void  InitLimbParameters();
+
 	// 体節の質量・慣性モーメント行列の設定
 	void  SetPhysicalProperties( const float * segment_weights, const Matrix3f * segment_inertia );
 
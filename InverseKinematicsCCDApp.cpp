@@ -12,6 +12,7 @@
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
 #include "InverseKinematicsCCDApp.h"
+#include "JointPathTable.h"
 #include "BVH.h"
 
 // プロトタイプ宣言
@@ -32,6 +33,12 @@ InverseKinematicsCCDApp::InverseKinematicsCCDApp()
 	base_joint_no = -1;
 	ee_joint_no = -1;
 
+	ik_solver_type = IK_SOLVER_CCD;
+	last_ik_result.num_iterations = 0;
+	last_ik_result.residual_error = 0.0f;
+	last_ik_result.solve_time = 0.0f;
+	last_ik_result.converged = false;
+
 	draw_joints = true;
 }
 
@@ -133,6 +140,12 @@ void  InverseKinematicsCCDApp::Display()
 
 	// 現在のモードを表示
 	DrawTextInformation( 0, "Inverse Kinematics (CCD-IK)" );
+
+	// 逆運動学計算の手法と、最後の計算の繰り返し数・誤差・計算時間を表示
+	char  message[ 128 ];
+	sprintf( message, "Solver: %s (press 'i' to change)  iteration: %d  error: %.4f m  time: %.3f ms", 
+		GetIKSolver( ik_solver_type ).GetName(), last_ik_result.num_iterations, last_ik_result.residual_error, last_ik_result.solve_time );
+	DrawTextInformation( 1, message );
 }
 
 
@@ -185,6 +198,10 @@ void  InverseKinematicsCCDApp::Keyboard( unsigned char key, int mx, int my )
 	// r キーで姿勢をリセット
 	if ( key == 'r' )
 		Start();
+
+	// i キーで逆運動学計算の手法を変更
+	if ( key == 'i' )
+		ik_solver_type = (IKSolverType) ( ( ik_solver_type + 1 ) % NUM_IK_SOLVER_TYPES );
 }
 
 
@@ -195,116 +212,20 @@ void  InverseKinematicsCCDApp::Keyboard( unsigned char key, int mx, int my )
 //
 void  FindJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no, vector< int > & joint_path, vector< int > & joint_path_signs )
 {
-	// 出力の配列をクリア
-	joint_path.clear();
-	joint_path_signs.clear();
-
-	// 探索時の現在の関節・体節
-	const Joint *  joint = NULL;
-	const Segment *  segment = NULL;
-
-	// 末端関節から探索を開始
-	joint = body->joints[ ee_joint_no ];
-
-	// 末端関節からルート体節に向かうパスを探索
-	while ( true )
-	{
-		// ルート側の隣の関節を辿り、ルートに到達したら終了
-		segment = joint->segments[ 0 ];
-		if ( segment->index == 0 )
-			break;
-		joint = segment->joints[ 0 ];
-
-		// 現在の関節をパスに追加
-		joint_path.push_back( joint->index );
-
-		// 途中で支点関節に到達したら終了
-		if ( joint->index == base_joint_no )
-			break;
-	}
-
-	// 各関節における末端関節の方向を表す符号の配列を生成（全て子側に末端関節がある）
-	joint_path_signs.resize( joint_path.size(), 1 );
-
-
-	// 支点が常にルート体節、もしくは、末端関節とルート体節の間にあると仮定すれば、ここで終了しても構わない
-	// それ以外の場所に支点関節がある場合は、ルートから支点関節までのパスを求めて追加する処理が必要となる
-	// return;
-
-	// ※レポート課題
-
-	// 支点がルート体節 or 支点関節がルート体節から末端関節のパス上にある場合は、終了
-	if ( ( base_joint_no == -1 ) || ( joint->index == base_joint_no ) )
-		return;
-
-	// 支点関節からルート体節へ向かうパス
-	vector< int >  joint_path2;
-
-	// 探索処理の終了判定用フラグ
-	bool  termination = false;
-
-	// 支点関節から探索を開始
-	joint = body->joints[ base_joint_no ];
-
-	// 支点関節からルート体節に向かうパスを探索
-	while ( true )
-	{
-		// 末端からルートまでのパスと合流したかどうかを判定し、合流したら終了
-		for ( int i=0; i<joint_path.size(); i++ )
-		{
-			if ( joint_path[i] == joint->index )
-			{
-				// 末端からルートまでのパスを、合流した体節の前の関節まで縮小
-				joint_path.resize( i + 1 );
-				termination = true;
-				break;
-
-				printf("ok\n");
-			}
-		}
-		if ( termination )
-			break;
-
-		// 現在の関節をパスに追加
-		joint_path2.push_back( joint->index );
-
-		// ルート側の隣の関節を辿り、ルートに到達したら終了
-		segment = joint->segments[ 0 ];
-		if ( segment->index == 0 )
-			break;
-		joint = segment->joints[ 0 ];
-
-		// 末端関節に到達した場合（ルートと支点関節の間に末端関節がある場合）は、
-		// 末端関節からルートまでのパスはクリアして、支点関節から末端関節までのパスを使用
-		if ( joint->index == ee_joint_no )
-		{
-			joint_path.clear();
-			joint_path_signs.clear();
-			break;
-		}
-	}
-
-	// 末端からルートに向かうパスと、支点からルートに向かうパスを結合（後者は逆の順番で結合）
-	// 各関節における末端関節の方向を表す符号の配列を生成
-	joint_path_signs.resize( joint_path.size(), 1 );
-	for ( int i = 0; i < joint_path2.size(); i++ )
-	{
-		joint_path.push_back( joint_path2[joint_path2.size() - 1 - i] );
-		joint_path_signs.push_back( -1 );
-	}
-
-	return;
-
+	// 骨格モデルの関節のパスの表から取得（初回のみ探索し、以降は探索済みのパスをコピーする）
+	JointPathRef  path = GetJointPath( body, base_joint_no, ee_joint_no );
+	joint_path.assign( path.joints, path.joints + path.num_joints );
+	joint_path_signs.assign( path.signs, path.signs + path.num_joints );
 }
 
 
 //
-//  Inverse Kinematics 計算（CCD法）
+//  Inverse Kinematics 計算（選択中の手法で計算し、繰り返し数・誤差・計算時間を記録）
 //  入出力姿勢、支点関節番号（-1の場合はルートを支点とする）、末端関節番号、末端関節の目標位置を指定
 //
 void  InverseKinematicsCCDApp::ApplyInverseKinematics( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position )
 {
-	ApplyInverseKinematicsCCD( posture, base_joint_no, ee_joint_no, ee_joint_position );
+	last_ik_result = GetIKSolver( ik_solver_type ).Solve( posture, base_joint_no, ee_joint_no, ee_joint_position );
 }
 
 
@@ -314,16 +235,25 @@ void  InverseKinematicsCCDApp::ApplyInverseKinematics( Posture & posture, int ba
 //
 void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position )
 {
-	// 最大繰り返し数の設定
-	const int  max_iteration = 10;
+	// 最大繰り返し数 10 回、位置が収束したと判断するための閾値 1cm で計算
+	ApplyInverseKinematicsCCD( posture, base_joint_no, ee_joint_no, ee_joint_position, 10, 0.01f );
+}
 
-	// 位置が収束したと判断するための閾値の設定
-	const float  distance_threshold = 0.01f;
 
+//
+//  Inverse Kinematics 計算（CCD法）
+//  最大繰り返し数・収束判定の閾値を指定し、実行した繰り返し数を返す
+//  （residual_error を指定すると、計算後の末端関節の位置と目標位置の距離を出力）
+//  （change_threshold を指定すると、１回の繰り返しでの末端関節の移動距離がそれ以下になった時点で終了し、
+//    計算前に末端関節が既に目標位置にあれば繰り返し計算を行わない）
+//
+int  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position, 
+	int max_iteration, float distance_threshold, float * residual_error, float change_threshold )
+{
 
-	// 順運動学計算結果の格納用変数
-	vector< Matrix4f >  segment_frames;
-	vector< Point3f >   joint_positions;
+	// 順運動学計算結果の格納用変数（スレッドごとに再利用する）
+	static thread_local vector< Matrix4f >  segment_frames;
+	static thread_local vector< Point3f >   joint_positions;
 
 	// 骨格情報
 	const Skeleton *  body = posture.body;
@@ -366,27 +296,38 @@ void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_jo
 	Vector3f  vec;
 	float  dist = -1.0f;
 
+	// 繰り返し前の末端関節の位置
+	Point3f  prev_ee_pos;
+
 
 	// 引数チェック
 	if ( !posture.body || ( ee_joint_no == -1 ) || ( base_joint_no == ee_joint_no ) )
-		return;
+		return  0;
 
-	// 末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
-	vector< int >  joint_path, joint_path_signs;
-	FindJointPath( body, base_joint_no, ee_joint_no, joint_path, joint_path_signs );
+	// 末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を骨格モデルの関節のパスの表から取得
+	JointPathRef  path = GetJointPath( body, base_joint_no, ee_joint_no );
 
 	// 現在の姿勢での各体節・関節の位置・向きを計算（順運動学計算）
 	ForwardKinematics( posture, segment_frames, joint_positions );
 
+	// 末端関節が既に目標位置にあれば（前フレームの解から開始した場合など）、繰り返し計算は行わない
+	// （change_threshold を指定しない従来の呼び出しでは、計算結果が変わらないように判定しない）
+	vec.sub( ee_joint_position, joint_positions[ ee_joint_no ] );
+	if ( ( change_threshold > 0.0f ) && ( vec.lengthSquared() < distance_threshold * distance_threshold ) )
+		max_iteration = 0;
+
 	// CCD法の繰り返し計算（末端関節の位置が収束するか、一定回数繰り返したら終了する）
-	for ( int i = 0; i < max_iteration; i++ )
+	int  i;
+	for ( i = 0; i < max_iteration; i++ )
 	{
+		prev_ee_pos = joint_positions[ ee_joint_no ];
+
 		// 末端関節から支点関節に向かって順番に繰り返し
-		for ( int j = 0; j < joint_path.size(); j++ )
+		for ( int j = 0; j < path.num_joints; j++ )
 		{
 			// 現在の関節と支点側の体節を取得
-			joint = body->joints[ joint_path[ j ] ];
-			direction = (float) joint_path_signs[ j ];
+			joint = body->joints[ path.joints[ j ] ];
+			direction = (float) path.signs[ j ];
 			segment = ( direction > 0.0f ) ? joint->segments[ 0 ] : joint->segments[ 1 ];
 
 			// 末端関節の現在位置を取得
@@ -432,7 +373,8 @@ void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_jo
 			}
 
 			// 更新された姿勢にもとづいて、各体節・関節の位置・向きを再計算（順運動学計算）
-			MyForwardKinematics( posture, segment_frames, joint_positions );
+			// （回転を変更した関節より末端側の体節・関節のみを再計算する）
+			ForwardKinematicsSubtree( posture, joint->index, segment_frames, joint_positions );
 		}
 
 		// 収束判定、末端関節の目標位置と現在位置の距離が閾値以下になったら終了
@@ -440,8 +382,24 @@ void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_jo
 		vec.sub( ee_joint_position, ee_pos );
 		dist = vec.lengthSquared();
 		if ( dist < distance_threshold * distance_threshold )
+		{
+			i ++;
 			break;
+		}
+
+		// 末端関節の移動距離が閾値以下になったら（これ以上近づかなければ）終了
+		if ( ( change_threshold > 0.0f ) && ( ee_pos.distanceSquared( prev_ee_pos ) < change_threshold * change_threshold ) )
+		{
+			i ++;
+			break;
+		}
 	}
+
+	// 計算後の末端関節の位置と目標位置の距離を出力
+	if ( residual_error )
+		*residual_error = joint_positions[ ee_joint_no ].distance( ee_joint_position );
+
+	return  i;
 }
 
 
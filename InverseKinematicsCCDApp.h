@@ -15,6 +15,7 @@
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
 #include "SimpleHumanGLUT.h"
+#include "InverseKinematicsSolver.h"
 
 
 //
@@ -39,6 +40,12 @@ class  InverseKinematicsCCDApp : public GLUTBaseApp
 	vector< Point3f >  joint_world_positions;
 	vector< Point3f >  joint_screen_positions;
 
+	// 使用する逆運動学計算の手法
+	IKSolverType  ik_solver_type;
+
+	// 最後の逆運動学計算の結果（繰り返し数・誤差・計算時間）
+	IKSolveResult  last_ik_result;
+
   protected:
 	// 描画設定
 
@@ -77,7 +84,7 @@ class  InverseKinematicsCCDApp : public GLUTBaseApp
   public:
 	// Inverse Kinematics 処理
 
-	//  Inverse Kinematics 計算（CCD法）
+	//  Inverse Kinematics 計算（選択中の手法で計算）
 	virtual void  ApplyInverseKinematics( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position );
 
   public:
@@ -105,6 +112,12 @@ void  FindJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no,
 // Inverse Kinematics 計算（CCD法）
 void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position );
 
+// Inverse Kinematics 計算（CCD法、最大繰り返し数・収束判定の閾値を指定し、実行した繰り返し数を返す）
+// （change_threshold が正の場合は、１回の繰り返しでの末端関節の移動距離がそれ以下になった時点で終了し、
+//   計算前に末端関節が既に目標位置にあれば繰り返し計算を行わない）
+int  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position, 
+	int max_iteration, float distance_threshold, float * residual_error = NULL, float change_threshold = 0.0f );
+
 // 順運動学計算（※レポート課題）
 void  MyForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array );
 
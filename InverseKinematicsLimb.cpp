@@ -0,0 +1,269 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  手足の逆運動学計算（解析的手法）
+**/
+
+
+#include "InverseKinematicsLimb.h"
+
+// 標準算術関数
+#include <math.h>
+
+
+
+// 手足を伸ばしきらないための、付け根から目標位置までの距離の余裕
+static const float  limb_reach_margin = 1.0e-4f;
+
+// ベクトルの長さ・回転角度が微少とみなす閾値
+static const float  limb_epsilon = 1.0e-6f;
+
+
+
+//
+//  体節内の２つの関節の間の距離を取得
+//
+static float  GetJointDistance( const Segment * segment, int joint0, int joint1 )
+{
+	const Point3f *  pos0 = NULL;
+	const Point3f *  pos1 = NULL;
+	for ( int i = 0; i < segment->num_joints; i++ )
+	{
+		if ( segment->joints[ i ]->index == joint0 )
+			pos0 = &segment->joint_positions[ i ];
+		if ( segment->joints[ i ]->index == joint1 )
+			pos1 = &segment->joint_positions[ i ];
+	}
+	if ( !pos0 || !pos1 )
+		return  0.0f;
+	return  pos0->distance( *pos1 );
+}
+
+
+//
+//  体節内の関節の位置を取得
+//
+static Point3f  GetJointPosition( const Segment * segment, int joint_no )
+{
+	for ( int i = 0; i < segment->num_joints; i++ )
+	{
+		if ( segment->joints[ i ]->index == joint_no )
+			return  segment->joint_positions[ i ];
+	}
+	return  Point3f( 0.0f, 0.0f, 0.0f );
+}
+
+
+//
+//  骨格モデルから手足の情報を生成
+//
+bool  InitLimbParameter( const Skeleton * body, int root_joint, int middle_joint, int end_joint, LimbParameter & limb )
+{
+	if ( !body || ( root_joint < 0 ) || ( middle_joint < 0 ) || ( end_joint < 0 ) )
+		return  false;
+	if ( ( root_joint >= body->num_joints ) || ( middle_joint >= body->num_joints ) || ( end_joint >= body->num_joints ) )
+		return  false;
+
+	// ３つの関節が２つの体節で順に接続されているかを確認
+	const Segment *  upper = body->joints[ root_joint ]->segments[ 1 ];
+	const Segment *  lower = body->joints[ middle_joint ]->segments[ 1 ];
+	if ( ( body->joints[ middle_joint ]->segments[ 0 ] != upper ) || ( body->joints[ end_joint ]->segments[ 0 ] != lower ) )
+		return  false;
+
+	limb.root_joint = root_joint;
+	limb.middle_joint = middle_joint;
+	limb.end_joint = end_joint;
+	limb.upper_segment = upper->index;
+	limb.lower_segment = lower->index;
+
+	// 体節の長さを計算
+	limb.upper_length = GetJointDistance( upper, root_joint, middle_joint );
+	limb.lower_length = GetJointDistance( lower, middle_joint, end_joint );
+	if ( ( limb.upper_length < limb_epsilon ) || ( limb.lower_length < limb_epsilon ) )
+		return  false;
+
+	// 初期姿勢での付け根側・末端側の体節の向き（付け根側の体節のローカル座標系）
+	Vector3f  upper_dir, lower_dir;
+	upper_dir.sub( GetJointPosition( upper, middle_joint ), GetJointPosition( upper, root_joint ) );
+	lower_dir.sub( GetJointPosition( lower, end_joint ), GetJointPosition( lower, middle_joint ) );
+	upper_dir.normalize();
+	lower_dir.normalize();
+
+	// 中間関節を曲げる回転軸を計算（初期姿勢で曲がっていればその向き、伸びきっていれば体節のX軸に近い向きとする）
+	limb.bend_axis.cross( lower_dir, upper_dir );
+	if ( limb.bend_axis.length() < 1.0e-3f )
+	{
+		Vector3f  x_axis( 1.0f, 0.0f, 0.0f );
+		limb.bend_axis.scaleAdd( - upper_dir.dot( x_axis ), upper_dir, x_axis );
+		if ( limb.bend_axis.length() < 1.0e-3f )
+			limb.bend_axis.set( 0.0f, 0.0f, 1.0f );
+	}
+	limb.bend_axis.normalize();
+
+	return  true;
+}
+
+
+//
+//  指定の軸まわりの回転行列を計算（軸は正規化されているものとする）
+//
+static inline void  SetAxisRotation( const Vector3f & axis, float angle, Matrix3f & rot )
+{
+	rot.set( AxisAngle4f( axis, angle ) );
+}
+
+
+//
+//  ２つのベクトルのなす角を計算
+//
+static inline float  GetVectorAngle( const Vector3f & v0, const Vector3f & v1 )
+{
+	float  len = v0.length() * v1.length();
+	if ( len < limb_epsilon )
+		return  0.0f;
+	float  c = v0.dot( v1 ) / len;
+	if ( c > 1.0f )
+		c = 1.0f;
+	else if ( c < -1.0f )
+		c = -1.0f;
+	return  acosf( c );
+}
+
+
+//
+//  余弦定理から三角形の角度を計算（辺 a, b の間の角度、c は対辺）
+//
+static inline float  GetTriangleAngle( float a, float b, float c )
+{
+	float  cos_angle = ( a * a + b * b - c * c ) / ( 2.0f * a * b );
+	if ( cos_angle > 1.0f )
+		cos_angle = 1.0f;
+	else if ( cos_angle < -1.0f )
+		cos_angle = -1.0f;
+	return  acosf( cos_angle );
+}
+
+
+//
+//  手足の逆運動学計算
+//  （１．中間関節を曲げて付け根から末端までの距離を目標位置までの距離に合わせる
+//    ２．付け根関節を回転して末端を目標位置の方向に向ける
+//    ３．ポールの位置が指定されていれば、付け根から目標位置への軸まわりに回転して中間関節をポールの方向に向ける）
+//
+bool  ApplyInverseKinematicsLimb( Posture & posture, const LimbParameter & limb, const Point3f & end_position, const Point3f * pole_position )
+{
+	const Skeleton *  body = posture.body;
+	if ( !body )
+		return  false;
+
+	// 現在の姿勢での各体節・関節の位置・向きを計算（順運動学計算）
+	// （計算結果の配列はスレッドごとに再利用する）
+	static thread_local vector< Matrix4f >  segment_frames;
+	static thread_local vector< Point3f >  joint_positions;
+	ForwardKinematics( posture, segment_frames, joint_positions );
+
+	// 付け根・中間・末端関節の位置と、付け根の親・付け根側・末端側の体節の向きを取得
+	const Point3f &  a = joint_positions[ limb.root_joint ];
+	const Point3f &  b = joint_positions[ limb.middle_joint ];
+	const Point3f &  c = joint_positions[ limb.end_joint ];
+	Matrix3f  parent_rot, upper_rot, lower_rot;
+	segment_frames[ body->joints[ limb.root_joint ]->segments[ 0 ]->index ].getRotationScale( &parent_rot );
+	segment_frames[ limb.upper_segment ].getRotationScale( &upper_rot );
+	segment_frames[ limb.lower_segment ].getRotationScale( &lower_rot );
+
+	// 付け根から目標位置までの距離（手足の長さの範囲内に補正）
+	Vector3f  at;
+	at.sub( end_position, a );
+	float  target_dist = at.length();
+	float  max_dist = limb.upper_length + limb.lower_length - limb_reach_margin;
+	float  min_dist = fabsf( limb.upper_length - limb.lower_length ) + limb_reach_margin;
+	bool  reachable = ( target_dist <= max_dist ) && ( target_dist >= min_dist );
+	if ( target_dist > max_dist )
+		target_dist = max_dist;
+	if ( target_dist < min_dist )
+		target_dist = min_dist;
+
+	// 現在の各関節の間のベクトル
+	Vector3f  ab, bc, ac;
+	ab.sub( b, a );
+	bc.sub( c, b );
+	ac.sub( c, a );
+
+	// 中間関節を曲げる回転軸（現在の曲げる向き、伸びきっていれば手足の情報の回転軸）
+	Vector3f  bend_axis;
+	bend_axis.cross( ac, ab );
+	if ( bend_axis.length() < limb_epsilon * ac.length() )
+		upper_rot.transform( limb.bend_axis, &bend_axis );
+	bend_axis.normalize();
+
+	// １．目標の距離になるように、付け根関節と中間関節の角度を変更
+	Vector3f  ba;
+	ba.negate( ab );
+	float  root_angle = GetTriangleAngle( limb.upper_length, target_dist, limb.lower_length ) - GetVectorAngle( ac, ab );
+	float  middle_angle = GetTriangleAngle( limb.upper_length, limb.lower_length, target_dist ) - GetVectorAngle( ba, bc );
+	Matrix3f  root_bend, middle_bend;
+	SetAxisRotation( bend_axis, root_angle, root_bend );
+	SetAxisRotation( bend_axis, middle_angle, middle_bend );
+
+	Matrix3f  new_upper_rot, new_lower_rot, lower_bend;
+	lower_bend.mul( root_bend, middle_bend );
+	new_upper_rot.mul( root_bend, upper_rot );
+	new_lower_rot.mul( lower_bend, lower_rot );
+
+	// 曲げた後の付け根から末端へのベクトルを計算
+	Vector3f  new_ab, new_bc, new_ac;
+	root_bend.transform( ab, &new_ab );
+	lower_bend.transform( bc, &new_bc );
+	new_ac.add( new_ab, new_bc );
+
+	// ２．末端が目標位置の方向を向くように、付け根関節を回転
+	Matrix3f  aim;
+	aim.setIdentity();
+	Vector3f  aim_axis;
+	aim_axis.cross( new_ac, at );
+	float  aim_angle = GetVectorAngle( new_ac, at );
+	if ( ( aim_axis.length() > limb_epsilon * new_ac.length() * at.length() ) && ( aim_angle > limb_epsilon ) )
+	{
+		aim_axis.normalize();
+		SetAxisRotation( aim_axis, aim_angle, aim );
+	}
+	else if ( aim_angle > 1.0f )
+	{
+		// 目標位置が正反対の方向にあれば、中間関節を曲げる回転軸まわりに回転
+		SetAxisRotation( bend_axis, aim_angle, aim );
+	}
+	new_upper_rot.mul( aim, new_upper_rot );
+	new_lower_rot.mul( aim, new_lower_rot );
+	Vector3f  aimed_ab;
+	aim.transform( new_ab, &aimed_ab );
+
+	// ３．中間関節がポールの方向に曲がるように、付け根から目標位置への軸まわりに回転
+	if ( pole_position && ( at.length() > limb_epsilon ) )
+	{
+		Vector3f  axis, pole, middle;
+		axis.normalize( at );
+		pole.sub( *pole_position, a );
+		pole.scaleAdd( - axis.dot( pole ), axis, pole );
+		middle.scaleAdd( - axis.dot( aimed_ab ), axis, aimed_ab );
+		if ( ( pole.length() > limb_epsilon ) && ( middle.length() > limb_epsilon ) )
+		{
+			Vector3f  cross;
+			cross.cross( middle, pole );
+			float  twist_angle = atan2f( axis.dot( cross ), middle.dot( pole ) );
+			Matrix3f  twist;
+			SetAxisRotation( axis, twist_angle, twist );
+			new_upper_rot.mul( twist, new_upper_rot );
+			new_lower_rot.mul( twist, new_lower_rot );
+		}
+	}
+
+	// 体節の向きから関節の相対回転を計算
+	posture.joint_rotations[ limb.root_joint ].mulTransposeLeft( parent_rot, new_upper_rot );
+	posture.joint_rotations[ limb.middle_joint ].mulTransposeLeft( new_upper_rot, new_lower_rot );
+
+	return  reachable;
+}
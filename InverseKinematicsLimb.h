@@ -0,0 +1,51 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  手足の逆運動学計算（解析的手法）
+**/
+
+#ifndef  _INVERSE_KINEMATICS_LIMB_H_
+#define  _INVERSE_KINEMATICS_LIMB_H_
+
+
+#include "SimpleHuman.h"
+
+
+//
+//  逆運動学計算（解析的手法）のための手足の情報
+//  （付け根・中間・末端の３つの関節と、その間の２つの体節からなる手足を対象とする）
+//
+struct  LimbParameter
+{
+	// 付け根・中間・末端の関節番号（股関節・膝・足首、または、肩・肘・手首）
+	int  root_joint;
+	int  middle_joint;
+	int  end_joint;
+
+	// 付け根側・末端側の体節番号（大腿・下腿、または、上腕・前腕）
+	int  upper_segment;
+	int  lower_segment;
+
+	// 付け根側・末端側の体節の長さ（関節間の距離）
+	float  upper_length;
+	float  lower_length;
+
+	// 中間関節を曲げる回転軸（付け根側の体節のローカル座標系、手足が伸びきっていて曲げる向きが決まらない時に使用）
+	Vector3f  bend_axis;
+};
+
+
+// 骨格モデルから手足の情報を生成（３つの関節が２つの体節で順に接続されていなければ false を返す）
+bool  InitLimbParameter( const Skeleton * body, int root_joint, int middle_joint, int end_joint, LimbParameter & limb );
+
+// 手足の逆運動学計算（末端関節を目標位置に移動するように、付け根・中間関節の回転を解析的に計算）
+// （順運動学計算は１回のみで、繰り返し計算は行わない。目標位置に届かない場合は目標位置の方向に伸ばして false を返す）
+// （pole_position を指定すると、中間関節がその位置の方向に曲がるようにする。NULL の場合は現在の曲げる向きを維持する）
+bool  ApplyInverseKinematicsLimb( Posture & posture, const LimbParameter & limb, const Point3f & end_position, const Point3f * pole_position = NULL );
+
+
+#endif // _INVERSE_KINEMATICS_LIMB_H_
@@ -0,0 +1,735 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  逆運動学計算の手法の切り替え（CCD法・FABRIK法・減衰最小二乗法）
+**/
+
+
+#include "InverseKinematicsSolver.h"
+#include "InverseKinematicsCCDApp.h"
+#include "JointPathTable.h"
+
+// 標準算術関数
+#include <math.h>
+
+// 計算時間の計測
+#include <chrono>
+
+// 関節の配列の探索
+#include <algorithm>
+
+
+
+// ベクトルの長さ・回転角度が微少とみなす閾値
+static const float  ik_epsilon = 1.0e-6f;
+
+
+
+//
+//  前回の解から計算を開始するための補助処理
+//
+
+// 計算前の入力姿勢の回転（今回の解での変化量の計算用、スレッドごとに再利用する）
+static thread_local vector< Matrix3f >  warm_start_input_rotations;
+
+
+//
+//  前回の解での回転の変化量を入力姿勢に加える
+//  （異なる関節のつながりの計算に使用された情報であれば、前回の解を破棄して、対象の関節を設定し直す）
+//
+static void  BeginWarmStart( IKWarmStartState * state, Posture & posture, const int * joints, int num_joints )
+{
+	bool  same_joints = ( state->body == posture.body ) && ( (int) state->joints.size() == num_joints );
+	for ( int i = 0; same_joints && ( i < num_joints ); i++ )
+		same_joints = ( state->joints[ i ] == joints[ i ] );
+	if ( !same_joints )
+	{
+		state->Reset();
+		state->body = posture.body;
+		state->joints.assign( joints, joints + num_joints );
+	}
+
+	warm_start_input_rotations.resize( num_joints );
+	for ( int i = 0; i < num_joints; i++ )
+		warm_start_input_rotations[ i ] = posture.joint_rotations[ joints[ i ] ];
+
+	if ( state->is_valid )
+	{
+		Matrix3f  delta;
+		for ( int i = 0; i < num_joints; i++ )
+		{
+			Matrix3f &  rot = posture.joint_rotations[ joints[ i ] ];
+			delta.set( state->joint_deltas[ i ] );
+			rot.mul( delta, rot );
+		}
+	}
+}
+
+
+//
+//  今回の解での回転の変化量と繰り返し数を記録
+//  （四元数として正規化して保持し、フレームごとに誤差が蓄積しないようにする）
+//
+static void  EndWarmStart( IKWarmStartState * state, const Posture & posture, int num_iterations )
+{
+	int  num_joints = (int) state->joints.size();
+	state->joint_deltas.resize( num_joints );
+	Matrix3f  delta;
+	for ( int i = 0; i < num_joints; i++ )
+	{
+		delta.mulTransposeRight( posture.joint_rotations[ state->joints[ i ] ], warm_start_input_rotations[ i ] );
+		state->joint_deltas[ i ].set( delta );
+		state->joint_deltas[ i ].normalize();
+	}
+	state->is_valid = true;
+	state->AddIterations( num_iterations );
+}
+
+
+
+//
+//  逆運動学計算の手法の基底クラス
+//
+
+// コンストラクタ
+IKSolver::IKSolver( int iteration, float threshold )
+{
+	max_iteration = iteration;
+	distance_threshold = threshold;
+	change_threshold = 1.0e-4f;
+}
+
+
+//
+//  逆運動学計算（各手法の繰り返し計算を呼び出し、繰り返し数・誤差・計算時間を記録）
+//  （前回の解の情報が指定されていれば、前回の解での回転の変化量を入力姿勢に加えてから計算を開始し、
+//    計算後に今回の解での回転の変化量を記録する）
+//
+IKSolveResult  IKSolver::Solve( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, IKWarmStartState * state ) const
+{
+	IKSolveResult  result;
+	result.num_iterations = 0;
+	result.residual_error = 0.0f;
+	result.solve_time = 0.0f;
+	result.converged = false;
+
+	// 引数チェック
+	if ( !posture.body || ( ee_joint_no < 0 ) || ( ee_joint_no >= posture.body->num_joints ) || ( base_joint_no == ee_joint_no ) )
+		return  result;
+
+	chrono::steady_clock::time_point  begin = chrono::steady_clock::now();
+
+	// 前回の解から計算を開始
+	JointPathRef  path = GetJointPath( posture.body, base_joint_no, ee_joint_no );
+	if ( state )
+		BeginWarmStart( state, posture, path.joints, path.num_joints );
+
+	// （前回の解から開始する場合のみ移動距離による終了判定を行い、従来の呼び出しでは計算結果を変えない）
+	result.num_iterations = SolveIterations( posture, base_joint_no, ee_joint_no, ee_joint_position, state ? change_threshold : 0.0f, result.residual_error );
+
+	// 今回の解を記録
+	if ( state )
+		EndWarmStart( state, posture, result.num_iterations );
+
+	result.solve_time = chrono::duration< float, milli >( chrono::steady_clock::now() - begin ).count();
+	result.converged = ( result.residual_error <= distance_threshold );
+
+	return  result;
+}
+
+
+
+//
+//  前回の逆運動学計算の解を次の計算の初期値とするための情報
+//
+
+// コンストラクタ
+IKWarmStartState::IKWarmStartState()
+{
+	body = NULL;
+	is_valid = false;
+}
+
+
+// 前回の解を破棄
+void  IKWarmStartState::Reset()
+{
+	joint_deltas.clear();
+	is_valid = false;
+}
+
+
+// 繰り返し数の分布を記録
+void  IKWarmStartState::AddIterations( int num_iterations )
+{
+	if ( num_iterations < 0 )
+		return;
+	if ( num_iterations >= (int) iteration_histogram.size() )
+		iteration_histogram.resize( num_iterations + 1, 0 );
+	iteration_histogram[ num_iterations ] ++;
+}
+
+
+// 繰り返し数の分布をクリア
+void  IKWarmStartState::ClearHistogram()
+{
+	iteration_histogram.clear();
+}
+
+
+// 記録した計算回数を取得
+int  IKWarmStartState::GetNumSolves() const
+{
+	int  num_solves = 0;
+	for ( int i = 0; i < (int) iteration_histogram.size(); i++ )
+		num_solves += iteration_histogram[ i ];
+	return  num_solves;
+}
+
+
+// 記録した計算の平均繰り返し数を取得
+float  IKWarmStartState::GetMeanIterations() const
+{
+	int  num_solves = 0, num_iterations = 0;
+	for ( int i = 0; i < (int) iteration_histogram.size(); i++ )
+	{
+		num_solves += iteration_histogram[ i ];
+		num_iterations += iteration_histogram[ i ] * i;
+	}
+	return  ( num_solves > 0 ) ? (float) num_iterations / num_solves : 0.0f;
+}
+
+
+
+//
+//  以下、各手法で共通の補助処理
+//
+
+
+//
+//  関節にワールド座標系での回転を適用
+//  （関節の親側の体節の向き S を使って、関節の回転 R を S^-1 * rot * S * R に変更する）
+//  （S^-1 の代わりに転置を使うと、S の誤差が繰り返しのたびに拡大して回転行列が発散するため、逆行列を使う）
+//
+static void  RotateJointGlobal( Posture & posture, int joint_no, const vector< Matrix4f > & segment_frames, const Matrix3f & rot )
+{
+	Matrix3f  parent_rot, inv_parent_rot, local_rot;
+	segment_frames[ posture.body->joints[ joint_no ]->segments[ 0 ]->index ].getRotationScale( &parent_rot );
+	inv_parent_rot.invert( parent_rot );
+
+	local_rot.mul( inv_parent_rot, rot );
+	local_rot.mul( local_rot, parent_rot );
+	posture.joint_rotations[ joint_no ].mul( local_rot, posture.joint_rotations[ joint_no ] );
+}
+
+
+//
+//  関節の位置を、隣の関節の位置から指定の距離になるように移動
+//  （２つの関節の位置が一致していて方向が決まらない場合は移動しない）
+//
+static inline void  PlaceJoint( const Point3f & fixed, float length, Point3f & moved )
+{
+	Vector3f  dir;
+	dir.sub( moved, fixed );
+	float  dist = dir.length();
+	if ( dist < ik_epsilon )
+		return;
+	moved.scaleAdd( length / dist, dir, fixed );
+}
+
+
+
+//
+//  CCD法
+//  （InverseKinematicsCCDApp の ApplyInverseKinematicsCCD() を使用）
+//
+int  CCDIKSolver::SolveIterations( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, float min_change, float & residual_error ) const
+{
+	return  ApplyInverseKinematicsCCD( posture, base_joint_no, ee_joint_no, ee_joint_position, max_iteration, distance_threshold, &residual_error, min_change );
+}
+
+
+
+//
+//  FABRIK法
+//  （１．末端関節を目標位置に置き、末端側から順に各関節を体節の長さを保つように移動
+//    ２．支点側の関節を元の位置に戻し、支点側から順に各関節を体節の長さを保つように移動
+//    ３．１・２を繰り返した後、各関節の位置が実現されるように、支点側から順に関節の回転を変更）
+//
+int  FABRIKSolver::SolveIterations( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, float min_change, float & residual_error ) const
+{
+	// 順運動学計算結果・計算用の配列（スレッドごとに再利用する）
+	static thread_local vector< Matrix4f >  segment_frames;
+	static thread_local vector< Point3f >  joint_positions;
+	static thread_local vector< Point3f >  points;
+	static thread_local vector< float >  lengths;
+
+	ForwardKinematics( posture, segment_frames, joint_positions );
+
+	// 末端関節を動かす関節の配列を、骨格モデルの関節のパスの表から取得（支点側の関節から順に並んでいる）
+	// （支点関節とルートの間にある関節を回転しても、ルートを移動しないと末端関節は動かないため、対象外とする）
+	JointPathRef  path = GetJointPath( posture.body, base_joint_no, ee_joint_no );
+	const int *  chain = path.chain;
+	int  num_chain = path.num_chain;
+	if ( num_chain == 0 )
+	{
+		residual_error = joint_positions[ ee_joint_no ].distance( ee_joint_position );
+		return  0;
+	}
+
+	// 各関節の位置と関節間の距離を取得（最後の要素は末端関節）
+	points.resize( num_chain + 1 );
+	lengths.resize( num_chain );
+	float  total_length = 0.0f;
+	for ( int i = 0; i < num_chain; i++ )
+		points[ i ] = joint_positions[ chain[ i ] ];
+	points[ num_chain ] = joint_positions[ ee_joint_no ];
+	for ( int i = 0; i < num_chain; i++ )
+	{
+		lengths[ i ] = points[ i ].distance( points[ i + 1 ] );
+		total_length += lengths[ i ];
+	}
+	const Point3f  origin = points[ 0 ];
+
+	int  iteration = 0;
+
+	// 目標位置に届かない場合は、目標位置の方向に伸ばす
+	if ( origin.distance( ee_joint_position ) >= total_length )
+	{
+		for ( int i = 0; i < num_chain; i++ )
+		{
+			Point3f  target = ee_joint_position;
+			PlaceJoint( points[ i ], lengths[ i ], target );
+			if ( lengths[ i ] >= ik_epsilon )
+				points[ i + 1 ] = target;
+		}
+		iteration = 1;
+	}
+	// 目標位置に届く場合は、末端関節の位置が収束するか、一定回数繰り返すまで移動を繰り返す
+	else
+	{
+		for ( ; iteration < max_iteration; iteration++ )
+		{
+			if ( points[ num_chain ].distance( ee_joint_position ) < distance_threshold )
+				break;
+			Point3f  prev_ee_pos = points[ num_chain ];
+
+			// 末端関節を目標位置に置き、末端側から順に移動
+			points[ num_chain ] = ee_joint_position;
+			for ( int i = num_chain - 1; i >= 0; i-- )
+				PlaceJoint( points[ i + 1 ], lengths[ i ], points[ i ] );
+
+			// 支点側の関節を元の位置に戻し、支点側から順に移動
+			points[ 0 ] = origin;
+			for ( int i = 0; i < num_chain; i++ )
+				PlaceJoint( points[ i ], lengths[ i ], points[ i + 1 ] );
+
+			// 末端関節の移動距離が閾値以下になったら終了
+			if ( points[ num_chain ].distance( prev_ee_pos ) < min_change )
+			{
+				iteration ++;
+				break;
+			}
+		}
+	}
+
+	// 支点側の関節から順に、次の関節が計算した位置に来るように関節を回転
+	// （次の関節の方向を変える最小の回転を適用し、回転した関節より末端側の体節・関節の位置・向きを再計算）
+	for ( int i = 0; i < num_chain; i++ )
+	{
+		if ( lengths[ i ] < ik_epsilon )
+			continue;
+
+		const Point3f &  joint_pos = joint_positions[ chain[ i ] ];
+		const Point3f &  next_pos = joint_positions[ ( i + 1 < num_chain ) ? chain[ i + 1 ] : ee_joint_no ];
+		Vector3f  curr_vec, goal_vec, axis;
+		curr_vec.sub( next_pos, joint_pos );
+		goal_vec.sub( points[ i + 1 ], joint_pos );
+		axis.cross( curr_vec, goal_vec );
+		float  axis_length = axis.length();
+		if ( axis_length < ik_epsilon * curr_vec.length() * goal_vec.length() )
+			continue;
+		float  angle = atan2f( axis_length, curr_vec.dot( goal_vec ) );
+
+		axis.scale( 1.0f / axis_length );
+		Matrix3f  rot;
+		rot.set( AxisAngle4f( axis, angle ) );
+		RotateJointGlobal( posture, chain[ i ], segment_frames, rot );
+		ForwardKinematicsSubtree( posture, chain[ i ], segment_frames, joint_positions );
+	}
+
+	residual_error = joint_positions[ ee_joint_no ].distance( ee_joint_position );
+	return  iteration;
+}
+
+
+
+//
+//  減衰最小二乗法
+//
+
+// コンストラクタ
+DLSIKSolver::DLSIKSolver() : IKSolver( 20, 0.01f )
+{
+	damping = 0.1f;
+	max_step = 0.2f;
+}
+
+
+//
+//  対称正定値行列の連立一次方程式 A x = b を解く（コレスキー分解、A は n×n の行優先の配列で、分解後の値に置き換える）
+//  （解は b に上書きする。正定値でなければ false を返す）
+//
+static bool  SolveSymmetricPositiveDefinite( float * a, int n, float * b )
+{
+	// A = L L^T に分解（L は A の下三角部分に格納）
+	for ( int j = 0; j < n; j++ )
+	{
+		float  d = a[ j * n + j ];
+		for ( int k = 0; k < j; k++ )
+			d -= a[ j * n + k ] * a[ j * n + k ];
+		if ( d <= 0.0f )
+			return  false;
+		d = sqrtf( d );
+		a[ j * n + j ] = d;
+
+		for ( int i = j + 1; i < n; i++ )
+		{
+			float  v = a[ i * n + j ];
+			for ( int k = 0; k < j; k++ )
+				v -= a[ i * n + k ] * a[ j * n + k ];
+			a[ i * n + j ] = v / d;
+		}
+	}
+
+	// L y = b、L^T x = y を順に解く
+	for ( int i = 0; i < n; i++ )
+	{
+		for ( int k = 0; k < i; k++ )
+			b[ i ] -= a[ i * n + k ] * b[ k ];
+		b[ i ] /= a[ i * n + i ];
+	}
+	for ( int i = n - 1; i >= 0; i-- )
+	{
+		for ( int k = i + 1; k < n; k++ )
+			b[ i ] -= a[ k * n + i ] * b[ k ];
+		b[ i ] /= a[ i * n + i ];
+	}
+	return  true;
+}
+
+
+//
+//  減衰最小二乗法の繰り返し計算（１つの末端関節）
+//
+int  DLSIKSolver::SolveIterations( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, float min_change, float & residual_error ) const
+{
+	IKTarget  target;
+	target.ee_joint_no = ee_joint_no;
+	target.position = ee_joint_position;
+	target.weight = 1.0f;
+	return  SolveTargets( posture, base_joint_no, &target, 1, min_change, residual_error );
+}
+
+
+//
+//  複数の末端関節の逆運動学計算（繰り返し数・誤差・計算時間を記録）
+//
+IKSolveResult  DLSIKSolver::SolveMultiTarget( Posture & posture, int base_joint_no, const IKTarget * targets, int num_targets, IKWarmStartState * state ) const
+{
+	IKSolveResult  result;
+	result.num_iterations = 0;
+	result.residual_error = 0.0f;
+	result.solve_time = 0.0f;
+	result.converged = false;
+
+	// 引数チェック
+	if ( !posture.body || !targets || ( num_targets <= 0 ) || ( num_targets > 32 ) )
+		return  result;
+	for ( int t = 0; t < num_targets; t++ )
+	{
+		if ( ( targets[ t ].ee_joint_no < 0 ) || ( targets[ t ].ee_joint_no >= posture.body->num_joints ) || ( targets[ t ].ee_joint_no == base_joint_no ) )
+			return  result;
+	}
+
+	chrono::steady_clock::time_point  begin = chrono::steady_clock::now();
+
+	// 前回の解から計算を開始（全ての末端関節のパス上の関節を対象とする）
+	static thread_local vector< int >  state_joints;
+	if ( state )
+	{
+		state_joints.clear();
+		for ( int t = 0; t < num_targets; t++ )
+		{
+			JointPathRef  path = GetJointPath( posture.body, base_joint_no, targets[ t ].ee_joint_no );
+			for ( int i = 0; i < path.num_chain; i++ )
+				if ( find( state_joints.begin(), state_joints.end(), path.chain[ i ] ) == state_joints.end() )
+					state_joints.push_back( path.chain[ i ] );
+		}
+		BeginWarmStart( state, posture, state_joints.data(), (int) state_joints.size() );
+	}
+
+	result.num_iterations = SolveTargets( posture, base_joint_no, targets, num_targets, state ? change_threshold : 0.0f, result.residual_error );
+
+	// 今回の解を記録
+	if ( state )
+		EndWarmStart( state, posture, result.num_iterations );
+
+	result.solve_time = chrono::duration< float, milli >( chrono::steady_clock::now() - begin ).count();
+	result.converged = ( result.residual_error <= distance_threshold );
+
+	return  result;
+}
+
+
+//
+//  減衰最小二乗法の繰り返し計算（複数の末端関節）
+//  （全ての末端関節の３次元の誤差を並べたベクトル e と、各関節の３軸まわりの回転をまとめたヤコビ行列 J を使い、
+//    回転の変化量を Δθ = J^T (J J^T + λ^2 I)^-1 e で計算する。重み w の末端関節の行には √w をかける）
+//  （末端関節 s の行・関節 j の軸 k の列は k × r_sj（r_sj は関節 j から末端関節 s へのベクトル、関節 j を通らない末端関節は 0）となるため、
+//    J J^T の (s, t) のブロックは Σ ( (r_sj・r_tj) I - r_tj r_sj^T ) 、
+//    関節 j の回転の変化量（ワールド座標系の回転ベクトル）は Σ r_tj × y_t（y = (J J^T + λ^2 I)^-1 e）となる）
+//  （全ての末端関節の回転を１回の繰り返しでまとめて更新し、順運動学計算も共通に行うため、
+//    末端関節ごとに順番に計算する場合と異なり、背骨などの共通の関節の回転が互いの結果を崩すことがない）
+//
+int  DLSIKSolver::SolveTargets( Posture & posture, int base_joint_no, const IKTarget * targets, int num_targets, float min_change, float & residual_error ) const
+{
+	// 順運動学計算結果・計算用の配列（スレッドごとに再利用する）
+	static thread_local vector< Matrix4f >  segment_frames;
+	static thread_local vector< Point3f >  joint_positions;
+	static thread_local vector< JointPathRef >  paths;
+	static thread_local vector< int >  joints;
+	static thread_local vector< unsigned int >  joint_target_masks;
+	static thread_local vector< int >  fk_joints;
+	static thread_local vector< float >  target_weights, target_steps;
+	static thread_local vector< Point3f >  ee_positions;
+	static thread_local vector< float >  matrix, rhs;
+
+	ForwardKinematics( posture, segment_frames, joint_positions );
+
+	// 各末端関節を動かす関節の配列を、骨格モデルの関節のパスの表から取得し、
+	// 全ての末端関節の関節をまとめた配列と、各関節がどの末端関節を動かすか（末端関節の番号のビット）を作成
+	// （支点関節とルートの間にある関節を回転しても、ルートを移動しないと末端関節は動かないため、対象外とする）
+	paths.resize( num_targets );
+	joints.clear();
+	joint_target_masks.clear();
+	fk_joints.clear();
+	target_weights.resize( num_targets );
+	target_steps.resize( num_targets );
+	float  max_chain_length = 0.0f;
+	for ( int t = 0; t < num_targets; t++ )
+	{
+		const JointPathRef &  path = paths[ t ] = GetJointPath( posture.body, base_joint_no, targets[ t ].ee_joint_no );
+		for ( int i = 0; i < path.num_chain; i++ )
+		{
+			int  slot = (int)( find( joints.begin(), joints.end(), path.chain[ i ] ) - joints.begin() );
+			if ( slot == (int) joints.size() )
+			{
+				joints.push_back( path.chain[ i ] );
+				joint_target_masks.push_back( 0 );
+			}
+			joint_target_masks[ slot ] |= 1u << t;
+		}
+
+		// 回転の変更後に順運動学計算を行う関節（各末端関節の支点側の最初の関節）
+		if ( ( path.num_chain > 0 ) && ( find( fk_joints.begin(), fk_joints.end(), path.chain[ 0 ] ) == fk_joints.end() ) )
+			fk_joints.push_back( path.chain[ 0 ] );
+
+		// 関節のつながりの長さ（１回の移動距離の制限と減衰係数に使用）
+		float  chain_length = 0.0f;
+		for ( int i = 0; i < path.num_chain; i++ )
+			chain_length += joint_positions[ path.chain[ i ] ].distance( joint_positions[ ( i + 1 < path.num_chain ) ? path.chain[ i + 1 ] : targets[ t ].ee_joint_no ] );
+		if ( max_chain_length < chain_length )
+			max_chain_length = chain_length;
+
+		target_weights[ t ] = sqrtf( ( targets[ t ].weight > 0.0f ) ? targets[ t ].weight : 0.0f );
+		target_steps[ t ] = max_step * chain_length;
+	}
+	int  num_joints = (int) joints.size();
+	int  n = num_targets * 3;
+	float  lambda = damping * max_chain_length;
+	ee_positions.resize( num_targets );
+	matrix.resize( n * n );
+	rhs.resize( n );
+
+	int  iteration = 0;
+	for ( ; ( iteration < max_iteration ) && ( num_joints > 0 ); iteration++ )
+	{
+		// 各末端関節の目標位置との差（１回に移動する距離は一定以下に制限し、重みをかける）
+		float  max_dist = 0.0f;
+		for ( int t = 0; t < num_targets; t++ )
+		{
+			ee_positions[ t ] = joint_positions[ targets[ t ].ee_joint_no ];
+			Vector3f  error;
+			error.sub( targets[ t ].position, ee_positions[ t ] );
+			float  dist = error.length();
+			if ( max_dist < dist )
+				max_dist = dist;
+			if ( dist > target_steps[ t ] )
+				error.scale( target_steps[ t ] / dist );
+			error.scale( target_weights[ t ] );
+			rhs[ t * 3 + 0 ] = error.x;
+			rhs[ t * 3 + 1 ] = error.y;
+			rhs[ t * 3 + 2 ] = error.z;
+		}
+		if ( max_dist < distance_threshold )
+			break;
+
+		// J J^T + λ^2 I を計算（各関節が動かす末端関節の組のブロックに加算）
+		fill( matrix.begin(), matrix.end(), 0.0f );
+		for ( int k = 0; k < num_joints; k++ )
+		{
+			const Point3f &  joint_pos = joint_positions[ joints[ k ] ];
+			for ( int s = 0; s < num_targets; s++ )
+			{
+				if ( !( joint_target_masks[ k ] & ( 1u << s ) ) )
+					continue;
+				Vector3f  rs;
+				rs.sub( ee_positions[ s ], joint_pos );
+				for ( int t = s; t < num_targets; t++ )
+				{
+					if ( !( joint_target_masks[ k ] & ( 1u << t ) ) )
+						continue;
+					Vector3f  rt;
+					rt.sub( ee_positions[ t ], joint_pos );
+					float  w = target_weights[ s ] * target_weights[ t ];
+					float  d = rs.dot( rt );
+					const float  r_s[ 3 ] = { rs.x, rs.y, rs.z };
+					const float  r_t[ 3 ] = { rt.x, rt.y, rt.z };
+					for ( int a = 0; a < 3; a++ )
+					{
+						for ( int b = 0; b < 3; b++ )
+						{
+							float  v = w * ( ( ( a == b ) ? d : 0.0f ) - r_t[ a ] * r_s[ b ] );
+							matrix[ ( s * 3 + a ) * n + t * 3 + b ] += v;
+							if ( s != t )
+								matrix[ ( t * 3 + b ) * n + s * 3 + a ] += v;
+						}
+					}
+				}
+			}
+		}
+		for ( int i = 0; i < n; i++ )
+			matrix[ i * n + i ] += lambda * lambda;
+
+		// y = (J J^T + λ^2 I)^-1 e を計算
+		if ( !SolveSymmetricPositiveDefinite( matrix.data(), n, rhs.data() ) )
+			break;
+
+		// 各関節に回転の変化量を適用（全関節の変化量を現在の姿勢から計算してから、順運動学計算をまとめて行う）
+		for ( int k = 0; k < num_joints; k++ )
+		{
+			const Point3f &  joint_pos = joint_positions[ joints[ k ] ];
+			Vector3f  omega( 0.0f, 0.0f, 0.0f );
+			for ( int t = 0; t < num_targets; t++ )
+			{
+				if ( !( joint_target_masks[ k ] & ( 1u << t ) ) )
+					continue;
+				Vector3f  r, y, v;
+				r.sub( ee_positions[ t ], joint_pos );
+				y.set( rhs[ t * 3 + 0 ], rhs[ t * 3 + 1 ], rhs[ t * 3 + 2 ] );
+				v.cross( r, y );
+				omega.scaleAdd( target_weights[ t ], v, omega );
+			}
+			float  angle = omega.length();
+			if ( angle < ik_epsilon )
+				continue;
+
+			omega.scale( 1.0f / angle );
+			Matrix3f  rot;
+			rot.set( AxisAngle4f( omega, angle ) );
+			RotateJointGlobal( posture, joints[ k ], segment_frames, rot );
+		}
+		for ( int i = 0; i < (int) fk_joints.size(); i++ )
+			ForwardKinematicsSubtree( posture, fk_joints[ i ], segment_frames, joint_positions );
+
+		// 全ての末端関節の移動距離が閾値以下になったら終了
+		float  max_move = 0.0f;
+		for ( int t = 0; t < num_targets; t++ )
+		{
+			float  move = joint_positions[ targets[ t ].ee_joint_no ].distance( ee_positions[ t ] );
+			if ( max_move < move )
+				max_move = move;
+		}
+		if ( max_move < min_change )
+		{
+			iteration ++;
+			break;
+		}
+	}
+
+	// 各末端関節と目標位置の距離の最大値を出力
+	residual_error = 0.0f;
+	for ( int t = 0; t < num_targets; t++ )
+	{
+		float  dist = joint_positions[ targets[ t ].ee_joint_no ].distance( targets[ t ].position );
+		if ( residual_error < dist )
+			residual_error = dist;
+	}
+	return  iteration;
+}
+
+
+
+//
+//  逆運動学計算の手法の選択
+//
+
+// 各手法のオブジェクト
+static CCDIKSolver  ccd_solver;
+static FABRIKSolver  fabrik_solver;
+static DLSIKSolver  dls_solver;
+
+// 動作変形などで使用する手法
+static IKSolverType  default_solver_type = IK_SOLVER_CCD;
+
+
+//
+//  指定の種類の逆運動学計算の手法を取得
+//
+IKSolver &  GetIKSolver( IKSolverType type )
+{
+	switch ( type )
+	{
+	  case IK_SOLVER_FABRIK:
+		return  fabrik_solver;
+	  case IK_SOLVER_DLS:
+		return  dls_solver;
+	  default:
+		return  ccd_solver;
+	}
+}
+
+
+//
+//  動作変形などで使用する逆運動学計算の手法の設定・取得
+//
+
+void  SetDefaultIKSolverType( IKSolverType type )
+{
+	if ( ( type >= 0 ) && ( type < NUM_IK_SOLVER_TYPES ) )
+		default_solver_type = type;
+}
+
+IKSolverType  GetDefaultIKSolverType()
+{
+	return  default_solver_type;
+}
+
+IKSolver &  GetDefaultIKSolver()
+{
+	return  GetIKSolver( default_solver_type );
+}
+
+
+//
+//  複数の末端関節の同時計算に使用する逆運動学計算の手法を取得
+//
+DLSIKSolver &  GetMultiTargetIKSolver()
+{
+	return  dls_solver;
+}
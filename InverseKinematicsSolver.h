@@ -0,0 +1,231 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  逆運動学計算の手法の切り替え（CCD法・FABRIK法・減衰最小二乗法）
+**/
+
+#ifndef  _INVERSE_KINEMATICS_SOLVER_H_
+#define  _INVERSE_KINEMATICS_SOLVER_H_
+
+
+#include <Quat4.h>
+
+#include "SimpleHuman.h"
+
+
+//
+//  逆運動学計算の結果（繰り返し数・末端関節の目標位置との誤差・計算時間）
+//
+struct  IKSolveResult
+{
+	// 繰り返し数
+	int  num_iterations;
+
+	// 計算後の末端関節の位置と目標位置の距離（m）
+	float  residual_error;
+
+	// 計算時間（ミリ秒）
+	float  solve_time;
+
+	// 誤差が閾値以下になったかどうか
+	bool  converged;
+};
+
+
+//
+//  複数の末端関節の逆運動学計算での、１つの末端関節の目標位置
+//
+struct  IKTarget
+{
+	// 末端関節番号
+	int  ee_joint_no;
+
+	// 目標位置
+	Point3f  position;
+
+	// 重み（他の末端関節の目標位置と両立しない場合に、重みの大きい末端関節ほど目標位置に近づける）
+	float  weight;
+};
+
+
+//
+//  前回の逆運動学計算の解を次の計算の初期値とするための情報（関節のつながりごとに保持）
+//  （前回の計算で各関節の回転に加えた変化量を保持しておき、次の計算では入力姿勢に変化量を加えた姿勢から開始する）
+//  （連続するフレームで同じ関節のつながりの計算を行う場合、入力姿勢も解も少しずつしか変化しないため、繰り返し数が少なくなる）
+//  （入力姿勢や目標位置が不連続に変化する時（接地の開始、動作の切り替えなど）には Reset() を呼び出す）
+//
+class  IKWarmStartState
+{
+  public:
+	// 対象の骨格モデルと回転を変更する関節（異なる関節のつながりの計算に使用された場合は、前回の解を破棄する）
+	const Skeleton *  body;
+	vector< int >  joints;
+
+	// 前回の解での各関節の回転の変化量（joints の順、解の回転＝変化量×入力姿勢の回転）
+	vector< Quat4f >  joint_deltas;
+
+	// 前回の解を保持しているかどうか
+	bool  is_valid;
+
+	// 繰り返し数ごとの計算回数（繰り返し数の分布の確認用）
+	vector< int >  iteration_histogram;
+
+  public:
+	// コンストラクタ
+	IKWarmStartState();
+
+	// 前回の解を破棄（繰り返し数の分布は保持する）
+	void  Reset();
+
+	// 繰り返し数の分布の記録・クリア
+	void  AddIterations( int num_iterations );
+	void  ClearHistogram();
+
+	// 記録した計算回数・平均繰り返し数を取得
+	int  GetNumSolves() const;
+	float  GetMeanIterations() const;
+};
+
+
+//
+//  逆運動学計算の手法の基底クラス
+//  （支点関節から末端関節までの関節の回転を変更して、末端関節を目標位置に移動する）
+//  （Solve() は const で、作業用の配列はスレッドごとに確保するため、複数のスレッドから同時に呼び出せる）
+//
+class  IKSolver
+{
+  protected:
+	// 最大繰り返し数
+	int  max_iteration;
+
+	// 位置が収束したと判断するための閾値（m）
+	float  distance_threshold;
+
+	// １回の繰り返しでの末端関節の移動距離がこれ以下になったら、目標位置に届かなくても終了する閾値（m、0 以下の場合は判定しない）
+	// （前回の解の情報を指定して計算する場合のみ使用する）
+	float  change_threshold;
+
+  public:
+	// コンストラクタ
+	IKSolver( int iteration = 10, float threshold = 0.01f );
+
+	// デストラクタ
+	virtual ~IKSolver() {}
+
+	// 手法の名前を取得
+	virtual const char *  GetName() const = 0;
+
+	// 最大繰り返し数・収束判定の閾値の設定・取得
+	void  SetMaxIteration( int n ) { max_iteration = n; }
+	int  GetMaxIteration() const { return  max_iteration; }
+	void  SetDistanceThreshold( float d ) { distance_threshold = d; }
+	float  GetDistanceThreshold() const { return  distance_threshold; }
+	void  SetChangeThreshold( float d ) { change_threshold = d; }
+	float  GetChangeThreshold() const { return  change_threshold; }
+
+	// 逆運動学計算（支点関節番号が -1 の場合はルートを支点とする）
+	// （state を指定すると、前回の解から計算を開始し、今回の解と繰り返し数を state に記録する）
+	// （state を指定しない場合は、移動距離による終了判定を行わず、従来の ApplyInverseKinematicsCCD() と同じ結果になる）
+	IKSolveResult  Solve( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, IKWarmStartState * state = NULL ) const;
+
+  protected:
+	// 各手法の繰り返し計算（繰り返し数を返し、計算後の末端関節と目標位置の距離を residual_error に出力）
+	// （min_change は移動距離による終了判定の閾値、0 の場合は判定しない）
+	virtual int  SolveIterations( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, float min_change, float & residual_error ) const = 0;
+
+  private:
+	// コピーは禁止
+	IKSolver( const IKSolver & );
+	IKSolver &  operator=( const IKSolver & );
+};
+
+
+//
+//  CCD法（末端側の関節から順に、末端関節が目標位置の方向を向くように回転する）
+//
+class  CCDIKSolver : public IKSolver
+{
+  public:
+	virtual const char *  GetName() const { return  "CCD"; }
+
+  protected:
+	virtual int  SolveIterations( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, float min_change, float & residual_error ) const;
+};
+
+
+//
+//  FABRIK法（関節の位置を末端側・支点側から交互に体節の長さを保って移動し、最後に関節の回転に変換する）
+//  （関節の位置のみで繰り返し計算を行うため、１回の繰り返しの計算量が少なく、長い関節のつながりでも収束が速い）
+//
+class  FABRIKSolver : public IKSolver
+{
+  public:
+	virtual const char *  GetName() const { return  "FABRIK"; }
+
+  protected:
+	virtual int  SolveIterations( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, float min_change, float & residual_error ) const;
+};
+
+
+//
+//  減衰最小二乗法（ヤコビ行列による方法、目標位置に届かない場合や特異姿勢の近くでも回転が発散しない）
+//
+class  DLSIKSolver : public IKSolver
+{
+  protected:
+	// 減衰係数（関節のつながりの長さに対する比率、大きいほど安定するが収束が遅くなる）
+	float  damping;
+
+	// １回の繰り返しで移動する末端関節の最大距離（関節のつながりの長さに対する比率）
+	float  max_step;
+
+  public:
+	// コンストラクタ
+	DLSIKSolver();
+
+	virtual const char *  GetName() const { return  "DLS"; }
+
+	// 減衰係数の設定・取得
+	void  SetDamping( float d ) { damping = d; }
+	float  GetDamping() const { return  damping; }
+
+	// 複数の末端関節の逆運動学計算（全ての末端関節の目標位置を共通の順運動学計算で同時に満たす、最大 32 個まで）
+	// （誤差は各末端関節と目標位置の距離の最大値、全ての末端関節が閾値以下になったら収束とする）
+	IKSolveResult  SolveMultiTarget( Posture & posture, int base_joint_no, const IKTarget * targets, int num_targets, IKWarmStartState * state = NULL ) const;
+
+  protected:
+	virtual int  SolveIterations( Posture & posture, int base_joint_no, int ee_joint_no, const Point3f & ee_joint_position, float min_change, float & residual_error ) const;
+
+	// 複数の末端関節の繰り返し計算（繰り返し数を返し、計算後の末端関節と目標位置の距離の最大値を residual_error に出力）
+	int  SolveTargets( Posture & posture, int base_joint_no, const IKTarget * targets, int num_targets, float min_change, float & residual_error ) const;
+};
+
+
+//
+//  逆運動学計算の手法の種類
+//
+enum  IKSolverType
+{
+	IK_SOLVER_CCD,
+	IK_SOLVER_FABRIK,
+	IK_SOLVER_DLS,
+	NUM_IK_SOLVER_TYPES
+};
+
+// 指定の種類の逆運動学計算の手法を取得（手法ごとに共通のオブジェクトを返す）
+IKSolver &  GetIKSolver( IKSolverType type );
+
+// 動作変形などで使用する逆運動学計算の手法の設定・取得（デフォルトは CCD法）
+void  SetDefaultIKSolverType( IKSolverType type );
+IKSolverType  GetDefaultIKSolverType();
+IKSolver &  GetDefaultIKSolver();
+
+// 複数の末端関節の同時計算に使用する逆運動学計算の手法を取得（減衰最小二乗法の共通のオブジェクトを返す）
+DLSIKSolver &  GetMultiTargetIKSolver();
+
+
+#endif // _INVERSE_KINEMATICS_SOLVER_H_
@@ -0,0 +1,193 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  逆運動学計算のための関節のパスの表（骨格モデルごとに支点関節・末端関節の組のパスを保持）
+**/
+
+
+#include "JointPathTable.h"
+
+
+
+//
+//  末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
+// （支点関節の番号が -1 の場合は、ルート体節を支点とする）
+// （joint_path_signs は、各関節の子側に末端関節がある場合は 1、親側に末端関節がある場合は -1 を出力）
+//
+static void  SearchJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no, vector< int > & joint_path, vector< int > & joint_path_signs )
+{
+	// 出力の配列をクリア
+	joint_path.clear();
+	joint_path_signs.clear();
+
+	// 探索時の現在の関節・体節
+	const Joint *  joint = NULL;
+	const Segment *  segment = NULL;
+
+	// 末端関節から探索を開始
+	joint = body->joints[ ee_joint_no ];
+
+	// 末端関節からルート体節に向かうパスを探索
+	while ( true )
+	{
+		// ルート側の隣の関節を辿り、ルートに到達したら終了
+		segment = joint->segments[ 0 ];
+		if ( segment->index == 0 )
+			break;
+		joint = segment->joints[ 0 ];
+
+		// 現在の関節をパスに追加
+		joint_path.push_back( joint->index );
+
+		// 途中で支点関節に到達したら終了
+		if ( joint->index == base_joint_no )
+			break;
+	}
+
+	// 各関節における末端関節の方向を表す符号の配列を生成（全て子側に末端関節がある）
+	joint_path_signs.resize( joint_path.size(), 1 );
+
+	// 支点がルート体節 or 支点関節がルート体節から末端関節のパス上にある場合は、終了
+	if ( ( base_joint_no == -1 ) || ( joint->index == base_joint_no ) )
+		return;
+
+	// 支点関節からルート体節へ向かうパス
+	vector< int >  joint_path2;
+
+	// 探索処理の終了判定用フラグ
+	bool  termination = false;
+
+	// 支点関節から探索を開始
+	joint = body->joints[ base_joint_no ];
+
+	// 支点関節からルート体節に向かうパスを探索
+	while ( true )
+	{
+		// 末端からルートまでのパスと合流したかどうかを判定し、合流したら終了
+		for ( int i=0; i<(int)joint_path.size(); i++ )
+		{
+			if ( joint_path[i] == joint->index )
+			{
+				// 末端からルートまでのパスを、合流した体節の前の関節まで縮小
+				joint_path.resize( i + 1 );
+				termination = true;
+				break;
+			}
+		}
+		if ( termination )
+			break;
+
+		// 現在の関節をパスに追加
+		joint_path2.push_back( joint->index );
+
+		// ルート側の隣の関節を辿り、ルートに到達したら終了
+		segment = joint->segments[ 0 ];
+		if ( segment->index == 0 )
+			break;
+		joint = segment->joints[ 0 ];
+
+		// 末端関節に到達した場合（ルートと支点関節の間に末端関節がある場合）は、
+		// 末端関節からルートまでのパスはクリアして、支点関節から末端関節までのパスを使用
+		if ( joint->index == ee_joint_no )
+		{
+			joint_path.clear();
+			joint_path_signs.clear();
+			break;
+		}
+	}
+
+	// 末端からルートに向かうパスと、支点からルートに向かうパスを結合（後者は逆の順番で結合）
+	// 各関節における末端関節の方向を表す符号の配列を生成
+	joint_path_signs.resize( joint_path.size(), 1 );
+	for ( int i = 0; i < (int) joint_path2.size(); i++ )
+	{
+		joint_path.push_back( joint_path2[joint_path2.size() - 1 - i] );
+		joint_path_signs.push_back( -1 );
+	}
+}
+
+
+
+//
+//  骨格モデルの関節のパスの表
+//
+
+// コンストラクタ
+JointPathTable::JointPathTable( const Skeleton * b )
+{
+	body = b;
+}
+
+
+//
+//  末端関節から支点関節へのパスを取得
+//
+JointPathRef  JointPathTable::GetPath( int base_joint_no, int ee_joint_no )
+{
+	JointPathRef  ref;
+	ref.joints = NULL;
+	ref.signs = NULL;
+	ref.num_joints = 0;
+	ref.chain = NULL;
+	ref.num_chain = 0;
+
+	// 引数チェック
+	if ( !body || ( ee_joint_no < 0 ) || ( ee_joint_no >= body->num_joints ) || 
+	     ( base_joint_no < -1 ) || ( base_joint_no >= body->num_joints ) || ( base_joint_no == ee_joint_no ) )
+		return  ref;
+
+	lock_guard< mutex >  lock( table_mutex );
+
+	// 探索済みでなければ、パスを探索して追加
+	int  key = ( base_joint_no + 1 ) * body->num_joints + ee_joint_no;
+	unordered_map< int, JointPath >::iterator  i = paths.find( key );
+	if ( i == paths.end() )
+	{
+		i = paths.emplace( key, JointPath() ).first;
+		JointPath &  path = i->second;
+		SearchJointPath( body, base_joint_no, ee_joint_no, path.joints, path.signs );
+
+		// 子側に末端関節がある関節を、支点側から順に並べる
+		for ( int j = (int) path.joints.size() - 1; j >= 0; j-- )
+		{
+			if ( path.signs[ j ] > 0 )
+				path.chain.push_back( path.joints[ j ] );
+		}
+	}
+
+	const JointPath &  path = i->second;
+	ref.joints = path.joints.data();
+	ref.signs = path.signs.data();
+	ref.num_joints = (int) path.joints.size();
+	ref.chain = path.chain.data();
+	ref.num_chain = (int) path.chain.size();
+	return  ref;
+}
+
+
+//
+//  探索済みのパスをクリア
+//
+void  JointPathTable::Clear()
+{
+	lock_guard< mutex >  lock( table_mutex );
+	paths.clear();
+}
+
+
+//
+//  骨格モデルの関節のパスの表から、末端関節から支点関節へのパスを取得
+//
+JointPathRef  GetJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no )
+{
+	if ( !body || !body->joint_path_table )
+	{
+		JointPathRef  ref = { NULL, NULL, 0, NULL, 0 };
+		return  ref;
+	}
+	return  body->joint_path_table->GetPath( base_joint_no, ee_joint_no );
+}
@@ -0,0 +1,84 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  逆運動学計算のための関節のパスの表（骨格モデルごとに支点関節・末端関節の組のパスを保持）
+**/
+
+#ifndef  _JOINT_PATH_TABLE_H_
+#define  _JOINT_PATH_TABLE_H_
+
+
+#include <mutex>
+#include <unordered_map>
+
+#include "SimpleHuman.h"
+
+
+//
+//  末端関節から支点関節へのパスの参照
+//  （配列の実体は骨格モデルの関節のパスの表が保持し、骨格モデルが削除されるまで有効）
+//
+struct  JointPathRef
+{
+	// 末端関節から支点関節へのパスの関節番号と、各関節における末端関節の方向（子側は 1、親側は -1）
+	const int *  joints;
+	const int *  signs;
+	int  num_joints;
+
+	// パスのうち子側に末端関節がある関節（支点側から順に並べたもの、ルートを移動せずに末端関節を動かせる関節）
+	const int *  chain;
+	int  num_chain;
+};
+
+
+//
+//  骨格モデルの関節のパスの表
+//  （支点関節・末端関節の組ごとに、最初に要求された時にパスを探索して保持し、以降は保持したパスを返す）
+//  （動作変形などで毎フレーム同じ組の逆運動学計算を行う時に、パスの探索や配列の確保を省略する）
+//
+class  JointPathTable
+{
+  protected:
+	// １つの組のパス
+	struct  JointPath
+	{
+		vector< int >  joints;
+		vector< int >  signs;
+		vector< int >  chain;
+	};
+
+	// 骨格モデル
+	const Skeleton *  body;
+
+	// 探索済みのパス（支点関節番号＋１と末端関節番号から計算したキーで管理）
+	// （要素を追加しても既存の要素の配列は移動しないため、返した参照は有効なまま）
+	mutex  table_mutex;
+	unordered_map< int, JointPath >  paths;
+
+  public:
+	// コンストラクタ
+	JointPathTable( const Skeleton * b );
+
+	// 末端関節から支点関節へのパスを取得（支点関節番号が -1 の場合はルート体節を支点とする）
+	// （関節番号が範囲外の場合は、空のパスを返す）
+	JointPathRef  GetPath( int base_joint_no, int ee_joint_no );
+
+	// 探索済みのパスをクリア（骨格モデルの接続情報を変更した時に呼び出す、それまでに返した参照は無効になる）
+	void  Clear();
+
+  private:
+	// コピーは禁止
+	JointPathTable( const JointPathTable & );
+	JointPathTable &  operator=( const JointPathTable & );
+};
+
+
+// 骨格モデルの関節のパスの表から、末端関節から支点関節へのパスを取得
+JointPathRef  GetJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no );
+
+
+#endif // _JOINT_PATH_TABLE_H_
@@ -0,0 +1,216 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  姿勢を必要に応じて生成する動作データ（遅延生成・姿勢のキャッシュ）
+**/
+
+
+#include "LazyMotion.h"
+#include "BVHStream.h"
+
+
+
+// 姿勢のキャッシュに保持するフレーム数のデフォルト値（約 4 秒分）
+const int  motion_frame_cache_size = 128;
+
+
+
+//
+//  BVH動作のチャンネルの値から姿勢を生成
+//
+
+// コンストラクタ
+BVHFrameDecoder::BVHFrameDecoder( const BVHChannelLayout & l, int num_frames )
+{
+	layout = l;
+	values.resize( (size_t) num_frames * layout.num_channels );
+}
+
+
+// 指定フレームの姿勢を生成
+void  BVHFrameDecoder::DecodeFrame( int no, Posture & p ) const
+{
+	// チャンネルの値を倍精度に戻してから姿勢に変換（変換用の配列はスレッドごとに再利用する）
+	static thread_local vector< double >  frame_values;
+	frame_values.resize( layout.num_channels );
+
+	const float *  src = &values[ (size_t) no * layout.num_channels ];
+	for ( int i = 0; i < layout.num_channels; i++ )
+		frame_values[ i ] = src[ i ];
+
+	DecodeBVHPosture( layout, frame_values.data(), p );
+}
+
+
+
+//
+//  生成済みの姿勢のキャッシュ
+//
+
+// コンストラクタ
+MotionFrameCache::MotionFrameCache( int c )
+{
+	capacity = ( c > 0 ) ? c : 1;
+	num_hits = 0;
+	num_misses = 0;
+	entries.reserve( capacity );
+}
+
+
+//
+//  指定フレームの姿勢を取得
+//
+Posture *  MotionFrameCache::GetFrame( const Motion * motion, int no )
+{
+	lock_guard< mutex >  lock( cache_mutex );
+	return  FindOrDecode( motion, no );
+}
+
+
+//
+//  指定フレームの姿勢をコピーして取得
+//
+void  MotionFrameCache::GetPosture( const Motion * motion, int no, Posture & p )
+{
+	lock_guard< mutex >  lock( cache_mutex );
+	Posture *  frame = FindOrDecode( motion, no );
+	if ( frame )
+		p = *frame;
+}
+
+
+//
+//  ２つのフレームの姿勢を補間して取得
+//  （先に１つ目の姿勢をコピーしておくため、２つ目の姿勢の生成で１つ目の姿勢が置き換えられても問題ない）
+//
+void  MotionFrameCache::GetInterpolatedPosture( const Motion * motion, int no0, int no1, float ratio, Posture & p )
+{
+	lock_guard< mutex >  lock( cache_mutex );
+	Posture *  frame0 = FindOrDecode( motion, no0 );
+	if ( !frame0 )
+		return;
+	p = *frame0;
+
+	if ( ratio <= 0.0f )
+		return;
+	Posture *  frame1 = FindOrDecode( motion, no1 );
+	if ( frame1 )
+		PostureInterpolation( p, *frame1, ratio, p );
+}
+
+
+//
+//  キャッシュをクリア
+//
+void  MotionFrameCache::Clear()
+{
+	lock_guard< mutex >  lock( cache_mutex );
+	entries.clear();
+	recent_frames.clear();
+}
+
+
+//
+//  指定フレームの姿勢を探索・生成
+//
+Posture *  MotionFrameCache::FindOrDecode( const Motion * motion, int no )
+{
+	if ( !motion->frame_decoder || !motion->body )
+		return  NULL;
+
+	// キャッシュにあれば、最近使用したフレームとして先頭に移動して返す
+	unordered_map< int, CacheEntry >::iterator  i = entries.find( no );
+	if ( i != entries.end() )
+	{
+		num_hits ++;
+		recent_frames.splice( recent_frames.begin(), recent_frames, i->second.recent );
+		return  &i->second.posture;
+	}
+	num_misses ++;
+
+	// キャッシュが一杯であれば、最も長く使用されていないフレームの姿勢を再利用
+	// （姿勢の配列を確保し直さないように、要素を取り出してフレーム番号を付け替える）
+	CacheEntry *  entry;
+	if ( (int) entries.size() >= capacity )
+	{
+		int  oldest = recent_frames.back();
+		recent_frames.pop_back();
+
+		unordered_map< int, CacheEntry >::node_type  node = entries.extract( oldest );
+		node.key() = no;
+		entry = &entries.insert( std::move( node ) ).position->second;
+	}
+	else
+	{
+		entry = &entries[ no ];
+	}
+
+	// 姿勢を生成
+	if ( entry->posture.body != motion->body )
+		entry->posture.Init( motion->body );
+	motion->frame_decoder->DecodeFrame( no, entry->posture );
+
+	// 最近使用したフレームとして登録
+	recent_frames.push_front( no );
+	entry->recent = recent_frames.begin();
+
+	return  &entry->posture;
+}
+
+
+
+//
+//  BVHファイルを読み込んで、姿勢を必要に応じて生成する動作データ（＋骨格モデル）を生成
+//  （読み込み時にはチャンネルの値のみを単精度で保持し、姿勢は取得時に生成する）
+//  （姿勢に変換して保持する場合と比べて、使用メモリ量は数分の１となる）
+//
+Motion *  LoadAndCoustructLazyBVHMotion( const char * bvh_file_name, const Skeleton * bvh_body, int cache_size )
+{
+	// BVHファイルを一定フレーム数ずつ読み込み
+	BVHStream  stream;
+	if ( !stream.Open( bvh_file_name, bvh_decode_chunk_size * 64 ) || ( stream.GetNumFrames() == 0 ) )
+		return  NULL;
+
+	// 骨格モデルを生成（生成済みの骨格モデルが入力された場合は省略）
+	const Skeleton *  body = bvh_body;
+	if ( !body )
+	{
+		body = CoustructBVHSkeleton( stream.GetBVH() );
+		if ( !body )
+			return  NULL;
+	}
+
+	// 全フレームのチャンネルの値を読み込み
+	const BVHChannelLayout &  layout = stream.GetChannelLayout();
+	BVHFrameDecoder *  decoder = new BVHFrameDecoder( layout, stream.GetNumFrames() );
+	while ( stream.ReadWindow() > 0 )
+	{
+		float *  dest = decoder->GetFrameValues( stream.GetWindowBegin() );
+		const double *  src = stream.GetFrameData( 0 );
+		int  num_values = stream.GetWindowNumFrames() * layout.num_channels;
+		for ( int i = 0; i < num_values; i++ )
+			dest[ i ] = (float) src[ i ];
+	}
+
+	// 読み込みに失敗したら終了
+	if ( stream.IsError() )
+	{
+		delete  decoder;
+		if ( body != bvh_body )
+			delete  body;
+		return  NULL;
+	}
+
+	// 動作データの初期化
+	Motion *  motion = new Motion();
+	motion->InitLazy( body, stream.GetNumFrames(), decoder, cache_size );
+	motion->interval = stream.GetInterval();
+	motion->name = stream.GetBVH()->GetMotionName();
+
+	// 生成した動作データを返す
+	return  motion;
+}
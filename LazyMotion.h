@@ -0,0 +1,130 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  姿勢を必要に応じて生成する動作データ（遅延生成・姿勢のキャッシュ）
+**/
+
+#ifndef  _LAZY_MOTION_H_
+#define  _LAZY_MOTION_H_
+
+
+#include <mutex>
+#include <list>
+#include <unordered_map>
+
+#include "SimpleHuman.h"
+
+
+// 姿勢のキャッシュに保持するフレーム数のデフォルト値
+extern const int  motion_frame_cache_size;
+
+
+//
+//  動作の各フレームの姿勢を生成するためのインターフェース
+//  （Motion::InitLazy() で動作データに設定すると、動作データが削除される時に一緒に削除される）
+//
+class  MotionFrameDecoder
+{
+  public:
+	// デストラクタ
+	virtual ~MotionFrameDecoder() {}
+
+	// 指定フレームの姿勢を生成（姿勢は動作データの骨格モデルで初期化済み）
+	virtual void  DecodeFrame( int no, Posture & p ) const = 0;
+
+	// 保持しているデータのサイズ（バイト数）を取得
+	virtual size_t  GetDataSize() const = 0;
+};
+
+
+//
+//  BVH動作のチャンネルの値（単精度で保持）から姿勢を生成
+//
+class  BVHFrameDecoder : public MotionFrameDecoder
+{
+  protected:
+	// チャンネルと姿勢の対応情報
+	BVHChannelLayout  layout;
+
+	// 全フレームのチャンネルの値 [フレーム番号][チャンネル番号]
+	vector< float >  values;
+
+  public:
+	// コンストラクタ
+	BVHFrameDecoder( const BVHChannelLayout & l, int num_frames );
+
+	// 指定フレームのチャンネルの値を取得
+	float *  GetFrameValues( int no ) { return  &values[ no * layout.num_channels ]; }
+
+	// 指定フレームの姿勢を生成
+	virtual void  DecodeFrame( int no, Posture & p ) const;
+
+	// 保持しているデータのサイズを取得
+	virtual size_t  GetDataSize() const { return  values.size() * sizeof( float ); }
+};
+
+
+//
+//  生成済みの姿勢のキャッシュ（最近使用したフレームの姿勢を一定数まで保持する）
+//
+class  MotionFrameCache
+{
+  protected:
+	// 排他制御（複数のスレッドからの姿勢の取得に対応）
+	mutex  cache_mutex;
+
+	// 保持する最大フレーム数
+	int  capacity;
+
+	// 保持しているフレーム番号（最近使用した順）
+	list< int >  recent_frames;
+
+	// 保持している姿勢
+	struct  CacheEntry
+	{
+		Posture  posture;
+		list< int >::iterator  recent;
+	};
+	unordered_map< int, CacheEntry >  entries;
+
+	// キャッシュのヒット・ミスの回数
+	int  num_hits;
+	int  num_misses;
+
+  public:
+	// コンストラクタ
+	MotionFrameCache( int capacity );
+
+	// 指定フレームの姿勢を取得（キャッシュになければ生成）
+	// （返される姿勢はキャッシュ内の姿勢のため、他のフレームを capacity 回以上取得すると内容が置き換わる）
+	Posture *  GetFrame( const Motion * motion, int no );
+
+	// 指定フレームの姿勢をコピーして取得（キャッシュになければ生成）
+	void  GetPosture( const Motion * motion, int no, Posture & p );
+
+	// ２つのフレームの姿勢を補間して取得（キャッシュになければ生成）
+	void  GetInterpolatedPosture( const Motion * motion, int no0, int no1, float ratio, Posture & p );
+
+	// キャッシュをクリア
+	void  Clear();
+
+	// キャッシュの情報の取得
+	int  GetCapacity() const { return  capacity; }
+	int  GetNumHits() const { return  num_hits; }
+	int  GetNumMisses() const { return  num_misses; }
+
+  protected:
+	// 指定フレームの姿勢を探索・生成（排他制御は呼び出し側で行う）
+	Posture *  FindOrDecode( const Motion * motion, int no );
+};
+
+
+// BVHファイルを読み込んで、姿勢を必要に応じて生成する動作データ（＋骨格モデル）を生成
+Motion *  LoadAndCoustructLazyBVHMotion( const char * bvh_file_name, const Skeleton * bvh_body = NULL, int cache_size = motion_frame_cache_size );
+
+
+#endif // _LAZY_MOTION_H_
@@ -0,0 +1,200 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  メモリマップトファイル（読み込み専用）
+**/
+
+
+#ifdef  _WIN32
+	#define  WIN32_LEAN_AND_MEAN
+	#define  NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include <stdio.h>
+
+#include "MappedFile.h"
+
+
+// 空のファイルの内容として返す文字列
+static const char  empty_data[] = "";
+
+
+// コンストラクタ
+MappedFile::MappedFile()
+{
+	data = NULL;
+	size = 0;
+	is_open = false;
+#ifdef  _WIN32
+	file_handle = NULL;
+	mapping_handle = NULL;
+#else
+	file_descriptor = -1;
+#endif
+	buffer = NULL;
+}
+
+// コンストラクタ
+MappedFile::MappedFile( const char * file_name )
+{
+	data = NULL;
+	size = 0;
+	is_open = false;
+#ifdef  _WIN32
+	file_handle = NULL;
+	mapping_handle = NULL;
+#else
+	file_descriptor = -1;
+#endif
+	buffer = NULL;
+
+	Open( file_name );
+}
+
+// デストラクタ
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+
+//
+//  ファイルを開く
+//
+bool  MappedFile::Open( const char * file_name )
+{
+	Close();
+
+#ifdef  _WIN32
+	// ファイルを開いてサイズを取得
+	HANDLE  file = CreateFileA( file_name, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( file == INVALID_HANDLE_VALUE )
+		return  false;
+	LARGE_INTEGER  file_size;
+	if ( !GetFileSizeEx( file, &file_size ) )
+	{
+		CloseHandle( file );
+		return  false;
+	}
+	file_handle = file;
+	size = (size_t) file_size.QuadPart;
+
+	// 空のファイルはマップできないので、空の内容を設定
+	if ( size == 0 )
+	{
+		data = empty_data;
+		is_open = true;
+		return  true;
+	}
+
+	// ファイルをメモリ空間に割り当て
+	HANDLE  mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( mapping != NULL )
+	{
+		const void *  view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+		if ( view != NULL )
+		{
+			mapping_handle = mapping;
+			data = (const char *) view;
+			is_open = true;
+			return  true;
+		}
+		CloseHandle( mapping );
+	}
+#else
+	// ファイルを開いてサイズを取得
+	int  fd = open( file_name, O_RDONLY );
+	if ( fd < 0 )
+		return  false;
+	struct stat  st;
+	if ( fstat( fd, &st ) != 0 )
+	{
+		close( fd );
+		return  false;
+	}
+	file_descriptor = fd;
+	size = (size_t) st.st_size;
+
+	// 空のファイルはマップできないので、空の内容を設定
+	if ( size == 0 )
+	{
+		data = empty_data;
+		is_open = true;
+		return  true;
+	}
+
+	// ファイルをメモリ空間に割り当て
+	void *  view = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( view != MAP_FAILED )
+	{
+		madvise( view, size, MADV_SEQUENTIAL );
+		data = (const char *) view;
+		is_open = true;
+		return  true;
+	}
+#endif
+
+	// メモリマップが利用できない場合は、ファイル全体をバッファに読み込む
+	FILE *  fp = fopen( file_name, "rb" );
+	if ( fp == NULL )
+	{
+		Close();
+		return  false;
+	}
+	buffer = new char[ size ];
+	size_t  read_size = fread( buffer, 1, size, fp );
+	fclose( fp );
+	if ( read_size != size )
+	{
+		Close();
+		return  false;
+	}
+	data = buffer;
+	is_open = true;
+
+	return  true;
+}
+
+
+//
+//  ファイルを閉じる
+//
+void  MappedFile::Close()
+{
+#ifdef  _WIN32
+	if ( mapping_handle != NULL )
+	{
+		UnmapViewOfFile( data );
+		CloseHandle( (HANDLE) mapping_handle );
+	}
+	if ( file_handle != NULL )
+		CloseHandle( (HANDLE) file_handle );
+	file_handle = NULL;
+	mapping_handle = NULL;
+#else
+	if ( ( file_descriptor >= 0 ) && ( buffer == NULL ) && ( data != NULL ) && ( data != empty_data ) )
+		munmap( (void *) data, size );
+	if ( file_descriptor >= 0 )
+		close( file_descriptor );
+	file_descriptor = -1;
+#endif
+
+	if ( buffer != NULL )
+		delete[]  buffer;
+	buffer = NULL;
+
+	data = NULL;
+	size = 0;
+	is_open = false;
+}
@@ -0,0 +1,65 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  メモリマップトファイル（読み込み専用）
+**/
+
+#ifndef  _MAPPED_FILE_H_
+#define  _MAPPED_FILE_H_
+
+
+#include <stddef.h>
+
+
+//
+//  ファイルの内容をメモリ空間に割り当てて、読み込み専用でアクセスするためのクラス
+//  （メモリマップが利用できない場合は、ファイル全体をバッファに読み込む）
+//
+class  MappedFile
+{
+  protected:
+	// ファイルの内容の先頭アドレス・サイズ
+	const char *  data;
+	size_t  size;
+
+	// ファイルが開かれているかどうかのフラグ
+	bool  is_open;
+
+	// メモリマップのハンドル（環境依存）
+#ifdef  _WIN32
+	void *  file_handle;
+	void *  mapping_handle;
+#else
+	int  file_descriptor;
+#endif
+
+	// メモリマップが利用できなかった場合の読み込みバッファ
+	char *  buffer;
+
+  public:
+	// コンストラクタ・デストラクタ
+	MappedFile();
+	MappedFile( const char * file_name );
+	~MappedFile();
+
+	// ファイルを開く・閉じる
+	bool  Open( const char * file_name );
+	void  Close();
+
+	// ファイルの内容を取得
+	bool  IsOpen() const { return  is_open; }
+	const char *  GetData() const { return  data; }
+	size_t  GetSize() const { return  size; }
+
+  private:
+	// コピーは禁止
+	MappedFile( const MappedFile & );
+	MappedFile &  operator=( const MappedFile & );
+};
+
+
+#endif // _MAPPED_FILE_H_
@@ -0,0 +1,454 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データのバイナリキャッシュ（.motc）
+**/
+
+
+// ヘッダファイルのインクルード
+#include "MotionCache.h"
+#include "MappedFile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+// グローバル変数の定義
+
+// キャッシュを使用するかどうかの設定
+bool  use_motion_cache = true;
+
+
+//
+//  キャッシュファイルの形式
+//
+//  ヘッダ（識別子・バージョン・元のBVHファイルの情報）
+//  骨格モデル（体節の名前・接続関節・接続位置・末端位置、関節の名前・接続体節）
+//  全フレームの姿勢（ルートの位置 3、ルートの向き 9、各関節の回転行列 9×関節数 の float 値を詰めて格納）
+//
+
+// キャッシュファイルの識別子・バージョン（形式を変更したらバージョンを変更する）
+static const char      motion_cache_magic[ 4 ] = { 'M', 'O', 'T', 'C' };
+static const uint32_t  motion_cache_version = 2;
+
+// キャッシュファイルのヘッダ
+struct  MotionCacheHeader
+{
+	// 識別子・バージョン
+	char      magic[ 4 ];
+	uint32_t  version;
+
+	// 元のBVHファイルのサイズ・更新時刻・内容のハッシュ値
+	uint64_t  bvh_size;
+	int64_t   bvh_mtime;
+	uint64_t  bvh_hash;
+
+	// 位置情報に適用したスケーリング比率
+	float     scale;
+
+	// 体節数・関節数・フレーム数・フレーム間隔
+	int32_t   num_segments;
+	int32_t   num_joints;
+	int32_t   num_frames;
+	float     interval;
+};
+
+
+
+//
+//  キャッシュの補助関数
+//
+
+// ファイルのサイズ・更新時刻を取得
+static bool  GetFileStatus( const char * file_name, uint64_t & size, int64_t & mtime )
+{
+#ifdef  _WIN32
+	struct __stat64  st;
+	if ( _stat64( file_name, &st ) != 0 )
+		return  false;
+#else
+	struct stat  st;
+	if ( stat( file_name, &st ) != 0 )
+		return  false;
+#endif
+	size = (uint64_t) st.st_size;
+	mtime = (int64_t) st.st_mtime;
+	return  true;
+}
+
+
+// ファイルの内容のハッシュ値を計算（8バイト単位の FNV-1a）
+static uint64_t  ComputeContentHash( const char * data, size_t size )
+{
+	const uint64_t  prime = 1099511628211ULL;
+	uint64_t  hash = 14695981039346656037ULL;
+	size_t  i = 0;
+	for ( ; i + 8 <= size; i += 8 )
+	{
+		uint64_t  word;
+		memcpy( &word, data + i, 8 );
+		hash = ( hash ^ word ) * prime;
+	}
+	for ( ; i < size; i++ )
+		hash = ( hash ^ (unsigned char) data[ i ] ) * prime;
+	hash = ( hash ^ size ) * prime;
+	return  hash;
+}
+
+
+// ファイルの内容のハッシュ値を計算
+static bool  ComputeFileHash( const char * file_name, uint64_t & hash )
+{
+	MappedFile  file;
+	if ( !file.Open( file_name ) )
+		return  false;
+	hash = ComputeContentHash( file.GetData(), file.GetSize() );
+	return  true;
+}
+
+
+// バッファへの書き込み
+template< class T >
+static void  WriteCacheValue( vector< char > & buffer, const T & value )
+{
+	const char *  p = (const char *) &value;
+	buffer.insert( buffer.end(), p, p + sizeof( T ) );
+}
+
+static void  WriteCacheString( vector< char > & buffer, const string & str )
+{
+	WriteCacheValue( buffer, (uint32_t) str.size() );
+	buffer.insert( buffer.end(), str.begin(), str.end() );
+}
+
+static void  WriteCacheTuple( vector< char > & buffer, const Tuple3f & t )
+{
+	WriteCacheValue( buffer, t.x );
+	WriteCacheValue( buffer, t.y );
+	WriteCacheValue( buffer, t.z );
+}
+
+static void  WriteCacheMatrix( vector< char > & buffer, const Matrix3f & m )
+{
+	float  v[ 9 ] = { m.m00, m.m01, m.m02, m.m10, m.m11, m.m12, m.m20, m.m21, m.m22 };
+	WriteCacheValue( buffer, v );
+}
+
+
+// バッファからの読み込み（範囲外の読み込みは失敗）
+struct  MotionCacheReader
+{
+	const char *  cur;
+	const char *  end;
+
+	template< class T >
+	bool  Read( T & value )
+	{
+		if ( cur + sizeof( T ) > end )
+			return  false;
+		memcpy( &value, cur, sizeof( T ) );
+		cur += sizeof( T );
+		return  true;
+	}
+
+	bool  ReadString( string & str )
+	{
+		uint32_t  length;
+		if ( !Read( length ) || ( cur + length > end ) )
+			return  false;
+		str.assign( cur, cur + length );
+		cur += length;
+		return  true;
+	}
+
+	bool  ReadTuple( Tuple3f & t )
+	{
+		return  Read( t.x ) && Read( t.y ) && Read( t.z );
+	}
+
+	bool  ReadMatrix( Matrix3f & m )
+	{
+		float  v[ 9 ];
+		if ( !Read( v ) )
+			return  false;
+		m.m00 = v[ 0 ];  m.m01 = v[ 1 ];  m.m02 = v[ 2 ];
+		m.m10 = v[ 3 ];  m.m11 = v[ 4 ];  m.m12 = v[ 5 ];
+		m.m20 = v[ 6 ];  m.m21 = v[ 7 ];  m.m22 = v[ 8 ];
+		return  true;
+	}
+};
+
+
+// 骨格モデルの読み込み
+static Skeleton *  ReadCacheSkeleton( MotionCacheReader & reader, int num_segments, int num_joints )
+{
+	Skeleton *  body = new Skeleton( num_segments, num_joints );
+	for ( int i = 0; i < num_segments; i++ )
+		body->segments[ i ] = new Segment();
+	for ( int i = 0; i < num_joints; i++ )
+		body->joints[ i ] = new Joint();
+
+	// 体節の情報を読み込み
+	for ( int i = 0; i < num_segments; i++ )
+	{
+		Segment *  segment = body->segments[ i ];
+		int32_t  n;
+		uint8_t  has_site;
+
+		segment->index = i;
+		segment->num_joints = 0;
+		segment->joints = NULL;
+		segment->joint_positions = NULL;
+		segment->has_site = false;
+
+		if ( !reader.ReadString( segment->name ) || !reader.Read( n ) || ( n < 0 ) || ( n > num_joints + 1 ) )
+			goto cache_error;
+
+		segment->num_joints = n;
+		segment->joints = new Joint*[ n ];
+		segment->joint_positions = new Point3f[ n ];
+		for ( int j = 0; j < n; j++ )
+		{
+			int32_t  joint_no;
+			if ( !reader.Read( joint_no ) || ( joint_no < 0 ) || ( joint_no >= num_joints ) )
+				goto cache_error;
+			segment->joints[ j ] = body->joints[ joint_no ];
+			if ( !reader.ReadTuple( segment->joint_positions[ j ] ) )
+				goto cache_error;
+		}
+
+		if ( !reader.Read( has_site ) || !reader.ReadTuple( segment->site_position ) )
+			goto cache_error;
+		segment->has_site = ( has_site != 0 );
+	}
+
+	// 関節の情報を読み込み
+	for ( int i = 0; i < num_joints; i++ )
+	{
+		Joint *  joint = body->joints[ i ];
+		int32_t  seg_no[ 2 ];
+
+		joint->index = i;
+		if ( !reader.ReadString( joint->name ) || !reader.Read( seg_no ) )
+			goto cache_error;
+		for ( int j = 0; j < 2; j++ )
+		{
+			if ( ( seg_no[ j ] < 0 ) || ( seg_no[ j ] >= num_segments ) )
+				goto cache_error;
+			joint->segments[ j ] = body->segments[ seg_no[ j ] ];
+		}
+	}
+
+	// 順運動学計算のための体節の接続情報を初期化
+	body->InitTopology();
+
+	return  body;
+
+cache_error:
+	delete  body;
+	return  NULL;
+}
+
+
+// 骨格モデルの書き込み
+static void  WriteCacheSkeleton( vector< char > & buffer, const Skeleton * body )
+{
+	// 体節の情報を書き込み
+	for ( int i = 0; i < body->num_segments; i++ )
+	{
+		const Segment *  segment = body->segments[ i ];
+		WriteCacheString( buffer, segment->name );
+		WriteCacheValue( buffer, (int32_t) segment->num_joints );
+		for ( int j = 0; j < segment->num_joints; j++ )
+		{
+			WriteCacheValue( buffer, (int32_t) segment->joints[ j ]->index );
+			WriteCacheTuple( buffer, segment->joint_positions[ j ] );
+		}
+		WriteCacheValue( buffer, (uint8_t) ( segment->has_site ? 1 : 0 ) );
+		WriteCacheTuple( buffer, segment->site_position );
+	}
+
+	// 関節の情報を書き込み
+	for ( int i = 0; i < body->num_joints; i++ )
+	{
+		const Joint *  joint = body->joints[ i ];
+		int32_t  seg_no[ 2 ] = { joint->segments[ 0 ]->index, joint->segments[ 1 ]->index };
+		WriteCacheString( buffer, joint->name );
+		WriteCacheValue( buffer, seg_no );
+	}
+}
+
+
+
+//
+//  BVHファイルに対応するキャッシュファイル名を取得
+//
+string  GetMotionCacheFileName( const char * bvh_file_name )
+{
+	string  name = bvh_file_name;
+	size_t  ext = name.find_last_of( '.' );
+	size_t  dir = name.find_last_of( "/\\" );
+	if ( ( ext != string::npos ) && ( ( dir == string::npos ) || ( ext > dir ) ) )
+		name.erase( ext );
+	name += ".motc";
+	return  name;
+}
+
+
+//
+//  キャッシュファイルから動作データ（＋骨格モデル）を読み込み
+//
+Motion *  LoadMotionCache( const char * bvh_file_name, const Skeleton * bvh_body )
+{
+	// 元のBVHファイルの情報を取得
+	uint64_t  bvh_size;
+	int64_t  bvh_mtime;
+	if ( !GetFileStatus( bvh_file_name, bvh_size, bvh_mtime ) )
+		return  NULL;
+
+	// キャッシュファイルを開く
+	string  cache_file_name = GetMotionCacheFileName( bvh_file_name );
+	MappedFile  file;
+	if ( !file.Open( cache_file_name.c_str() ) )
+		return  NULL;
+
+	MotionCacheReader  reader;
+	reader.cur = file.GetData();
+	reader.end = file.GetData() + file.GetSize();
+
+	// ヘッダの確認
+	MotionCacheHeader  header;
+	if ( !reader.Read( header ) )
+		return  NULL;
+	if ( ( memcmp( header.magic, motion_cache_magic, 4 ) != 0 ) || ( header.version != motion_cache_version ) )
+		return  NULL;
+	if ( ( header.scale != bvh_scale ) || ( header.num_segments <= 0 ) || ( header.num_joints != header.num_segments - 1 ) || ( header.num_frames <= 0 ) )
+		return  NULL;
+
+	// 元のBVHファイルとの対応の確認（サイズが異なれば無効、更新時刻が異なる場合は内容のハッシュ値で判定）
+	if ( header.bvh_size != bvh_size )
+		return  NULL;
+	if ( header.bvh_mtime != bvh_mtime )
+	{
+		uint64_t  bvh_hash;
+		if ( !ComputeFileHash( bvh_file_name, bvh_hash ) || ( bvh_hash != header.bvh_hash ) )
+			return  NULL;
+	}
+
+	// 動作名を読み込み
+	string  name;
+	if ( !reader.ReadString( name ) )
+		return  NULL;
+
+	// 骨格モデルを読み込み
+	Skeleton *  new_body = ReadCacheSkeleton( reader, header.num_segments, header.num_joints );
+	if ( !new_body )
+		return  NULL;
+
+	// 生成済みの骨格モデルが入力された場合は、関節数が一致すればそちらを使用
+	const Skeleton *  body = new_body;
+	if ( bvh_body )
+	{
+		delete  new_body;
+		new_body = NULL;
+		if ( bvh_body->num_joints != header.num_joints )
+			return  NULL;
+		body = bvh_body;
+	}
+
+	// 姿勢データのサイズを確認
+	size_t  frame_size = sizeof( float ) * ( 3 + 9 + 9 * header.num_joints );
+	if ( (size_t)( reader.end - reader.cur ) != frame_size * header.num_frames )
+	{
+		if ( new_body )
+			delete  new_body;
+		return  NULL;
+	}
+
+	// 動作データの初期化
+	Motion *  motion = new Motion( body, header.num_frames );
+	motion->interval = header.interval;
+	motion->name = name;
+
+	// 各フレームの姿勢を読み込み
+	for ( int i = 0; i < header.num_frames; i++ )
+	{
+		Posture &  posture = motion->frames[ i ];
+		reader.ReadTuple( posture.root_pos );
+		reader.ReadMatrix( posture.root_ori );
+		for ( int j = 0; j < header.num_joints; j++ )
+			reader.ReadMatrix( posture.joint_rotations[ j ] );
+	}
+
+	// 読み込んだ動作データを返す
+	return  motion;
+}
+
+
+//
+//  動作データ（＋骨格モデル）をキャッシュファイルに保存
+//
+bool  SaveMotionCache( const char * bvh_file_name, const Motion * motion )
+{
+	if ( !motion || !motion->body || !motion->frames || ( motion->num_frames <= 0 ) )
+		return  false;
+	const Skeleton *  body = motion->body;
+
+	// ヘッダの設定
+	MotionCacheHeader  header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, motion_cache_magic, 4 );
+	header.version = motion_cache_version;
+	if ( !GetFileStatus( bvh_file_name, header.bvh_size, header.bvh_mtime ) )
+		return  false;
+	if ( !ComputeFileHash( bvh_file_name, header.bvh_hash ) )
+		return  false;
+	header.scale = bvh_scale;
+	header.num_segments = body->num_segments;
+	header.num_joints = body->num_joints;
+	header.num_frames = motion->num_frames;
+	header.interval = motion->interval;
+
+	// キャッシュの内容をバッファに書き込み
+	vector< char >  buffer;
+	buffer.reserve( sizeof( header ) + 4096 + sizeof( float ) * ( 3 + 9 + 9 * body->num_joints ) * motion->num_frames );
+	WriteCacheValue( buffer, header );
+	WriteCacheString( buffer, motion->name );
+	WriteCacheSkeleton( buffer, body );
+	for ( int i = 0; i < motion->num_frames; i++ )
+	{
+		const Posture &  posture = motion->frames[ i ];
+		WriteCacheTuple( buffer, posture.root_pos );
+		WriteCacheMatrix( buffer, posture.root_ori );
+		for ( int j = 0; j < body->num_joints; j++ )
+			WriteCacheMatrix( buffer, posture.joint_rotations[ j ] );
+	}
+
+	// 一時ファイルに出力してから置き換える（書き込み途中のキャッシュが読み込まれないようにする）
+	string  cache_file_name = GetMotionCacheFileName( bvh_file_name );
+	string  temp_file_name = cache_file_name + ".tmp";
+	FILE *  fp = fopen( temp_file_name.c_str(), "wb" );
+	if ( !fp )
+		return  false;
+	size_t  written = fwrite( &buffer.front(), 1, buffer.size(), fp );
+	if ( ( fclose( fp ) != 0 ) || ( written != buffer.size() ) )
+	{
+		remove( temp_file_name.c_str() );
+		return  false;
+	}
+	remove( cache_file_name.c_str() );
+	if ( rename( temp_file_name.c_str(), cache_file_name.c_str() ) != 0 )
+	{
+		remove( temp_file_name.c_str() );
+		return  false;
+	}
+
+	return  true;
+}
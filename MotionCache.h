@@ -0,0 +1,37 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データのバイナリキャッシュ（.motc）
+**/
+
+#ifndef  _MOTION_CACHE_H_
+#define  _MOTION_CACHE_H_
+
+
+#include "SimpleHuman.h"
+
+
+//
+//  BVHファイルから生成した骨格モデル・動作データを、BVHファイルと同じ場所にバイナリ形式で保存しておき、
+//  次回以降の読み込みではテキストの解析・回転行列の計算を省略する
+//  （キャッシュは元のBVHファイルのサイズ・更新時刻・内容のハッシュ値により有効性を判定する）
+//
+
+// キャッシュを使用するかどうかの設定（デフォルトでは使用する）
+extern bool  use_motion_cache;
+
+// BVHファイルに対応するキャッシュファイル名を取得
+string  GetMotionCacheFileName( const char * bvh_file_name );
+
+// キャッシュファイルから動作データ（＋骨格モデル）を読み込み（キャッシュが無効な場合は NULL を返す）
+Motion *  LoadMotionCache( const char * bvh_file_name, const Skeleton * bvh_body = NULL );
+
+// 動作データ（＋骨格モデル）をキャッシュファイルに保存
+bool  SaveMotionCache( const char * bvh_file_name, const Motion * motion );
+
+
+#endif // _MOTION_CACHE_H_
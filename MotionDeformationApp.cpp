@@ -15,6 +15,14 @@
 #include "Timeline.h"
 #include "MotionDeformationApp.h"
 #include "HumanBody.h"
+#include "EulerRotation.h"
+#include "BVHStream.h"
+#include "PosturePool.h"
+#include "MotionTransformTable.h"
+#include "QuaternionPosture.h"
+#include "QuaternionInterpolationSIMD.h"
+#include "InverseKinematicsLimb.h"
+#include "InverseKinematicsSolver.h"
 #include <vector>
 #include <algorithm>
 
@@ -45,6 +53,7 @@ MotionDeformationApp::MotionDeformationApp() : InverseKinematicsCCDApp()
 	motion = NULL;
 
 	org_posture = NULL;
+	org_frame_no = -1;
 	deformed_posture = NULL;
 	on_animation = true;
 	animation_time = 0.0f;
@@ -68,6 +77,11 @@ MotionDeformationApp::MotionDeformationApp() : InverseKinematicsCCDApp()
 	r_foot_lock = false;
 	l_foot_lock = false;
 
+	is_loading = false;
+	num_frame_posture_allocations = 0;
+	draw_debug_info = false;
+	use_limb_ik = true;
+
 	prev_motion_end_pose = new Posture();
 	if (motion && motion->body) {
 		InitPosture(*prev_motion_end_pose, motion->body);
@@ -81,12 +95,11 @@ MotionDeformationApp::MotionDeformationApp() : InverseKinematicsCCDApp()
 //
 MotionDeformationApp::~MotionDeformationApp()
 {
-	if ( motion )
-		delete  motion;
-	if ( curr_posture && curr_posture->body )
-		delete  curr_posture->body;
+	// 動作データ・骨格モデルは動作ライブラリが管理するため、姿勢などのみを削除
+	// （基底クラスで骨格モデルが削除されないよう、現在の姿勢は削除後にクリアする）
 	if ( curr_posture )
 		delete  curr_posture;
+	curr_posture = NULL;
 	if ( org_posture )
 		delete  org_posture;
 	if ( deformed_posture )
@@ -96,8 +109,6 @@ MotionDeformationApp::~MotionDeformationApp()
 
 	if (second_curr_posture)
 		delete  second_curr_posture;
-	if (second_motion)
-		delete  second_motion;
 
 	if (prev_motion_end_pose) 
 		delete prev_motion_end_pose;
@@ -225,15 +236,66 @@ void GetAdaptiveJointNames(const Skeleton* skeleton, const char** names)
 }
 
 
+//
+//  統計モデルの学習と結果読み込み（Pythonスクリプトを実行）
+//
+static void  TrainModelParameters( ModelParam & model_param )
+{
+	//　Python学習と結果読み込み
+	int ret = system("python train_model.py");
+	//  検証時はこっちも
+	// int validation = system("python cross_validation.py");
+
+	if (ret == 0) {
+		std::ifstream infile("model_params.txt");
+		if (infile.is_open()) {
+			// kire: 重み10つ + 切片
+			infile >> model_param.params_kire[0] >> model_param.params_kire[1]
+				>> model_param.params_kire[2] >> model_param.params_kire[3]
+				>> model_param.params_kire[4] >> model_param.params_kire[5]
+				>> model_param.params_kire[6] >> model_param.params_kire[7]
+				>> model_param.params_kire[8] >> model_param.params_kire[9]
+				>> model_param.params_kire[10];
+
+			// furi: 重み10つ + 切片
+			for (int i = 0; i < 7; i++) {
+				infile >> model_param.params_furi[i][0] >> model_param.params_furi[i][1]
+					>> model_param.params_furi[i][2] >> model_param.params_furi[i][3]
+					>> model_param.params_furi[i][4] >> model_param.params_furi[i][5]
+					>> model_param.params_furi[i][6] >> model_param.params_furi[i][7]
+					>> model_param.params_furi[i][8] >> model_param.params_furi[i][9]
+					>> model_param.params_furi[i][10];
+			}
+	 
+			// bezier: 重み10つ + 切片
+			for (int i = 0; i < 4; i++) {
+				infile >> model_param.params_bezier[i][0] >> model_param.params_bezier[i][1]
+					>> model_param.params_bezier[i][2] >> model_param.params_bezier[i][3]
+					>> model_param.params_bezier[i][4] >> model_param.params_bezier[i][5]
+					>> model_param.params_bezier[i][6] >> model_param.params_bezier[i][7]
+					>> model_param.params_bezier[i][8] >> model_param.params_bezier[i][9]
+					>> model_param.params_bezier[i][10];
+			}
+
+			// 標準化に使用した平均(mean)を読み込む
+			for (int i = 0; i < 10; i++) infile >> model_param.means[i];
+			// 標準化に使用した標準偏差(std)を読み込む
+			for (int i = 0; i < 10; i++) infile >> model_param.stds[i];
+
+			infile.close();
+		}
+	}
+}
+
+
 //
 //  初期化
+//  （動作データの読み込み・解析はバックグラウンドで行い、完了するまでは読み込み中の画面を表示する）
 //
 void  MotionDeformationApp::Initialize()
 {
 	GLUTBaseApp::Initialize();
 
-	// 入力動作の初期化
-	InitMotion( 0 );
 	// Distanceinfo構造体の初期化
 	InitDistanceParameter(distanceinfo);
 
@@ -247,6 +309,161 @@ void  MotionDeformationApp::Initialize()
 	//// CSVのヘッダー（項目名）を書き込んでおきます
 	//csv_file << "time,frame,r_foot,l_foot,r_hand,l_hand,total" << std::endl;
 
+	// HumanBodyは動作データの読み込み後に設定
+	my_human_body = NULL;
+
+	// フリレベル・キレレベルの初期設定
+	furi[0] = 1.0f;
+	furi[1] = 1.0f;
+	furi[2] = 1.0f;
+	furi[3] = 1.0f;
+	furi[4] = 1.0f;
+	furi[5] = 1.0f;
+	furi[6] = 1.0f;
+	kire = 1.0f;
+
+	input_kire = 0.0f;
+	input_furi = 0.0f;
+
+	// ベジェ制御点の初期化
+	timewarp_deformation.bezier_control1 = Point2f(0.0f, 0.0f);
+	timewarp_deformation.bezier_control2 = Point2f(1.0f, 1.0f);
+
+	// 編集中のレベルの設定
+	selected_param = 0;
+
+	// タイムライン描画機能の初期化（動作データの読み込み後に設定）
+	timeline = new Timeline();
+
+	// 初期の視点を設定
+	camera_yaw = -90.0f;
+	camera_distance = 4.0f;
+
+	// 入力動作の読み込み・解析を開始
+	InitMotion( 0 );
+}
+
+
+//
+//  入力動作・２つ目の動作の読み込みと入力動作の解析をバックグラウンドで開始
+//
+void  MotionDeformationApp::StartLoading( const char * file_name, const char * second_file_name )
+{
+	// ファイル名を記憶
+	current_file_name = file_name;
+	is_loading = true;
+
+	// 入力動作・２つ目の動作の読み込みを開始
+	loading_error.clear();
+	loading_motion = loader.LoadMotion( file_name );
+	loading_second_motion = loader.LoadMotion( second_file_name );
+
+	// 入力動作の読み込み後に、末端部位の移動距離・ねじれの計算と統計モデルの学習を行う
+	// （アプリケーションの変数は変更せず、解析結果として返す）
+	shared_future< MotionHandle >  motion_future = loading_motion;
+	ModelParam  initial_param = model_param;
+	loading_analysis = loader.Run< MotionAnalysis >( "Analyzing motion", [ motion_future, initial_param ]()
+	{
+		MotionAnalysis  analysis;
+		analysis.model_param = initial_param;
+
+		MotionHandle  input_motion = motion_future.get();
+		if ( input_motion )
+		{
+			// 末端部位の移動距離の合計をフレーム毎に配列として出力
+			const char *  segment_names[ NUM_PRIMARY_SEGMENTS ];
+			GetAdaptiveSegmentNames( input_motion->body, segment_names );
+			CheckDistance( *input_motion, analysis.distance, analysis.model_param, segment_names );
+
+			// ねじれの計算
+			analysis.model_param.ChestVal = CalcChestVal( input_motion.get() );
+		}
+
+		// 統計モデルの学習と結果読み込み
+		TrainModelParameters( analysis.model_param );
+
+		return  analysis;
+	} );
+}
+
+
+//
+//  バックグラウンドでの読み込みの完了を確認
+//  （アイドル時の処理から呼び出し、全ての結果が揃っていれば切り替える）
+//
+void  MotionDeformationApp::UpdateLoading()
+{
+	if ( !is_loading )
+		return;
+
+	if ( !IsFutureReady( loading_motion ) || !IsFutureReady( loading_second_motion ) || !IsFutureReady( loading_analysis ) )
+		return;
+
+	is_loading = false;
+	FinishLoading();
+}
+
+
+//
+//  バックグラウンド処理の結果を取得
+//  （処理中に例外が発生していた場合は、エラーの説明を出力して false を返す）
+//
+template< class T >
+static bool  GetLoadingResult( const shared_future< T > & f, T & result, string & error )
+{
+	try
+	{
+		result = f.get();
+		return  true;
+	}
+	catch ( const exception & e )
+	{
+		error = e.what();
+	}
+	catch ( ... )
+	{
+		error = "unknown error";
+	}
+	return  false;
+}
+
+
+//
+//  読み込んだ動作データ・解析結果にもとづく動作変形情報などの初期化
+//
+void  MotionDeformationApp::FinishLoading()
+{
+	// 読み込んだ動作データ・解析結果を取得
+	MotionHandle  new_motion;
+	MotionHandle  new_second_motion;
+	MotionAnalysis  analysis;
+	bool  motion_loaded = GetLoadingResult( loading_motion, new_motion, loading_error );
+	GetLoadingResult( loading_second_motion, new_second_motion, loading_error );
+	bool  analysis_finished = GetLoadingResult( loading_analysis, analysis, loading_error );
+	loading_motion = shared_future< MotionHandle >();
+	loading_second_motion = shared_future< MotionHandle >();
+	loading_analysis = shared_future< MotionAnalysis >();
+
+	// 読み込み・解析中にエラーが発生した場合は、エラーを出力
+	// （入力動作の読み込みか解析に失敗した場合は、入力動作を切り替えずに終了する）
+	if ( !loading_error.empty() )
+		printf( "Error: Failed to load motion (%s).\n", loading_error.c_str() );
+	// （２つ目の動作の読み込みに失敗した場合は、２つ目の動作は設定しない）
+	if ( !motion_loaded || !analysis_finished )
+		return;
+
+	// 動作データを設定（読み込みに失敗した場合は、読み込み中の画面のままとする）
+	if ( new_motion )
+		SetMotion( new_motion );
+	if ( new_second_motion )
+		SetSecondMotion( new_second_motion );
+	if ( !motion )
+		return;
+
+	// 末端部位の移動距離・統計モデルの情報を設定
+	distanceinfo = analysis.distance;
+	model_param = analysis.model_param;
+
 	// 解析を行う動作データの骨格の、主要体節の名前を設定
 	const char * primary_segment_names[NUM_PRIMARY_SEGMENTS];
 
@@ -287,10 +504,6 @@ void  MotionDeformationApp::Initialize()
 		primary_joint_names[JOI_BACK] = "Spine";
 		primary_joint_names[JOI_NECK] = "Neck";
 	}
-	
-
-	// 末端部位の移動距離の合計をフレーム毎に配列として出力
-	CheckDistance(*motion, distanceinfo, model_param, primary_segment_names);
 
 	// HumanBodyのセットアップ
 	if (motion && motion->body) {
@@ -304,6 +517,9 @@ void  MotionDeformationApp::Initialize()
 		{
 			my_human_body->SetPrimaryJoint((PrimaryJointType)i, primary_joint_names[i]);
 		}
+
+		// 接地した足の固定に使う、手足の逆運動学計算（解析的手法）の情報を設定
+		my_human_body->InitLimbParameters();
 	}
 	else {
 		my_human_body = NULL;
@@ -320,95 +536,73 @@ void  MotionDeformationApp::Initialize()
 	// 最初のフレームで必ず計算が走るように、ありえない値で初期化
 	for (int i = 0; i < 7; i++) prev_furi[i] = -999.9f;
 
-	// フリレベル・キレレベルの初期設定
-	furi[0] = 1.0f;
-	furi[1] = 1.0f;
-	furi[2] = 1.0f;
-	furi[3] = 1.0f;
-	furi[4] = 1.0f;
-	furi[5] = 1.0f;
-	furi[6] = 1.0f;
-	kire = 1.0f;
-
-	input_kire = 0.0f;
-	input_furi = 0.0f;
-
-	// ベジェ制御点の初期化
-	timewarp_deformation.bezier_control1 = Point2f(0.0f, 0.0f);
-	timewarp_deformation.bezier_control2 = Point2f(1.0f, 1.0f);
-
 	// 交差項の設定
 	model_param.interaction = input_furi * input_kire;
 
-	// 編集中のレベルの設定
-	selected_param = 0;
-
-	// ねじれの計算
-	model_param.ChestVal = CalcChestVal(motion);
+	// （仮置き）pythonによる推定結果
+	EstimateParameters(input_furi, input_kire, model_param);
 
-	// prev_output_root_posの設定
-	prev_output_root_pos = motion->frames[0].root_pos;
+	// タイムラインの設定
+	InitTimeline( timeline, *motion, deformation, timewarp_deformation, 0.0f );
 
-	// 動作変形情報の初期化
-	//InitParameter();
+	// 動作の最初から再生を開始
+	animation_time = 0.0f;
+	frame_no = 0;
+	prev_output_root_pos.set(-99999.0f, -99999.0f, -99999.0f);
+	prev_input_root_pos.set(-99999.0f, -99999.0f, -99999.0f);
+}
 
-	//　Python学習と結果読み込み
-	int ret = system("python train_model.py");
-	//  検証時はこっちも
-	// int validation = system("python cross_validation.py");
 
-	if (ret == 0) {
-		std::ifstream infile("model_params.txt");
-		if (infile.is_open()) {
-			// kire: 重み10つ + 切片
-			infile >> model_param.params_kire[0] >> model_param.params_kire[1]
-				>> model_param.params_kire[2] >> model_param.params_kire[3]
-				>> model_param.params_kire[4] >> model_param.params_kire[5]
-				>> model_param.params_kire[6] >> model_param.params_kire[7]
-				>> model_param.params_kire[8] >> model_param.params_kire[9]
-				>> model_param.params_kire[10];
+//
+//  読み込みの進捗を描画
+//
+void  MotionDeformationApp::DrawLoadingProgress()
+{
+	if ( !is_loading )
+		return;
 
-			// furi: 重み10つ + 切片
-			for (int i = 0; i < 7; i++) {
-				infile >> model_param.params_furi[i][0] >> model_param.params_furi[i][1]
-					>> model_param.params_furi[i][2] >> model_param.params_furi[i][3]
-					>> model_param.params_furi[i][4] >> model_param.params_furi[i][5]
-					>> model_param.params_furi[i][6] >> model_param.params_furi[i][7]
-					>> model_param.params_furi[i][8] >> model_param.params_furi[i][9]
-					>> model_param.params_furi[i][10];
-			}
-	 
-			// bezier: 重み10つ + 切片
-			for (int i = 0; i < 4; i++) {
-				infile >> model_param.params_bezier[i][0] >> model_param.params_bezier[i][1]
-					>> model_param.params_bezier[i][2] >> model_param.params_bezier[i][3]
-					>> model_param.params_bezier[i][4] >> model_param.params_bezier[i][5]
-					>> model_param.params_bezier[i][6] >> model_param.params_bezier[i][7]
-					>> model_param.params_bezier[i][8] >> model_param.params_bezier[i][9]
-					>> model_param.params_bezier[i][10];
-			}
+	// 終了した処理の割合をバーで表示
+	const int  bar_length = 20;
+	int  num_tasks = loader.GetNumTasks();
+	int  num_finished = loader.GetNumFinishedTasks();
+	int  filled = ( num_tasks > 0 ) ? bar_length * num_finished / num_tasks : 0;
+	char  bar[ bar_length + 1 ];
+	for ( int i = 0; i < bar_length; i++ )
+		bar[ i ] = ( i < filled ) ? '#' : '.';
+	bar[ bar_length ] = '\0';
+
+	char  message[ 256 ];
+	snprintf( message, sizeof( message ), "Loading [%s] %d / %d", bar, num_finished, num_tasks );
+	DrawTextInformation( 1, message );
+	snprintf( message, sizeof( message ), "%s", loader.GetStatus().c_str() );
+	DrawTextInformation( 2, message );
+}
 
-			// 標準化に使用した平均(mean)を読み込む
-			for (int i = 0; i < 10; i++) infile >> model_param.means[i];
-			// 標準化に使用した標準偏差(std)を読み込む
-			for (int i = 0; i < 10; i++) infile >> model_param.stds[i];
 
-			infile.close();
-		}
+//
+//  接地している足の逆運動学計算の繰り返し数の分布を描画（確認用）
+//  （繰り返し計算を使用している場合のみ、左右の足の計算回数・平均繰り返し数・繰り返し数ごとの計算回数を表示）
+//
+void  MotionDeformationApp::DrawFootIKInformation( int line_no )
+{
+	char  message[ 256 ];
+	if ( use_limb_ik )
+	{
+		DrawTextInformation( line_no, "foot IK: analytic (f to change)" );
+		return;
 	}
 
-	// （仮置き）pythonによる推定結果
-	EstimateParameters(input_furi, input_kire, model_param);
-
-	// タイムライン描画機能の初期化
-	timeline = new Timeline();
-	if ( motion )
-		InitTimeline( timeline, *motion, deformation, timewarp_deformation, 0.0f );
-
-	// 初期の視点を設定
-	camera_yaw = -90.0f;
-	camera_distance = 4.0f;
-
+	const IKWarmStartState *  states[ 2 ] = { &r_foot_ik_state, &l_foot_ik_state };
+	const char *  labels[ 2 ] = { "R", "L" };
+	for ( int s = 0; s < 2; s++ )
+	{
+		const IKWarmStartState &  state = *states[ s ];
+		int  length = snprintf( message, sizeof( message ), "foot IK (%s) %s: %d solves, mean %.2f iter.",
+			GetDefaultIKSolver().GetName(), labels[ s ], state.GetNumSolves(), state.GetMeanIterations() );
+		for ( int i = 0; ( i < (int) state.iteration_histogram.size() ) && ( length < (int) sizeof( message ) ); i++ )
+			length += snprintf( message + length, sizeof( message ) - length, " %d:%d", i, state.iteration_histogram[ i ] );
+		DrawTextInformation( line_no + s, message );
+	}
 }
 
 
@@ -456,8 +650,16 @@ void  MotionDeformationApp::Display()
 			glTranslatef( -1.0f, 0.0f, 0.0f );
 
 		glColor3f( 1.0f, 1.0f, 1.0f );
-		DrawPosture( *org_posture );
-		DrawPostureShadow( *org_posture, shadow_dir, shadow_color );
+		if ( org_frame_no >= 0 )
+		{
+			DrawMotionFrame( *motion, org_frame_no );
+			DrawMotionFrameShadow( *motion, org_frame_no, shadow_dir, shadow_color );
+		}
+		else
+		{
+			DrawPosture( *org_posture );
+			DrawPostureShadow( *org_posture, shadow_dir, shadow_color );
+		}
 
 		glPopMatrix();
 	}
@@ -495,7 +697,7 @@ void  MotionDeformationApp::Display()
 	//}
 
 	// タイムラインを描画
-	if ( timeline )
+	if ( timeline && !is_loading )
 	{
 		timeline->SetLineTime( 1, animation_time );
 		timeline->DrawTimeline();
@@ -503,6 +705,13 @@ void  MotionDeformationApp::Display()
 
 	// 現在のモード、時間・フレーム番号を表示
 	DrawTextInformation( 0, "Motion Deformation Base" );
+	DrawLoadingProgress();
+	if ( !loading_error.empty() )
+	{
+		char  error_message[ 256 ];
+		snprintf( error_message, sizeof( error_message ), "Load error: %s", loading_error.c_str() );
+		DrawTextInformation( 2, error_message );
+	}
 	char  message[64];
 	if ( motion )
 	{
@@ -530,6 +739,14 @@ void  MotionDeformationApp::Display()
 		sprintf(param_msg, "EDIT: %s = %.2f (Use [ / ] to change)", part_names[selected_param], val);
 		DrawTextInformation(4, param_msg); 
 	}
+
+	// 前回のフレームで姿勢の領域を確保した回数を表示（確認用の情報の表示中のみ）
+	if ( draw_debug_info && motion && !is_loading )
+	{
+		sprintf( message, "posture allocations: %d", num_frame_posture_allocations );
+		DrawTextInformation( 5, message );
+		DrawFootIKInformation( 6 );
+	}
 }
 
 
@@ -553,6 +770,10 @@ void  MotionDeformationApp::MouseClick( int button, int state, int mx, int my )
 {
 	GLUTBaseApp::MouseClick( button, state, mx, my );
 
+	// 動作データの読み込み中は操作を受け付けない
+	if ( is_loading )
+		return;
+
 	// マウス座標に対応するタイムラインのトラック番号・時刻を取得
 	int  selected_track_no = timeline->GetTrackByPosition( mx, my );
 	float  selected_time = timeline->GetTimeByPosition( mx );
@@ -573,6 +794,10 @@ void  MotionDeformationApp::MouseDrag( int mx, int my )
 {
 	GLUTBaseApp::MouseDrag( mx, my );
 
+	// 動作データの読み込み中は操作を受け付けない
+	if ( is_loading )
+		return;
+
 	// マウス座標に対応するタイムラインのトラック番号・時刻を取得
 	int  selected_track_no = timeline->GetTrackByPosition( mx, my );
 	float  selected_time = timeline->GetTimeByPosition( mx );
@@ -595,6 +820,24 @@ void  MotionDeformationApp::Keyboard( unsigned char key, int mx, int my )
 {
 	GLUTBaseApp::Keyboard( key, mx, my );
 
+	// 動作データの読み込み中は操作を受け付けない
+	if ( is_loading )
+		return;
+
+	// i キーで確認用の情報の表示の有無を変更
+	if ( key == 'i' )
+		draw_debug_info = !draw_debug_info;
+
+	// f キーで接地している足の固定の手法（解析的手法・繰り返し計算）を変更
+	if ( key == 'f' )
+	{
+		use_limb_ik = !use_limb_ik;
+		r_foot_ik_state.Reset();
+		l_foot_ik_state.Reset();
+		r_foot_ik_state.ClearHistogram();
+		l_foot_ik_state.ClearHistogram();
+	}
+
 	// 数字キーで入力動作・動作変形情報を変更
 	//if ( ( key >= '1' ) && ( key <= '9' ) )
 	//{
@@ -873,6 +1116,9 @@ void  MotionDeformationApp::Keyboard( unsigned char key, int mx, int my )
 //
 void  MotionDeformationApp::Animation( float delta )
 {
+	// バックグラウンドでの読み込みが完了していれば、読み込んだ動作データに切り替え
+	UpdateLoading();
+
 	// アニメーション再生中でなければ終了
 	if ( !on_animation )
 		return;
@@ -885,6 +1131,9 @@ void  MotionDeformationApp::Animation( float delta )
 	if ( !motion )
 		return;
 
+	// 姿勢の領域の確保回数を記録（バックグラウンドでの読み込み中は、その処理での確保も含まれる）
+	long long  prev_posture_allocations = GetPostureAllocationCount();
+
 	// ループ判定用のフラグを用意
 	bool is_loop = false;
 
@@ -909,6 +1158,7 @@ void  MotionDeformationApp::Animation( float delta )
 
 	// 動作データから現在時刻の姿勢を取得
 	motion->GetPosture( animation_time, *org_posture );
+	org_frame_no = motion->GetFrameNo( animation_time );
 
 	// 動作変換（タイムワーピング）の情報の更新
 	InitTimeDeformationParameter(animation_time, distanceinfo, timewarp_deformation, *motion, kire);
@@ -921,7 +1171,7 @@ void  MotionDeformationApp::Animation( float delta )
 
 	// 動作変形（動作ワーピング）の適用後の姿勢の計算
 	//weight = ApplyMotionDeformation( animation_time, deformation, *motion, *deformed_posture, timewarp_deformation, *deformed_posture );
-	weight = ApplyMotionDeformation(animation_time, deformation, *motion, *deformed_posture, timewarp_deformation, distanceinfo, furi, my_human_body, fixed_r_foot_pos, fixed_l_foot_pos, r_foot_lock, l_foot_lock, prev_output_root_pos, prev_input_root_pos, *deformed_posture, is_loop, kire);
+	weight = ApplyMotionDeformation(animation_time, deformation, *motion, *deformed_posture, timewarp_deformation, distanceinfo, furi, my_human_body, fixed_r_foot_pos, fixed_l_foot_pos, r_foot_lock, l_foot_lock, prev_output_root_pos, prev_input_root_pos, *deformed_posture, is_loop, kire, &r_foot_ik_state, &l_foot_ik_state, use_limb_ik);
 
 	//// 【追加】過去の動作からの累積オフセットを取得して適用
 	//Vector3f cumulative_pos;
@@ -952,6 +1202,9 @@ void  MotionDeformationApp::Animation( float delta )
 
 	// ２つ目の動作の姿勢を取得
  	second_motion->GetPosture(animation_time, *second_curr_posture);
+
+	// このフレームで姿勢の領域を確保した回数を記録
+	num_frame_posture_allocations = GetPostureAllocationCount() - prev_posture_allocations;
 }
 
 
@@ -1034,15 +1287,14 @@ void  MotionDeformationApp::InitMotion( int no )
 
 		//LoadBVH("radio_long_3_Char00.bvh");
 		//LoadBVH("sample_walking2.bvh");
-		LoadBVH("radio_new_4_Char00.bvh");
 
-		LoadSecondBVH("radio_middle_1_Char00.bvh");
 		//LoadSecondBVH("steplong_Char00.bvh");
 		//LoadSecondBVH("radio_long_3_Char00.bvh");
 		//LoadSecondBVH("fight_punch_key.bvh");
 		//LoadSecondBVH("radio_long_2_Char00.bvh"); //4
-		if ( !motion )
-			return;
+
+		// 入力動作・２つ目の動作の読み込みをバックグラウンドで開始（完了後に FinishLoading() で初期化）
+		StartLoading("radio_new_4_Char00.bvh", "radio_middle_1_Char00.bvh");
 	}
 }
 
@@ -1122,18 +1374,24 @@ void  MotionDeformationApp::LoadBVH( const char * file_name )
 	// ファイル名を記憶
 	current_file_name = file_name;
 
-	// BVHファイルを読み込んで動作データ（＋骨格モデル）を生成
-	Motion *  new_motion = LoadAndCoustructBVHMotion( file_name );
+	// 動作ライブラリから動作データを取得（同じファイルは一度だけ読み込み、同じ骨格モデルは共有される）
+	MotionHandle  new_motion = MotionLibrary::GetInstance().LoadMotion( file_name );
 
 	// BVHファイルの読み込みに失敗したら終了
 	if ( !new_motion )
 		return;
 
-	// 骨格・動作・姿勢の削除
-	if ( motion && motion->body )
-		delete  motion->body;
-	if ( motion )
-		delete  motion;
+	// 動作・姿勢の初期化
+	SetMotion( new_motion );
+}
+
+
+//
+//  動作変形に使用する動作の設定、骨格・姿勢の初期化
+//
+void  MotionDeformationApp::SetMotion( const MotionHandle & new_motion )
+{
+	// 姿勢の削除（動作データ・骨格モデルは動作ライブラリが管理する）
 	if ( curr_posture )
 		delete  curr_posture;
 	if ( org_posture )
@@ -1142,11 +1400,13 @@ void  MotionDeformationApp::LoadBVH( const char * file_name )
 		delete  deformed_posture;
  
 	// 動作変形に使用する動作・姿勢の初期化
-	motion = new_motion;
+	motion_handle = new_motion;
+	motion = motion_handle.get();
 	curr_posture = new Posture();
 	InitPosture( *curr_posture, motion->body );
 	org_posture = new Posture();
 	InitPosture( *org_posture, motion->body );
+	org_frame_no = -1;
 	deformed_posture = new Posture();
 	InitPosture( *deformed_posture, motion->body );
 }
@@ -1157,23 +1417,30 @@ void  MotionDeformationApp::LoadBVH( const char * file_name )
 //
 void  MotionDeformationApp::LoadSecondBVH(const char* file_name)
 {
-	// BVHファイルを読み込んで動作データ（＋骨格モデル）を生成
-	Motion* new_motion = LoadAndCoustructBVHMotion(file_name);
+	// 動作ライブラリから動作データを取得（同じファイルは一度だけ読み込み、同じ骨格モデルは共有される）
+	MotionHandle new_motion = MotionLibrary::GetInstance().LoadMotion(file_name);
 
 	// BVHファイルの読み込みに失敗したら終了
 	if (!new_motion)
 		return;
 
-	// 現在使用している骨格・動作・姿勢を削除
-	if (second_motion && second_motion->body)
-		delete  second_motion->body;
-	if (second_motion)
-		delete  second_motion;
+	// 動作・姿勢の初期化
+	SetSecondMotion(new_motion);
+}
+
+
+//
+// ２つ目の動作の設定、姿勢の初期化
+//
+void  MotionDeformationApp::SetSecondMotion(const MotionHandle& new_motion)
+{
+	// 現在使用している姿勢を削除（動作データ・骨格モデルは動作ライブラリが管理する）
 	if (second_curr_posture)
 		delete  second_curr_posture;
 
 	// 動作再生に使用する動作・姿勢を初期化
-	second_motion = new_motion;
+	second_motion_handle = new_motion;
+	second_motion = second_motion_handle.get();
 	second_curr_posture = new Posture(second_motion->body);
 }
 
@@ -1334,98 +1601,103 @@ void MotionDeformationApp::GetCumulativeOffset(float current_time, Vector3f& out
 void  MotionDeformationApp::SaveDeformedMotionAsBVH( const char * file_name )
 {
 	// 変形後の動作データを生成
-	Motion* deformed_motion = GenerateDeformedMotion(deformation, *motion, distanceinfo, my_human_body, fixed_r_foot_pos, fixed_l_foot_pos, r_foot_lock, l_foot_lock, prev_output_root_pos, prev_input_root_pos, is_loop ,kire, furi);
+	Motion* deformed_motion = GenerateDeformedMotion(deformation, *motion, distanceinfo, my_human_body, fixed_r_foot_pos, fixed_l_foot_pos, r_foot_lock, l_foot_lock, prev_output_root_pos, prev_input_root_pos, is_loop ,kire, furi, use_limb_ik);
 	if (!deformed_motion) return;
 
-	// テンプレートとなるBVHファイルを読み込む
-	BVH template_bvh( current_file_name.c_str() );
-
-	if (!template_bvh.IsLoadSuccess()) {
+	// テンプレートとなるBVHファイルの階層構造を取得（動作ライブラリが一度だけ読み込み、モーションデータは読み込まない）
+	shared_ptr< const BVH > template_bvh_handle = MotionLibrary::GetInstance().LoadHierarchy( current_file_name.c_str() );
+	if (!template_bvh_handle) {
 		printf("Error: Template BVH (radio_long_3_Char00.bvh) load failed.\n");
 		delete deformed_motion;
 		return;
 	}
+	const BVH& template_bvh = *template_bvh_handle;
 
 	int num_frames = deformed_motion->num_frames;
 	int num_channels = template_bvh.GetNumChannel();
 	double* data = new double[num_frames * num_channels];
 
+	// チャンネルと姿勢の対応情報（関節ごとの回転順序）を最初に一度だけ判定
+	BVHChannelLayout layout;
+	InitBVHChannelLayout(&template_bvh, layout);
+
 	// 全フレームループ
 	for (int f = 0; f < num_frames; f++)
 	{
 		Posture& pose = deformed_motion->frames[f];
+		double* frame_data = &data[f * num_channels];
 
+		// 位置情報の書き出し
 		for (int c = 0; c < num_channels; c++)
 		{
 			const BVH::Channel* channel = template_bvh.GetChannel(c);
 			const BVH::Joint* joint = channel->joint;
-			int joint_index = joint->index; // SimpleHumanのJoint indexと一致すると仮定
 
-			double value = 0.0;
+			if (channel->type != BVH::X_POSITION &&
+				channel->type != BVH::Y_POSITION &&
+				channel->type != BVH::Z_POSITION)
+				continue;
 
-			// 位置情報の書き出し
-			if (channel->type == BVH::X_POSITION ||
-				channel->type == BVH::Y_POSITION ||
-				channel->type == BVH::Z_POSITION)
-			{
-				if (joint->parent == NULL) {
-					// ルート関節は Posture の root_pos を使用
-					if (channel->type == BVH::X_POSITION) value = pose.root_pos.x / 0.01; // cm -> m 逆変換(bvh_scaleが0.01の場合)
-					if (channel->type == BVH::Y_POSITION) value = pose.root_pos.y / 0.01;
-					if (channel->type == BVH::Z_POSITION) value = pose.root_pos.z / 0.01;
-				}
-				else {
-					// 子関節は OFFSET（骨の長さ）を使用することで潰れるのを防ぐ
-					if (channel->type == BVH::X_POSITION) value = joint->offset[0];
-					if (channel->type == BVH::Y_POSITION) value = joint->offset[1];
-					if (channel->type == BVH::Z_POSITION) value = joint->offset[2];
-				}
+			double value = 0.0;
+			if (joint->parent == NULL) {
+				// ルート関節は Posture の root_pos を使用
+				if (channel->type == BVH::X_POSITION) value = pose.root_pos.x / 0.01; // cm -> m 逆変換(bvh_scaleが0.01の場合)
+				if (channel->type == BVH::Y_POSITION) value = pose.root_pos.y / 0.01;
+				if (channel->type == BVH::Z_POSITION) value = pose.root_pos.z / 0.01;
 			}
-			// 回転情報の書き出し
-			else
-			{
-				// ここで関節に対応する回転行列を取得
-				Matrix3f rot_mat;
-
-				if (joint->parent == NULL) {
-					// ルート関節の回転は pose.root_ori に格納されている
-					rot_mat = pose.root_ori;
-				}
-				else {
-					// 子関節のインデックス補正
-					int simple_joint_index = joint->index - 1;
-
-					if (simple_joint_index >= 0 && simple_joint_index < deformed_motion->body->num_joints) {
-						rot_mat = pose.joint_rotations[simple_joint_index];
-					}
-					else {
-						rot_mat.setIdentity();
-					}
-				}
-
-				double rx, ry, rz;
-				Quat4f q;
-				q.set(rot_mat);
-
-				// オイラー角に変換 (YXZ順)
-				QuatToEulerYXZ(q, ry, rx, rz);
+			else {
+				// 子関節は OFFSET（骨の長さ）を使用することで潰れるのを防ぐ
+				if (channel->type == BVH::X_POSITION) value = joint->offset[0];
+				if (channel->type == BVH::Y_POSITION) value = joint->offset[1];
+				if (channel->type == BVH::Z_POSITION) value = joint->offset[2];
+			}
+			frame_data[c] = value;
+		}
 
-				if (channel->type == BVH::X_ROTATION) value = rx;
-				if (channel->type == BVH::Y_ROTATION) value = ry;
-				if (channel->type == BVH::Z_ROTATION) value = rz;
+		// 回転情報の書き出し（関節ごとに一度だけ、チャンネルの回転順序に合わせてオイラー角に変換）
+		for (int j = 0; j < (int)layout.joints.size(); j++)
+		{
+			const BVHChannelLayout::JointRotation& rotation = layout.joints[j];
+			if (rotation.num_channels == 0)
+				continue;
+
+			// ここで関節に対応する回転行列を取得
+			Matrix3f rot_mat;
+			if (j == 0) {
+				// ルート関節の回転は pose.root_ori に格納されている
+				rot_mat = pose.root_ori;
+			}
+			else if (j - 1 < deformed_motion->body->num_joints) {
+				// 子関節のインデックス補正
+				rot_mat = pose.joint_rotations[j - 1];
+			}
+			else {
+				rot_mat.setIdentity();
 			}
 
-			data[f * num_channels + c] = value;
+			// オイラー角に変換（３軸の回転でない場合は YXZ順 で変換して各軸の角度を使用）
+			double angles[3];
+			if (rotation.order != EULER_UNKNOWN) {
+				MatrixToEuler((EulerOrder)rotation.order, rot_mat, angles);
+				for (int k = 0; k < 3; k++)
+					frame_data[layout.rotation_channels[rotation.first + k]] = angles[k];
+			}
+			else {
+				double axis_angles[3];
+				MatrixToEuler(EULER_YXZ, rot_mat, angles);
+				axis_angles[1] = angles[0];
+				axis_angles[0] = angles[1];
+				axis_angles[2] = angles[2];
+				for (int k = 0; k < rotation.num_channels; k++)
+					frame_data[layout.rotation_channels[rotation.first + k]] = axis_angles[rotation.axes[k]];
+			}
 		}
-
-		// 保存実行
-		template_bvh.SetMotion(num_frames, deformed_motion->interval, data);
-		template_bvh.Save(file_name);
 	}
 
-	// 保存実行
-	//template_bvh.SetMotion(num_frames, deformed_motion->interval, data);
-	//template_bvh.Save(file_name);
+	// 保存実行（全フレームの変換後に一度だけ書き出す。書き込み途中のファイルが残らないよう一時ファイル経由で置き換える）
+	if (!template_bvh.Save(file_name, num_frames, deformed_motion->interval, data, true)) {
+		printf("Error: Failed to save BVH file (%s).\n", file_name);
+	}
 
 	delete[] data;
 	delete deformed_motion;
@@ -1507,12 +1779,10 @@ void InitDistanceParameter(vector<DistanceParam> & param)
 // 肩を利用したねじれの計算
 //
 
-float CalcChestVal(const Motion* motion)
+// ねじれの計算に使用する左右の肩の関節を特定
+static void GetChestValJoints(const Skeleton* body, int& rShldrIdx, int& lShldrIdx)
 {
-	if (!motion) return 0.0;
-
-	// 1. 関節の特定
-	HumanBody human_body(motion->body);
+	HumanBody human_body(body);
 
 	// 候補リストを使って存在するものを登録する
 	const char* r_shoulder_candidates[] = { "RightArm", "RightShoulder", "RightCollar" };
@@ -1530,53 +1800,96 @@ float CalcChestVal(const Motion* motion)
 		if (human_body.GetPrimaryJoint(JOI_L_SHOULDER) != -1) break;
 	}
 
-	int rShldrIdx = human_body.GetPrimaryJoint(JOI_R_SHOULDER);
-	int lShldrIdx = human_body.GetPrimaryJoint(JOI_L_SHOULDER);
+	rShldrIdx = human_body.GetPrimaryJoint(JOI_R_SHOULDER);
+	lShldrIdx = human_body.GetPrimaryJoint(JOI_L_SHOULDER);
+}
 
-	std::vector<float> torsionValues;
-	torsionValues.reserve(motion->num_frames);
+// １フレーム分のねじれ（左右の肩のZ座標の差）を右肩と左肩の位置から計算し、分散の計算のために合計を更新
+static void AddChestValPositions(const Point3f& rPos, const Point3f& lPos, double& sum, double& sqSum)
+{
+	// Z軸（奥行き）の差分を計算
+	// パンチ動作等は、片方の肩が前、もう片方が後ろに行くため、この値が大きく変動します
+	float zDiff = rPos.z - lPos.z;
 
-	// 計算用の一時変数
-	Posture temp_posture;
-	std::vector< Matrix4f > seg_frames;
-	std::vector< Point3f > joint_positions;
+	sum += zDiff;
+	sqSum += (double)zDiff * zDiff;
+}
 
-	// 2. 全フレームを走査
-	for (int i = 0; i < motion->num_frames; ++i)
-	{
-		// 時間から姿勢を取得
-		float time = i * motion->interval;
-		motion->GetPosture(time, temp_posture);
+// １フレーム分のねじれ（左右の肩のZ座標の差）を姿勢から計算し、分散の計算のために合計を更新
+static void AddChestValFrame(const Posture& posture, int rShldrIdx, int lShldrIdx,
+	vector< Matrix4f >& seg_frames, vector< Point3f >& joint_positions, double& sum, double& sqSum)
+{
+	// 順運動学計算 (FK) で、関節のグローバル座標を取得
+	ForwardKinematics(posture, seg_frames, joint_positions);
+
+	// 右肩と左肩の位置から計算
+	AddChestValPositions(joint_positions[rShldrIdx], joint_positions[lShldrIdx], sum, sqSum);
+}
+
+// 合計から分散を計算
+static float GetChestValVariance(int num_values, double sum, double sqSum)
+{
+	if (num_values == 0) return 0.0;
+
+	double mean = sum / num_values;
+	double variance = sqSum / num_values - mean * mean;
+	return (variance > 0.0) ? (float)variance : 0.0f;
+}
+
+float CalcChestVal(const Motion* motion)
+{
+	if (!motion) return 0.0;
 
-		// 順運動学計算 (FK) で、関節のグローバル座標を取得
-		ForwardKinematics(temp_posture, seg_frames, joint_positions);
+	// 1. 関節の特定
+	int rShldrIdx, lShldrIdx;
+	GetChestValJoints(motion->body, rShldrIdx, lShldrIdx);
+	if ((rShldrIdx == -1) || (lShldrIdx == -1)) return 0.0;
 
-		// 右肩と左肩の位置取得
-		Point3f rPos = joint_positions[rShldrIdx];
-		Point3f lPos = joint_positions[lShldrIdx];
+	// 全フレームの順運動学計算の結果を取得（他の解析処理と共有）
+	const MotionTransformTable* table = ForwardKinematicsBatch(motion);
+	if (!table) return 0.0;
 
-		// Z軸（奥行き）の差分を計算
-		// パンチ動作等は、片方の肩が前、もう片方が後ろに行くため、この値が大きく変動します
-		float zDiff = rPos.z - lPos.z;
+	// 計算用の一時変数
+	Point3f rPos, lPos;
+	double sum = 0.0, sqSum = 0.0;
 
-		torsionValues.push_back(zDiff);
+	// 2. 全フレームを走査
+	for (int i = 0; i < motion->num_frames; ++i)
+	{
+		table->GetJointPosition(i, rShldrIdx, rPos);
+		table->GetJointPosition(i, lShldrIdx, lPos);
+		AddChestValPositions(rPos, lPos, sum, sqSum);
 	}
 
 	// 3. 分散を計算
-	if (torsionValues.empty()) return 0.0;
+	return GetChestValVariance(motion->num_frames, sum, sqSum);
+}
+
+float CalcChestVal(BVHStream& stream)
+{
+	// 1. 関節の特定
+	const Skeleton* body = stream.GetSkeleton();
+	if (!body || !stream.Rewind()) return 0.0;
+	int rShldrIdx, lShldrIdx;
+	GetChestValJoints(body, rShldrIdx, lShldrIdx);
+	if ((rShldrIdx == -1) || (lShldrIdx == -1)) return 0.0;
 
-	// 平均値
-	float sum = std::accumulate(torsionValues.begin(), torsionValues.end(), 0.0);
-	float mean = sum / torsionValues.size();
+	// 計算用の一時変数
+	std::vector< Matrix4f > seg_frames;
+	std::vector< Point3f > joint_positions;
+	double sum = 0.0, sqSum = 0.0;
+	int num_values = 0;
 
-	// 分散
-	float sqSum = 0.0;
-	for (const float val : torsionValues) {
-		sqSum += std::pow(val - mean, 2);
+	// 2. 全フレームを一定フレーム数ずつ読み込みながら走査
+	while (stream.ReadPostureWindow() > 0)
+	{
+		for (int i = 0; i < stream.GetWindowNumFrames(); ++i)
+			AddChestValFrame(stream.GetPosture(i), rShldrIdx, lShldrIdx, seg_frames, joint_positions, sum, sqSum);
+		num_values += stream.GetWindowNumFrames();
 	}
-	float variance = sqSum / torsionValues.size();
 
-	return variance;
+	// 3. 分散を計算
+	return GetChestValVariance(num_values, sum, sqSum);
 }
 
 
@@ -1606,119 +1919,115 @@ float ShowPopupInput(const char* title, const char* prompt, float current_val)
 
 
 //
-// 末端部位の移動距離を測定
+// 順運動学計算により主要体節の位置を計算（１フレーム分）
 //
-void CheckDistance(const Motion& motion, vector<DistanceParam> & param, ModelParam& m_param, const char ** segment_names)
+static void GetPrimarySegmentPositions(const Posture& posture, const HumanBody& human_body,
+	vector< Matrix4f >& segment_frames, Point3f* segment_positions)
 {
-	// 骨格の追加情報を生成
-	// キャラクタの骨格情報
-	HumanBody* human_body;
+	Vector3f vec;
 
-	human_body = new HumanBody(motion.body);
-	for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
+	ForwardKinematics(posture, segment_frames);
+	for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++) 
 	{
-		human_body->SetPrimarySegment((PrimarySegmentType)i, segment_names[i]);
+		int seg_no = human_body.GetPrimarySegment((PrimarySegmentType)i);
+		if (seg_no != -1)
+		{
+			segment_frames[seg_no].get(&vec);
+			segment_positions[i] = vec;
+		}
 	}
-		
-	// 計算用変数
-	Point3f before_segment_positions[NUM_PRIMARY_SEGMENTS] ; // 前フレームの主要体節の位置
+}
 
-	// 末端部位の位置を取得
-	// 動作終了フレームまで繰り返す
-	for (float animation_time = 0; animation_time < motion.GetDuration(); animation_time += motion.interval)
+
+//
+// 末端部位の移動距離を測定（１フレーム分、主要体節の位置から測定）
+//
+static void AddDistanceFrame(const Point3f* segment_positions, const HumanBody& human_body, bool is_first_frame,
+	Point3f* before_segment_positions, vector<DistanceParam>& param, ModelParam& m_param)
+{
+
+	// もし初めのフレームなら前フレームの主要体節の位置を現在の位置と同一に設定
+	if (is_first_frame)
 	{
-		// 計算用変数
-		Posture * curr_posture = & motion.frames[0]; // 最初の姿勢で初期化
+		for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
+			before_segment_positions[i] = segment_positions[i];
+	}
 
-		// 動作データから現在時刻の姿勢を取得
-		motion.GetPosture(animation_time, *curr_posture);
+	// 両手足のフレーム間の距離を計算
+	float right_ankle_dist = segment_positions[0].distance(before_segment_positions[0]);
+	float left_ankle_dist = segment_positions[1].distance(before_segment_positions[1]);
+	float right_hand_dist = segment_positions[2].distance(before_segment_positions[2]);
+	float left_hand_dist = segment_positions[3].distance(before_segment_positions[3]);
 
-		// 順運動学計算により主要体節の位置を計算・記録
-		static vector< Matrix4f > segment_frames;
-		Vector3f vec;
-		Point3f segment_positions[NUM_PRIMARY_SEGMENTS];
+	float head_dist = segment_positions[6].distance(before_segment_positions[6]);
 
-		ForwardKinematics(*curr_posture, segment_frames);
-		for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++) 
-		{
-			int seg_no = human_body->GetPrimarySegment((PrimarySegmentType)i);
-			if (seg_no != -1)
-			{
-				segment_frames[seg_no].get(&vec);
-				segment_positions[i] = vec;
-			}
-		}
+	// 末端部位の移動距離の合計を計算
+	float total_dist = right_ankle_dist + left_ankle_dist + right_hand_dist + left_hand_dist;
 
-		// もし初めのフレームなら前フレームの主要体節の位置を現在の位置と同一に設定
-		if (animation_time == 0)
+	// 前フレームの両手足の位置を更新
+	for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
+	{
+		int  seg_no = human_body.GetPrimarySegment((PrimarySegmentType)i);
+		if (seg_no != -1)
 		{
-			for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
-				before_segment_positions[i] = segment_positions[i];
+			before_segment_positions[i] = segment_positions[i];
 		}
+	}
 
-		// 両手足のフレーム間の距離を計算
-		float right_ankle_dist = segment_positions[0].distance(before_segment_positions[0]);
-		float left_ankle_dist = segment_positions[1].distance(before_segment_positions[1]);
-		float right_hand_dist = segment_positions[2].distance(before_segment_positions[2]);
-		float left_hand_dist = segment_positions[3].distance(before_segment_positions[3]);
+	m_param.right_foot_dist += right_ankle_dist;
+	m_param.left_foot_dist += left_ankle_dist;
+	m_param.right_hand_dist += right_hand_dist;
+	m_param.left_hand_dist += left_hand_dist;
+	m_param.head_dist += head_dist;
 
-		float head_dist = segment_positions[6].distance(before_segment_positions[6]);
+	// 保存用変数
+	DistanceParam d;
 
-		// 末端部位の移動距離の合計を計算
-		float total_dist = right_ankle_dist + left_ankle_dist + right_hand_dist + left_hand_dist;
+	// 末端部位の移動距離の合計を格納
+	d.distanceadd=total_dist;
 
-		// 前フレームの両手足の位置を更新
-		for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
-		{
-			int  seg_no = human_body->GetPrimarySegment((PrimarySegmentType)i);
-			if (seg_no != -1)
-			{
-				before_segment_positions[i] = segment_positions[i];
-			}
-		}
-
-		m_param.right_foot_dist += right_ankle_dist;
-		m_param.left_foot_dist += left_ankle_dist;
-		m_param.right_hand_dist += right_hand_dist;
-		m_param.left_hand_dist += left_hand_dist;
-		m_param.head_dist += head_dist;
-
-		// 保存用変数
-		DistanceParam d;
+	// 動作が動いているかどうかの初期化
+	d.movecheck = 1;
 
-		// 末端部位の移動距離の合計を格納
-		d.distanceadd=total_dist;
+	// 動作が開始したかどうかの判断の初期化
+	d.move_start = true;
 
-		// 動作が動いているかどうかの初期化
-		d.movecheck = 1;
+	// 動作が動いているかどうかの閾値の初期化
+	d.move_amount = 10000;
 
-		// 動作が開始したかどうかの判断の初期化
-		d.move_start = true;
+	// 接地判定の閾値設定
+	float dist_threshold =  0.003f;  // 水平移動量の閾値
+	float height_threshold = segment_positions[SEG_R_FOOT].y + 0.08f; // 高さの閾値
 
-		// 動作が動いているかどうかの閾値の初期化
-		d.move_amount = 10000;
+	// 両方の条件を満たしたときだけ「接地」とみなす
+	d.is_r_foot_grounded = (right_ankle_dist < dist_threshold) && (segment_positions[SEG_R_FOOT].y < height_threshold);
+	d.is_l_foot_grounded = (left_ankle_dist < dist_threshold) && (segment_positions[SEG_L_FOOT].y < height_threshold);
 
-		// 接地判定の閾値設定
-		float dist_threshold =  0.003f;  // 水平移動量の閾値
-		float height_threshold = segment_positions[SEG_R_FOOT].y + 0.08f; // 高さの閾値
+	// 現フレームの情報を格納する
+	param.push_back(d);
+}
 
-		// 両方の条件を満たしたときだけ「接地」とみなす
-		d.is_r_foot_grounded = (right_ankle_dist < dist_threshold) && (segment_positions[SEG_R_FOOT].y < height_threshold);
-		d.is_l_foot_grounded = (left_ankle_dist < dist_threshold) && (segment_positions[SEG_L_FOOT].y < height_threshold);
 
-		// 現フレームの情報を格納する
-		param.push_back(d);
+//
+// 末端部位の移動距離の測定結果から統計モデルの情報・動作区間を計算
+//
+static void FinishDistanceParameter(int num_frames, vector<DistanceParam>& param, ModelParam& m_param)
+{
+	if (param.empty() || (num_frames == 0))
+	{
+		m_param.moving_ratio = 0.0f;
+		return;
 	}
 
 	// 統計モデルの情報を更新
-	m_param.right_foot_dist = m_param.right_foot_dist / motion.num_frames;
-	m_param.left_foot_dist = m_param.left_foot_dist / motion.num_frames;
-	m_param.right_hand_dist = m_param.right_hand_dist / motion.num_frames;
-	m_param.left_hand_dist = m_param.left_hand_dist / motion.num_frames;
-	m_param.head_dist = m_param.head_dist / motion.num_frames;
+	m_param.right_foot_dist = m_param.right_foot_dist / num_frames;
+	m_param.left_foot_dist = m_param.left_foot_dist / num_frames;
+	m_param.right_hand_dist = m_param.right_hand_dist / num_frames;
+	m_param.left_hand_dist = m_param.left_hand_dist / num_frames;
+	m_param.head_dist = m_param.head_dist / num_frames;
 
 	// 平滑化(前後10フレーム)
-	for (int i = 10; i < param.size() - 10; i++)
+	for (int i = 10; i + 10 < (int)param.size(); i++)
 	{
 		for (int j = 1; j < 11; j++)
 		{
@@ -1869,6 +2178,80 @@ void CheckDistance(const Motion& motion, vector<DistanceParam> & param, ModelPar
 	}
 }
 
+//
+// 末端部位の移動距離を測定
+//
+void CheckDistance(const Motion& motion, vector<DistanceParam> & param, ModelParam& m_param, const char ** segment_names)
+{
+	// 骨格の追加情報を生成
+	// キャラクタの骨格情報
+	HumanBody human_body(motion.body);
+	for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
+	{
+		human_body.SetPrimarySegment((PrimarySegmentType)i, segment_names[i]);
+	}
+		
+	// 計算用変数
+	Point3f before_segment_positions[NUM_PRIMARY_SEGMENTS] ; // 前フレームの主要体節の位置
+	Point3f segment_positions[NUM_PRIMARY_SEGMENTS]; // 現フレームの主要体節の位置
+
+	// 全フレームの順運動学計算の結果を取得（他の解析処理と共有）
+	const MotionTransformTable* table = ForwardKinematicsBatch(&motion);
+
+	// 末端部位の位置を取得
+	// 動作終了フレームまで繰り返す
+	for (int i = 0; table && i < motion.num_frames; i++)
+	{
+		for (int j = 0; j < NUM_PRIMARY_SEGMENTS; j++)
+		{
+			int seg_no = human_body.GetPrimarySegment((PrimarySegmentType)j);
+			if (seg_no != -1)
+				table->GetSegmentPosition(i, seg_no, segment_positions[j]);
+		}
+
+		// 末端部位の移動距離を計算・記録
+		AddDistanceFrame(segment_positions, human_body, i == 0, before_segment_positions, param, m_param);
+	}
+
+	// 統計モデルの情報・動作区間を計算
+	FinishDistanceParameter(motion.num_frames, param, m_param);
+}
+
+
+//
+// 末端部位の移動距離を測定（BVHファイルから一定フレーム数ずつ読み込みながら測定）
+//
+void CheckDistance(BVHStream& stream, vector<DistanceParam> & param, ModelParam& m_param, const char ** segment_names)
+{
+	// 骨格の追加情報を生成
+	const Skeleton* body = stream.GetSkeleton();
+	if (!body || !stream.Rewind()) return;
+	HumanBody human_body(body);
+	for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
+	{
+		human_body.SetPrimarySegment((PrimarySegmentType)i, segment_names[i]);
+	}
+
+	// 計算用変数
+	Point3f before_segment_positions[NUM_PRIMARY_SEGMENTS] ; // 前フレームの主要体節の位置
+	Point3f segment_positions[NUM_PRIMARY_SEGMENTS]; // 現フレームの主要体節の位置
+	vector< Matrix4f > segment_frames;
+
+	// 読み込んだフレームごとに末端部位の移動距離を計算・記録
+	while (stream.ReadPostureWindow() > 0)
+	{
+		for (int i = 0; i < stream.GetWindowNumFrames(); i++)
+		{
+			bool is_first_frame = (stream.GetWindowBegin() + i == 0);
+			GetPrimarySegmentPositions(stream.GetPosture(i), human_body, segment_frames, segment_positions);
+			AddDistanceFrame(segment_positions, human_body, is_first_frame, before_segment_positions, param, m_param);
+		}
+	}
+
+	// 統計モデルの情報・動作区間を計算
+	FinishDistanceParameter(stream.GetWindowBegin() + stream.GetWindowNumFrames(), param, m_param);
+}
+
 
 //
 //  動作変形情報にもとづく動作変形処理（タイムワーピング）
@@ -1878,7 +2261,7 @@ void CheckDistance(const Motion& motion, vector<DistanceParam> & param, ModelPar
 // 動作変形（タイムワーピング）の情報の初期化・更新
 //
 void  InitTimeDeformationParameter(
-	vector<DistanceParam>& distance, TimeWarpingParam& param, Motion motion, float kire)
+	vector<DistanceParam>& distance, TimeWarpingParam& param, const Motion& motion, float kire)
 {
 	InitTimeDeformationParameter(0.0f, distance, param, motion, kire);
 }
@@ -1887,7 +2270,7 @@ void  InitTimeDeformationParameter(
 //  動作変形（タイムワーピング）の情報の初期化・更新
 //
 void  InitTimeDeformationParameter(
-	float now_time, vector<DistanceParam>& distance, TimeWarpingParam& param, Motion motion, float kire)
+	float now_time, vector<DistanceParam>& distance, TimeWarpingParam& param, const Motion& motion, float kire)
 {
 	// 現在時刻のフレームを計算
 	int now_frame = now_time / motion.interval;
@@ -2097,21 +2480,12 @@ void ApplyTimeWarping(float now_time, TimeWarpingParam& deform, const Motion& in
 	// もし現在時刻にタイムワーピングを適用するなら
 	if (now_time > deform.warp_in_duration_time && now_time < deform.warp_out_duration_time)
 	{
-		// タイムワーピング実行後の姿勢
-		Posture after_pose ;
-
 		// タイムワーピング実行後の時刻を取得
 		float warping_time = Warping(now_time, deform);
 
-		// タイムワーピング実行後の姿勢を生成
-		input_motion.GetPosture(warping_time, after_pose);
-
-		// 前のフレームの姿勢と姿勢補間
-		// 動作を滑らかにつなぐ努力
-		Posture before_frame_pose;
-		input_motion.GetPosture(before_frame_time, before_frame_pose);
-
-		PostureInterpolation(after_pose, before_frame_pose, 0.5, output_pose);
+		// タイムワーピング実行後の姿勢を前後のフレームの補間により生成
+		// （フレームの間の時刻でも滑らかに変化するため、前のフレームの姿勢との補間は不要）
+		input_motion.SampleInterpolated(warping_time, output_pose);
 
 		before_frame_time = warping_time;
 	}
@@ -2289,15 +2663,15 @@ void  InitDeformationParameter(
 	ee_pos = joint_position_frame_array[ ee_joint_no ];
 	ee_pos.add( ee_joint_translation );
 
-	// キー姿勢の指定部位の位置を移動
-	ApplyInverseKinematicsCCD( param.key_pose, base_joint_no, ee_joint_no, ee_pos );
+	// キー姿勢の指定部位の位置を移動（動作変形で使用する逆運動学計算の手法で計算）
+	GetDefaultIKSolver().Solve( param.key_pose, base_joint_no, ee_joint_no, ee_pos );
 }
 
 //
 //  動作変形（動作ワーピング）の情報の初期化・更新
 //
 void  InitDeformationParameter(
-	float now_time, vector<DistanceParam> distance, MotionWarpingParam& param, TimeWarpingParam time_param, Motion& motion, float furi[])
+	float now_time, const vector<DistanceParam>& distance, MotionWarpingParam& param, TimeWarpingParam time_param, Motion& motion, float furi[])
 {
 	// 現在時刻のフレーム
 	int now_frame = 0.00;
@@ -2492,30 +2866,17 @@ void  InitDeformationParameter(
 //　モーションワーピング後のキー姿勢を末端部位の位置変更により更新
 //
 
-void UpdateKeyposeByPosition(MotionWarpingParam& param, Motion& motion, float furi[])
+void UpdateKeyposeByPosition(MotionWarpingParam& param, Motion& motion, float furi[], IKWarmStartState* ik_state)
 {
-	// 順運動学計算
-	static vector< Matrix4f >  seg_frame_array;
-	vector< Point3f >  joint_position_frame_array;
-	ForwardKinematics(param.org_pose, seg_frame_array, joint_position_frame_array);
 	param.key_pose = param.org_pose;
 
-	// 1フレーム前の姿勢情報を取得(値は仮のもの)
-	Posture before_posture = param.org_pose;
-
-	// 取得するフレームの時間
+	// キー時刻と1フレーム前のフレーム番号を取得
+	// （各部位の位置は、動作データの順運動学計算の結果の表から取得して、毎回の順運動学計算を省略する）
 	float before_time = param.key_time - motion.interval;
 	if (before_time < 0.0f)
 		before_time = 0.0f;
-
-	// 1フレーム前の姿勢情報を取得
-	motion.GetPosture(before_time, before_posture);
-
-	// 数フレーム前の姿勢の順運動学計算
-	static vector< Matrix4f >  before_seg_frame_array;
-	vector< Point3f >  before_joint_position_frame_array;
-
-	ForwardKinematics(before_posture, before_seg_frame_array, before_joint_position_frame_array);
+	int key_frame_no = motion.GetFrameNo(param.key_time);
+	int before_frame_no = motion.GetFrameNo(before_time);
 
 	// 骨格の追加情報を生成
 	// キャラクタの骨格情報
@@ -2532,23 +2893,36 @@ void UpdateKeyposeByPosition(MotionWarpingParam& param, Motion& motion, float fu
 		human_body->SetPrimarySegment((PrimarySegmentType)i, primary_segment_names[i]);
 	}
 
-	// 末端部位ごとにモーションワーピング後のキー時刻の姿勢を変形する
+	// 末端部位ごとにモーションワーピング後のキー時刻の目標位置を計算する
+	// （腰はルート座標を直接更新し、それ以外の末端部位は逆運動学計算の目標とする）
+	IKTarget targets[NUM_PRIMARY_SEGMENTS];
+	int num_targets = 0;
 	for (int i = 0; i < NUM_PRIMARY_SEGMENTS; i++)
 	{
 		// 末端部位の位置を取得
 		Point3f segment_positions[NUM_PRIMARY_SEGMENTS];
 		Point3f before_segment_positions[NUM_PRIMARY_SEGMENTS];
-		Vector3f vec;
-		Vector3f before_vec;
 
 		int seg_no = human_body->GetPrimarySegment((PrimarySegmentType)i);
-		if (seg_no != -1)
+		if (seg_no == -1)
+			continue;
+
+		// 腰以外の末端部位は、部位の根元の関節の位置を使う
+		// （部位の位置は部位の中心の位置であり、逆運動学計算で動かす関節の位置とは異なるため）
+		int ee_joint_no = -1;
+		if (i == SEG_PELVIS)
 		{
-			seg_frame_array[seg_no].get(&vec);
-			segment_positions[i] = vec;
-			before_seg_frame_array[seg_no].get(&before_vec);
-			before_segment_positions[i] = before_vec;
+			motion.GetGlobalSegmentPosition(key_frame_no, seg_no, segment_positions[i]);
+			motion.GetGlobalSegmentPosition(before_frame_no, seg_no, before_segment_positions[i]);
+		}
+		else if (motion.body->segments[seg_no]->num_joints > 0)
+		{
+			ee_joint_no = motion.body->segments[seg_no]->joints[0]->index;
+			motion.GetGlobalJointPosition(key_frame_no, ee_joint_no, segment_positions[i]);
+			motion.GetGlobalJointPosition(before_frame_no, ee_joint_no, before_segment_positions[i]);
 		}
+		else
+			continue;
 
 		// 末端部位の位置から末端部位の移動の向きを計算
 		Vector3f move_vec;
@@ -2571,9 +2945,20 @@ void UpdateKeyposeByPosition(MotionWarpingParam& param, Motion& motion, float fu
 		}
 		else
 		{
-			ApplyInverseKinematicsCCD(param.key_pose, -1, seg_no, ee_pos);
+			// 末端部位の根元の関節の目標位置として追加
+			targets[num_targets].ee_joint_no = ee_joint_no;
+			targets[num_targets].position = ee_pos;
+			targets[num_targets].weight = 1.0f;
+			num_targets++;
 		}
 	}
+
+	// 全ての末端部位の目標位置を同時に満たすように姿勢を変形する
+	// （腰の移動後の姿勢から計算するため、末端部位ごとに順番に計算する場合と異なり、後の計算で先に合わせた部位がずれることはない）
+	// （ik_state が指定されていれば、前回の解から計算を開始する）
+	if (num_targets > 0)
+		GetMultiTargetIKSolver().SolveMultiTarget(param.key_pose, -1, targets, num_targets, ik_state);
+
 	delete human_body;
 }
 
@@ -2583,16 +2968,18 @@ void UpdateKeyposeByPosition(MotionWarpingParam& param, Motion& motion, float fu
 void UpdateKeyposeByVelocity(MotionWarpingParam& param, Motion& motion, float furi[])
 {
 	param.key_pose = param.org_pose;
-	// 1フレーム前の姿勢情報を取得(値は仮のもの)
-	Posture before_posture = param.org_pose;
 
 	// 取得するフレームの時間
 	float before_time = param.key_time - motion.interval;
 	if (before_time < 0.0f)
 		before_time = 0.0f;
 
-	// 1フレーム前の姿勢情報を取得
-	motion.GetPosture(before_time, before_posture);
+	// キー時刻と1フレーム前の姿勢情報を四元数表現で取得
+	// （動作データの変換済みの姿勢を使用して、回転行列から四元数への変換を毎回行わずに済む）
+	// （取得用の姿勢はスレッドごとに再利用する）
+	static thread_local QuaternionPosture org_qpose, before_qpose;
+	if (!motion.GetQuaternionFrame(motion.GetFrameNo(param.key_time), org_qpose) || !motion.GetQuaternionFrame(motion.GetFrameNo(before_time), before_qpose))
+		return;
 
 	// 骨格の追加情報を生成
 	// キャラクタの骨格情報
@@ -2693,8 +3080,8 @@ void UpdateKeyposeByVelocity(MotionWarpingParam& param, Motion& motion, float fu
 		if (joint_no == -1)
 			continue;
 
-		org_q.set(param.org_pose.joint_rotations[joint_no]);
-		before_q.set(before_posture.joint_rotations[joint_no]);
+		org_q = org_qpose.joint_rotations[joint_no];
+		before_q = before_qpose.joint_rotations[joint_no];
 
 		// diff = org * before_inv
 		// before_inv を計算 (共役クォータニオン)
@@ -2729,13 +3116,13 @@ void UpdateKeyposeByVelocity(MotionWarpingParam& param, Motion& motion, float fu
 	// 元の動作における移動ベクトル（速度）を計算
 	// (現在のフレームの位置 - 1フレーム前の位置
 	Vector3f root_velocity;
-	root_velocity = param.org_pose.root_pos - before_posture.root_pos;
+	root_velocity = param.org_pose.root_pos - before_qpose.root_pos;
 
 	// 移動ベクトルに倍率を掛ける（足を1.5倍振るなら、移動も1.5倍にする）
 	root_velocity = root_velocity * move_scale;
 
 	// 1フレーム前の位置に、補正した移動ベクトルを足して新しい位置にする
-	param.key_pose.root_pos = before_posture.root_pos + root_velocity;
+	param.key_pose.root_pos = before_qpose.root_pos + root_velocity;
 	delete human_body;
 }
 
@@ -2748,33 +3135,12 @@ void QuatToEulerYXZ(const Quat4f& q, double& y, double& x, double& z)
 	Matrix3f mat;
 	mat.set(q); // SimpleHuman.cpp 926行目付近の使用法に基づく
 
-	// 回転行列からオイラー角(YXZ順)を抽出
+	// 回転行列からオイラー角(YXZ順、度数法)を抽出
 	// R = Ry * Rx * Rz
 	//     | CyCz+SySxSz   CzSxSy-CySz   CxSy |   | m00 m01 m02 |
 	// R = | CxSz          CxCz          -Sx  | = | m10 m11 m12 |
 	//     | CySxSz-CzSy   CyCzSx+SySz   CxCy |   | m20 m21 m22 |
-
-	// m12 = -sin(x)
-	x = asin(-mat.m12);
-
-	// cos(x) が 0 でない場合 (ジンバルロックしていない場合)
-	if (cos(x) != 0) {
-		// m02 = cos(x)sin(y), m22 = cos(x)cos(y) -> tan(y) = m02/m22
-		y = atan2(mat.m02, mat.m22);
-
-		// m10 = cos(x)sin(z), m11 = cos(x)cos(z) -> tan(z) = m10/m11
-		z = atan2(mat.m10, mat.m11);
-	}
-	else {
-		// ジンバルロック時の処理 (x = +/- 90度)
-		y = atan2(-mat.m20, mat.m00);
-		z = 0;
-	}
-
-	// ラジアンから度数法へ変換
-	x = x * 180.0 / M_PI;
-	y = y * 180.0 / M_PI;
-	z = z * 180.0 / M_PI;
+	MatrixToEulerKernel< 1, 0, 2 >(mat, y, x, z);
 }
 
 
@@ -2783,7 +3149,7 @@ void QuatToEulerYXZ(const Quat4f& q, double& y, double& x, double& z)
 //  動作変形（動作ワーピング）の適用後の動作を生成
 //
 
-Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion, const vector<DistanceParam>& distance, HumanBody* my_human_body, Point3f& fixed_r_foot_pos, Point3f& fixed_l_foot_pos, bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, bool is_loop, float kire, float* furi)
+Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion, const vector<DistanceParam>& distance, HumanBody* my_human_body, Point3f& fixed_r_foot_pos, Point3f& fixed_l_foot_pos, bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, bool is_loop, float kire, float* furi, bool use_limb_ik)
 {
 	Motion *  deformed = NULL;
 
@@ -2796,6 +3162,9 @@ Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motio
 	float current_before_time = 0.0f;
 	Posture temp_posture(motion.body);
 
+	// 接地している足の逆運動学計算の前フレームの解（次のフレームの計算の初期値とする）
+	IKWarmStartState r_foot_ik_state, l_foot_ik_state;
+
 	// 各フレームの姿勢を変形
 	for (int i = 0; i < motion.num_frames; i++)
 	{
@@ -2810,7 +3179,7 @@ Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motio
 
 		// モーションワーピングを適用し、結果を deformed->frames[i] に格納
 		//ApplyMotionDeformation(t, current_motion_param, const_cast<Motion&>(motion), temp_posture, current_time_param, deformed->frames[i]);
-		ApplyMotionDeformation(t, current_motion_param, const_cast<Motion&>(motion), temp_posture, current_time_param, distance, furi, my_human_body, fixed_r_foot_pos, fixed_l_foot_pos, r_foot_lock, l_foot_lock, prev_output_root_pos, prev_input_root_pos, deformed->frames[i], is_loop, kire);
+		ApplyMotionDeformation(t, current_motion_param, const_cast<Motion&>(motion), temp_posture, current_time_param, distance, furi, my_human_body, fixed_r_foot_pos, fixed_l_foot_pos, r_foot_lock, l_foot_lock, prev_output_root_pos, prev_input_root_pos, deformed->frames[i], is_loop, kire, &r_foot_ik_state, &l_foot_ik_state, use_limb_ik);
 	}
 	// 動作変形後の動作を返す
 	return  deformed;
@@ -2978,7 +3347,8 @@ Quat4f Slerp(const Quat4f& q1, const Quat4f& q2, float t) {
 // [修正] 動作変形（動作ワーピング）の適用後の姿勢の計算
 float ApplyMotionDeformation(float time, const MotionWarpingParam& deform, Motion& motion, Posture& input_pose, TimeWarpingParam time_param, 
 	const std::vector<DistanceParam>& distanceinfo, float* furi, HumanBody* human_body, Point3f& r_fixed_pos, Point3f& l_fixed_pos,
-	bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, Posture& output_pose ,bool is_loop, float kire)
+	bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, Posture& output_pose ,bool is_loop, float kire,
+	IKWarmStartState* r_foot_ik_state, IKWarmStartState* l_foot_ik_state, bool use_limb_ik)
 {
 	// 【安全対策1】distanceinfoが空なら何もせず帰る（クラッシュ防止）
 	if (distanceinfo.empty()) {
@@ -3020,8 +3390,9 @@ float ApplyMotionDeformation(float time, const MotionWarpingParam& deform, Motio
 			warped_zero_time = Warping(0.0f, time_param); // 時刻0がどう変形されるか計算
 		}
 
-		Posture warped_zero_pose;
-		motion.GetPosture(warped_zero_time, warped_zero_pose);
+		PooledPosture  pooled_warped_zero_pose(motion.body);
+		Posture& warped_zero_pose = *pooled_warped_zero_pose;
+		motion.SampleInterpolated(warped_zero_time, warped_zero_pose);
 		prev_input_root_pos = warped_zero_pose.root_pos; // これを次の基準にする！
 
 		// ロック解除
@@ -3039,7 +3410,10 @@ float ApplyMotionDeformation(float time, const MotionWarpingParam& deform, Motio
 	}
 
 	// ワーピング後の姿勢を取得（これをベースにする）
-	motion.GetPosture(warping_time, input_pose);
+	// （四元数表現でも保持して、後の回転の適用で回転行列から四元数への変換を省略する）
+	static thread_local QuaternionPosture input_qpose;
+	motion.SampleInterpolated(warping_time, input_qpose);
+	input_qpose.GetPosture(input_pose);
 	Vector3f current_pure_root_pos = input_pose.root_pos;
 	output_pose = input_pose; // 初期値としてコピー
 
@@ -3098,7 +3472,8 @@ float ApplyMotionDeformation(float time, const MotionWarpingParam& deform, Motio
 		if (prev_seg_start != -1 && prev_seg_end != -1) {
 			// 前の動作あり
 			float prev_mid_time = (prev_seg_start + prev_seg_end) * 0.5f * motion.interval;
-			MotionWarpingParam prev_param;
+			// （変形情報の姿勢の領域を毎フレーム確保しないよう、変形情報はスレッドごとに再利用する）
+			static thread_local MotionWarpingParam prev_param;
 			TimeWarpingParam prev_time_param;
 
 			InitTimeDeformationParameter(prev_mid_time, const_cast<vector<DistanceParam>&>(distanceinfo), prev_time_param, motion, kire);
@@ -3154,7 +3529,8 @@ float ApplyMotionDeformation(float time, const MotionWarpingParam& deform, Motio
 		if (next_seg_start != -1 && next_seg_end != -1) {
 			// 次の動作あり
 			float next_mid_time = (next_seg_start + next_seg_end) * 0.5f * motion.interval;
-			MotionWarpingParam next_param;
+			// （変形情報の姿勢の領域を毎フレーム確保しないよう、変形情報はスレッドごとに再利用する）
+			static thread_local MotionWarpingParam next_param;
 			TimeWarpingParam next_time_param;
 			InitTimeDeformationParameter(next_mid_time, const_cast<vector<DistanceParam>&>(distanceinfo), next_time_param, motion, kire);
 			InitDeformationParameter(next_mid_time, distanceinfo, next_param, next_time_param, motion, furi);
@@ -3248,16 +3624,17 @@ if (p_from_pos && p_to_pos) {
 	if (ratio < 0.0f) ratio = 0.0f;
 	if (ratio > 1.0f) ratio = 1.0f;
 
-	if (motion.body && p_from_rots && p_to_rots) {
+	if (motion.body && p_from_rots && p_to_rots && motion.body->num_joints > 0) {
+		// Slerp (From -> To) を全関節まとめて計算
+		static thread_local std::vector<Quat4f> interpolated_rots;
+		interpolated_rots.resize(motion.body->num_joints);
+		InterpolateQuaternions(&p_from_rots->front(), &p_to_rots->front(), ratio, &interpolated_rots.front(), motion.body->num_joints);
+
 		for (int i = 0; i < motion.body->num_joints; i++)
 		{
-			// Slerp (From -> To)
-			Quat4f q_interpolated = Slerp((*p_from_rots)[i], (*p_to_rots)[i], ratio);
-
 			// 適用: NewRot = Offset * OrgRot
-			Quat4f q;
-			q.set(input_pose.joint_rotations[i]);
-			q_interpolated.mul(q);
+			Quat4f& q_interpolated = interpolated_rots[i];
+			q_interpolated.mul(input_qpose.joint_rotations[i]);
 			output_pose.joint_rotations[i].set(q_interpolated);
 		}
 	}
@@ -3268,6 +3645,15 @@ if (p_from_pos && p_to_pos) {
 int r_foot_joint = human_body->GetPrimaryJoint(JOI_R_ANKLE);
 int l_foot_joint = human_body->GetPrimaryJoint(JOI_L_ANKLE);
 
+// 股関節・膝・足首の情報があれば、解析的手法で足を固定（繰り返し計算を行わない）
+// （解析的手法を使用しない設定の場合は、前フレームの解から開始する繰り返し計算で足を固定）
+const LimbParameter* r_leg = use_limb_ik ? human_body->GetLimbParameter(LIMB_RIGHT_LEG) : NULL;
+const LimbParameter* l_leg = use_limb_ik ? human_body->GetLimbParameter(LIMB_LEFT_LEG) : NULL;
+if (r_leg && r_leg->end_joint != r_foot_joint)
+	r_leg = NULL;
+if (l_leg && l_leg->end_joint != l_foot_joint)
+	l_leg = NULL;
+
 if (distanceinfo[warping_frame].is_r_foot_grounded && r_foot_joint >= 0) {
 	if (!r_foot_lock) {
 		vector<Point3f> joi_pos;
@@ -3275,8 +3661,14 @@ if (distanceinfo[warping_frame].is_r_foot_grounded && r_foot_joint >= 0) {
 		ForwardKinematics(output_pose, seg_frames, joi_pos);
 		r_fixed_pos = joi_pos[r_foot_joint];
 		r_foot_lock = true;
+		// 固定位置が変わったので、前フレームの解は使用しない
+		if (r_foot_ik_state)
+			r_foot_ik_state->Reset();
 	}
-	ApplyInverseKinematicsCCD(output_pose, -1, r_foot_joint, r_fixed_pos);
+	if (r_leg)
+		ApplyInverseKinematicsLimb(output_pose, *r_leg, r_fixed_pos);
+	else
+		GetDefaultIKSolver().Solve(output_pose, -1, r_foot_joint, r_fixed_pos, r_foot_ik_state);
 
 	// ★ルート補正: IK後、もし足が固定位置からズレていたら、腰を動かして合わせる
 		// これで「滑り」を完全に防止します
@@ -3298,8 +3690,14 @@ if (distanceinfo[warping_frame].is_l_foot_grounded && l_foot_joint >= 0) {
 		ForwardKinematics(output_pose, seg_frames, joi_pos);
 		l_fixed_pos = joi_pos[l_foot_joint];
 		l_foot_lock = true;
+		// 固定位置が変わったので、前フレームの解は使用しない
+		if (l_foot_ik_state)
+			l_foot_ik_state->Reset();
 	}
-	ApplyInverseKinematicsCCD(output_pose, -1, l_foot_joint, l_fixed_pos);
+	if (l_leg)
+		ApplyInverseKinematicsLimb(output_pose, *l_leg, l_fixed_pos);
+	else
+		GetDefaultIKSolver().Solve(output_pose, -1, l_foot_joint, l_fixed_pos, l_foot_ik_state);
 
 	// ★ルート補正
     //vector<Point3f> joi_pos_chk;
@@ -3334,6 +3732,14 @@ void GetPostureOffset(const Posture& org, const Posture& deformed, Motion& motio
 	// 各関節の回転差分
 	for (int i = 0; i < motion.body->num_joints; i++)
 	{
+		// 変形していない関節は、四元数に変換せずに単位クォータニオン（回転ゼロ）とする
+		// （キー姿勢の変形は一部の主要関節のみのため、大半の関節の変換を省略できる）
+		if (org.joint_rotations[i] == deformed.joint_rotations[i])
+		{
+			diff_rots[i].set(0.0f, 0.0f, 0.0f, 1.0f);
+			continue;
+		}
+
 		Quat4f q_org ;
 		q_org.set(org.joint_rotations[i]);
 		Quat4f q_def;
@@ -3401,6 +3807,54 @@ void  PostureWarping( const Posture & org, const Posture & src, const Posture &
 }
 
 
+//
+//  動作ワーピングの姿勢変形（四元数表現の姿勢を入力として、回転行列から四元数への変換を省略）
+//
+void  PostureWarping( const QuaternionPosture & org, const QuaternionPosture & src, const QuaternionPosture & dest, float ratio, Posture & p )
+{
+	// ３つの姿勢の骨格モデルが異なる場合は終了
+	if ( ( org.body != src.body ) || ( src.body != dest.body ) || ( dest.body != p.body ) )
+		return;
+
+	// 骨格モデルを取得
+	const Skeleton *  body = org.body;
+
+	//計算用変数
+	Quat4f q1, q;
+	Vector3f v;
+
+	// 各関節の回転を計算
+	for ( int i = 0; i < body->num_joints; i++ )
+	{
+		// q1 = dest * src^-1 * org
+		q1.mulInverse(dest.joint_rotations[i], src.joint_rotations[i]);
+		q1.mul(org.joint_rotations[i]);
+
+		//orgとq1の間を重みratioで補間してqに代入
+		const Quat4f & q0 = org.joint_rotations[i];
+		if (q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w < 0)
+			q1.negate(q1);
+		q.interpolate(q0, q1, ratio);
+		p.joint_rotations[i].set(q);
+	}
+
+	// ルートの向きを計算
+	q1.mulInverse(dest.root_ori, src.root_ori);
+	q1.mul(org.root_ori);
+
+	//orgとq1の間を重みratioで補間してqに代入
+	if (org.root_ori.x * q1.x + org.root_ori.y * q1.y + org.root_ori.z * q1.z + org.root_ori.w * q1.w < 0)
+		q1.negate(q1);
+	q.interpolate(org.root_ori, q1, ratio);
+	p.root_ori.set(q);
+
+	// ルートの位置を計算
+	v.sub(dest.root_pos, src.root_pos);
+	v.scale(ratio);
+	p.root_pos.add(v,org.root_pos);
+}
+
+
 // ---------------------------------------------------------
 // 今回の「お題（ターゲット）」をランダムに設定する関数
 // ---------------------------------------------------------
@@ -17,6 +17,8 @@
 #include "SimpleHumanGLUT.h"
 #include "InverseKinematicsCCDApp.h"
 #include "HumanBody.h"
+#include "MotionLibrary.h"
+#include "AsyncMotionLoader.h"
 #include <vector>
 
 #include <fstream> // 追加
@@ -130,6 +132,19 @@ struct  ModelParam
 };
 
 
+//
+//　入力動作の解析結果（バックグラウンドで計算）
+//
+struct MotionAnalysis
+{
+	// 末端部分の移動距離の合計の情報
+	vector<DistanceParam> distance;
+
+	// 統計モデル情報（移動距離・ねじれ・学習した係数）
+	ModelParam model_param;
+};
+
+
 //
 //  動作変形アプリケーションクラス
 //
@@ -141,6 +156,9 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 	// 動作変形を適用する動作データ
 	Motion *           motion;
 
+	// 動作データの参照（動作ライブラリから取得した動作データを保持する）
+	MotionHandle       motion_handle;
+
 	// 末端部分の移動距離の合計の情報
 	vector<DistanceParam> distanceinfo;
 
@@ -174,6 +192,9 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 	// ２つ目の動作データ
 	Motion*		second_motion;
 
+	// ２つ目の動作データの参照
+	MotionHandle	second_motion_handle;
+
 	// ２つ目の動作データの姿勢
 	Posture*	second_curr_posture;
 
@@ -189,6 +210,10 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 	Point3f		fixed_r_foot_pos;
 	Point3f		fixed_l_foot_pos;
 
+	// 接地している足の逆運動学計算の前フレームの解（次のフレームの計算の初期値とする）
+	IKWarmStartState	r_foot_ik_state;
+	IKWarmStartState	l_foot_ik_state;
+
 	// 前のフレームの腰の位置
 	Point3f prev_output_root_pos;
 	Point3f prev_input_root_pos;
@@ -225,6 +250,10 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 	// 変形前のキャラクタの姿勢
 	Posture *          org_posture;
 
+	// 変形前の姿勢に対応する動作データのフレーム番号（動作データのフレームでなければ -1）
+	// （動作データのフレームであれば、計算済みの順運動学計算の結果を使用して描画する）
+	int                org_frame_no;
+
 	// 変形後のキャラクタの姿勢
 	Posture *          deformed_posture;
 
@@ -266,6 +295,33 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 	// 部位名とIDの変換用ヘルパー
 	HumanBody* my_human_body;
 
+  protected:
+	// 動作データの非同期読み込みのための変数
+
+	// 動作データの読み込み・解析を行うバックグラウンド処理
+	// （読み込み中の結果より先に削除されないよう、結果よりも前に宣言する）
+	AsyncMotionLoader  loader;
+
+	// 読み込み中の入力動作・２つ目の動作・入力動作の解析結果
+	shared_future< MotionHandle >  loading_motion;
+	shared_future< MotionHandle >  loading_second_motion;
+	shared_future< MotionAnalysis >  loading_analysis;
+
+	// 読み込み中かどうかを表すフラグ
+	bool  is_loading;
+
+	// 読み込み・解析中に発生したエラーの説明（エラーがなければ空）
+	string  loading_error;
+
+	// 前回のアニメーション処理で姿勢の領域を確保した回数（定常状態では 0 となることの確認用）
+	int  num_frame_posture_allocations;
+
+	// 計算処理の確認用の情報（姿勢の領域の確保回数など）を表示するかどうかの設定
+	bool  draw_debug_info;
+
+	// 接地している足の固定に解析的手法を使用するかどうかの設定（false の場合は繰り返し計算による逆運動学計算を使用）
+	bool  use_limb_ik;
+
   public:
 	// コンストラクタ
 	MotionDeformationApp();
@@ -318,6 +374,25 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 	// ２つ目の動作ファイルの読み込み
 	void  LoadSecondBVH(const char* file_name);
 
+	// 動作変形に使用する動作・２つ目の動作の設定、骨格・姿勢の初期化
+	void  SetMotion( const MotionHandle & new_motion );
+	void  SetSecondMotion( const MotionHandle & new_motion );
+
+	// 入力動作・２つ目の動作の読み込みと入力動作の解析をバックグラウンドで開始
+	void  StartLoading( const char * file_name, const char * second_file_name );
+
+	// バックグラウンドでの読み込みの完了を確認（完了していれば動作データ・解析結果に切り替え）
+	void  UpdateLoading();
+
+	// 読み込んだ動作データ・解析結果にもとづく動作変形情報などの初期化
+	void  FinishLoading();
+
+	// 読み込みの進捗を描画
+	void  DrawLoadingProgress();
+
+	// 接地している足の逆運動学計算の繰り返し数の分布を描画（確認用）
+	void  DrawFootIKInformation( int line_no );
+
 	// 変形後の動作をBVH動作ファイルとして保存
 	void  SaveDeformedMotionAsBVH( const char * file_name );
 
@@ -341,6 +416,9 @@ void GetAdaptiveJointNames(const Skeleton* skeleton, const char** names);
 
 float CalcChestVal(const Motion* motion);
 
+// 肩を利用したねじれの計算（BVHファイルから一定フレーム数ずつ読み込みながら計算）
+float CalcChestVal(class BVHStream& stream);
+
 // Windowsの標準機能を使って、入力ダイアログを表示する
 float ShowPopupInput(const char* title, const char* prompt, float current_val);
 
@@ -355,15 +433,18 @@ void InitDistanceParameter(vector<DistanceParam> & param);
 // 末端部位の移動距離を測定
 void CheckDistance(const Motion& motion, vector<DistanceParam> & param, ModelParam& m_param, const char ** segment_names = NULL);
 
+// 末端部位の移動距離を測定（BVHファイルから一定フレーム数ずつ読み込みながら測定）
+void CheckDistance(class BVHStream& stream, vector<DistanceParam> & param, ModelParam& m_param, const char ** segment_names = NULL);
+
 //
 //  動作変形情報にもとづく動作変形処理（タイムワーピング）
 //
 
 // 動作変形（タイムワーピング）の情報の初期化・更新
-void  InitTimeDeformationParameter(vector<DistanceParam>& distance, TimeWarpingParam& param, Motion motion, float kire);
+void  InitTimeDeformationParameter(vector<DistanceParam>& distance, TimeWarpingParam& param, const Motion& motion, float kire);
 
 // 動作変形（タイムワーピング）の情報の初期化・更新
-void  InitTimeDeformationParameter(float now_time, vector<DistanceParam>& distance, TimeWarpingParam& param, Motion motion, float kire);
+void  InitTimeDeformationParameter(float now_time, vector<DistanceParam>& distance, TimeWarpingParam& param, const Motion& motion, float kire);
 
 // 動作変形（タイムワーピング）の情報の更新
 void ReTimeDeformationParameter(float warp_in_duration, float warp_out_duration, TimeWarpingParam& param);
@@ -392,10 +473,12 @@ void  InitDeformationParameter( const Motion & motion, float key_time, float ble
 
 // 動作変形（動作ワーピング）の情報の初期化・更新
 void  InitDeformationParameter(
-	float now_time, vector<DistanceParam> distance, MotionWarpingParam& param, TimeWarpingParam time_param, Motion& motion, float furi[]);
+	float now_time, const vector<DistanceParam>& distance, MotionWarpingParam& param, TimeWarpingParam time_param, Motion& motion, float furi[]);
 
 // モーションワーピング後のキー姿勢を末端部位の位置変更により更新
-void UpdateKeyposeByPosition(MotionWarpingParam& param, Motion& motion, float furi[]);
+// （腰以外の全ての末端部位の目標位置を、逆運動学計算により同時に満たす）
+// （ik_state を指定すると、前回の更新時の逆運動学計算の解から計算を開始する）
+void UpdateKeyposeByPosition(MotionWarpingParam& param, Motion& motion, float furi[], IKWarmStartState* ik_state = NULL);
 
 // モーションワーピング後のキー姿勢を関節角度の回転速度の変更により更新
 void UpdateKeyposeByVelocity(MotionWarpingParam& param, Motion& motion, float furi[]);
@@ -404,17 +487,20 @@ void UpdateKeyposeByVelocity(MotionWarpingParam& param, Motion& motion, float fu
 void QuatToEulerYXZ(const Quat4f& q, double& y, double& x, double& z);
 
 // 動作変形（動作ワーピング）の適用後の動作を生成
-Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion , const vector<DistanceParam>& distance, HumanBody* my_human_body, Point3f& fixed_r_foot_pos, Point3f& fixed_l_foot_pos, bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, bool is_loop, float kire, float* furi);
+Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion , const vector<DistanceParam>& distance, HumanBody* my_human_body, Point3f& fixed_r_foot_pos, Point3f& fixed_l_foot_pos, bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, bool is_loop, float kire, float* furi, bool use_limb_ik = true);
 
 // 動作変形（動作ワーピング）の適用後の姿勢の計算
 float  ApplyMotionDeformation( float time, const MotionWarpingParam & deform, Motion& motion, Posture & input_pose, TimeWarpingParam time_param, Posture & output_pose );
 
 // 動作ワーピングの姿勢変形（２つの姿勢の差分（dest - src）に重み ratio をかけたものを元の姿勢 org に加える ）
 void  PostureWarping( const Posture & org, const Posture & src, const Posture & dest, float ratio, Posture & p );
+void  PostureWarping( const class QuaternionPosture & org, const class QuaternionPosture & src, const class QuaternionPosture & dest, float ratio, Posture & p );
 
+// （use_limb_ik が false の場合は、接地している足を既定の手法の繰り返し計算で固定し、足ごとの state に前回の解を保持する）
 float ApplyMotionDeformation(float time, const MotionWarpingParam& deform, Motion& motion, Posture& input_pose, TimeWarpingParam time_param,
 	const std::vector<DistanceParam>& distanceinfo, float* furi, HumanBody* human_body, Point3f& r_fixed_pos, Point3f& l_fixed_pos, 
-	bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, Posture& output_pose, bool is_loop, float kire);
+	bool& r_foot_lock, bool& l_foot_lock, Point3f& prev_output_root_pos, Point3f& prev_input_root_pos, Posture& output_pose, bool is_loop, float kire,
+	IKWarmStartState* r_foot_ik_state = NULL, IKWarmStartState* l_foot_ik_state = NULL, bool use_limb_ik = true);
 
 void GetPostureOffset(const Posture& org, const Posture& deformed, Motion& motion, std::vector<Quat4f>& diff_rots, Vector3f& diff_pos);
 
@@ -38,18 +38,7 @@ MotionDeformationEditApp::MotionDeformationEditApp() : MotionDeformationApp()
 //
 MotionDeformationEditApp::~MotionDeformationEditApp()
 {
-	if ( motion )
-		delete  motion;
-	if ( curr_posture && curr_posture->body )
-		delete  curr_posture->body;
-	if ( curr_posture )
-		delete  curr_posture;
-	if ( org_posture )
-		delete  org_posture;
-	if ( deformed_posture )
-		delete  deformed_posture;
-	if ( timeline )
-		delete  timeline;
+	// 動作・姿勢・タイムラインは基底クラス（MotionDeformationApp）のデストラクタで削除する
 }
 
 
@@ -127,8 +116,16 @@ void  MotionDeformationEditApp::Display()
 				glTranslatef( -1.0f, 0.0f, 0.0f );
 
 			glColor3f( 1.0f, 1.0f, 1.0f );
-			DrawPosture( *org_posture );
-			DrawPostureShadow( *org_posture, shadow_dir, shadow_color );
+			if ( org_frame_no >= 0 )
+			{
+				DrawMotionFrame( *motion, org_frame_no );
+				DrawMotionFrameShadow( *motion, org_frame_no, shadow_dir, shadow_color );
+			}
+			else
+			{
+				DrawPosture( *org_posture );
+				DrawPostureShadow( *org_posture, shadow_dir, shadow_color );
+			}
 
 			glPopMatrix();
 		}
@@ -204,7 +201,7 @@ void  MotionDeformationEditApp::Display()
 	}
 
 	// タイムラインを描画
-	if ( timeline )
+	if ( timeline && !is_loading )
 	{
 		timeline->SetLineTime( 1, animation_time );
 		timeline->DrawTimeline();
@@ -213,7 +210,9 @@ void  MotionDeformationEditApp::Display()
 	// 現在のモード、時間・フレーム番号を表示
 	DrawTextInformation( 0, "Motion Deformation" );
 	char  message[64];
-	if ( on_animation_mode )
+	if ( is_loading )
+		DrawLoadingProgress();
+	else if ( on_animation_mode )
 		DrawTextInformation( 1, "Animation mode" );
 	else
 		DrawTextInformation( 1, "Kyepose edit mode" );
@@ -247,6 +246,14 @@ void  MotionDeformationEditApp::Display()
 		DrawTextInformation(4, param_msg);
 	}
 
+	// 前回のフレームで姿勢の領域を確保した回数を表示（確認用の情報の表示中のみ）
+	if ( draw_debug_info && on_animation_mode && motion && !is_loading )
+	{
+		sprintf( message, "posture allocations: %d", num_frame_posture_allocations );
+		DrawTextInformation( 5, message );
+		DrawFootIKInformation( 6 );
+	}
+
 	//DrawGraph();
 }
 
@@ -344,6 +351,10 @@ void  MotionDeformationEditApp::MouseClick( int button, int state, int mx, int m
 	else
 		GLUTBaseApp::MouseClick( button, state, mx, my );
 
+	// 動作データの読み込み中は操作を受け付けない
+	if ( is_loading )
+		return;
+
 	// マウス座標に対応するタイムラインのトラック番号・時刻を取得
 	int  selected_track_no = timeline->GetTrackByPosition( mx, my );
 	float  selected_time = timeline->GetTimeByPosition( mx );
@@ -386,6 +397,10 @@ void  MotionDeformationEditApp::MouseDrag( int mx, int my )
 	else
 		GLUTBaseApp::MouseDrag( mx, my );
 
+	// 動作データの読み込み中は操作を受け付けない
+	if ( is_loading )
+		return;
+
 	// マウス座標に対応するタイムラインのトラック番号・時刻を取得
 	int  selected_track_no = timeline->GetTrackByPosition( mx, my );
 	float  selected_time = timeline->GetTimeByPosition( mx );
@@ -408,6 +423,24 @@ void  MotionDeformationEditApp::Keyboard( unsigned char key, int mx, int my )
 {
 	GLUTBaseApp::Keyboard( key, mx, my );
 
+	// 動作データの読み込み中は操作を受け付けない
+	if ( is_loading )
+		return;
+
+	// i キーで確認用の情報の表示の有無を変更
+	if ( key == 'i' )
+		draw_debug_info = !draw_debug_info;
+
+	// f キーで接地している足の固定の手法（解析的手法・繰り返し計算）を変更
+	if ( key == 'f' )
+	{
+		use_limb_ik = !use_limb_ik;
+		r_foot_ik_state.Reset();
+		l_foot_ik_state.Reset();
+		r_foot_ik_state.ClearHistogram();
+		l_foot_ik_state.ClearHistogram();
+	}
+
 	// 数字キーで入力動作・動作変形情報を変更
 	//if ( ( key >= '1' ) && ( key <= '9' ) )
 	//{
@@ -717,6 +750,9 @@ void  MotionDeformationEditApp::Keyboard( unsigned char key, int mx, int my )
 //
 void  MotionDeformationEditApp::Animation( float delta )
 {
+	// バックグラウンドでの読み込みが完了していれば、読み込んだ動作データに切り替え
+	UpdateLoading();
+
 	// アニメーション再生中でなければ終了
 	if ( !on_animation_mode )
 		return;
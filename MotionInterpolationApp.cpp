@@ -55,18 +55,13 @@ MotionInterpolationApp::~MotionInterpolationApp()
 {
 	for ( int i=0; i<2; i++ )
 	{
+		// 動作データ・骨格モデルは動作ライブラリが管理するため、動作情報のみを削除
 		if ( motions[ i ] )
-		{
-			if ( motions[ i ]->motion )
-				delete  motions[ i ]->motion;
 			delete  motions[ i ];
-		}
 		if ( motion_posture[ i ])
 			delete  motion_posture[ i ];
 	}
 
-	if ( curr_posture && curr_posture->body )
-		delete  curr_posture->body;
 	if ( curr_posture )
 		delete  curr_posture;
 }
@@ -88,6 +83,8 @@ void  MotionInterpolationApp::Initialize()
 		body = LoadSampleMotions( motion_list );
 		motions[ 0 ] = motion_list[ 0 ];
 		motions[ 1 ] = motion_list[ 1 ];
+		for ( int i = 2; i < (int) motion_list.size(); i++ )
+			delete  motion_list[ i ];
 	}
 
 	// 姿勢の初期化
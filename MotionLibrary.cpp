@@ -0,0 +1,284 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作ライブラリ（動作データ・骨格モデルの共有管理）
+**/
+
+
+#include "MotionLibrary.h"
+#include "BVH.h"
+#include "MappedFile.h"
+#include "LazyMotion.h"
+#include "CompressedMotion.h"
+
+#include <string.h>
+#include <filesystem>
+
+
+
+//
+//  骨格モデルの比較の補助関数
+//
+
+// 値を文字列に追加
+template< class T >
+static inline void  AppendSkeletonKey( string & key, const T & value )
+{
+	key.append( (const char *) &value, sizeof( T ) );
+}
+
+// 名前を文字列に追加
+static inline void  AppendSkeletonKey( string & key, const string & name )
+{
+	AppendSkeletonKey( key, (int) name.size() );
+	key.append( name );
+}
+
+// 骨格モデルの階層構造・名前・接続位置を表す文字列を生成（同一の骨格モデルであれば同一の文字列となる）
+static string  GetSkeletonKey( const Skeleton * body )
+{
+	string  key;
+	AppendSkeletonKey( key, body->num_segments );
+	AppendSkeletonKey( key, body->num_joints );
+
+	for ( int i = 0; i < body->num_segments; i++ )
+	{
+		const Segment *  segment = body->segments[ i ];
+		AppendSkeletonKey( key, segment->name );
+		AppendSkeletonKey( key, segment->num_joints );
+		for ( int j = 0; j < segment->num_joints; j++ )
+		{
+			AppendSkeletonKey( key, segment->joints[ j ]->index );
+			AppendSkeletonKey( key, segment->joint_positions[ j ].x );
+			AppendSkeletonKey( key, segment->joint_positions[ j ].y );
+			AppendSkeletonKey( key, segment->joint_positions[ j ].z );
+		}
+		AppendSkeletonKey( key, segment->has_site );
+		if ( segment->has_site )
+		{
+			AppendSkeletonKey( key, segment->site_position.x );
+			AppendSkeletonKey( key, segment->site_position.y );
+			AppendSkeletonKey( key, segment->site_position.z );
+		}
+	}
+
+	for ( int i = 0; i < body->num_joints; i++ )
+	{
+		const Joint *  joint = body->joints[ i ];
+		AppendSkeletonKey( key, joint->name );
+		AppendSkeletonKey( key, joint->segments[ 0 ] ? joint->segments[ 0 ]->index : -1 );
+		AppendSkeletonKey( key, joint->segments[ 1 ] ? joint->segments[ 1 ]->index : -1 );
+	}
+
+	return  key;
+}
+
+
+
+//
+//  ライブラリを取得
+//
+MotionLibrary &  MotionLibrary::GetInstance()
+{
+	static MotionLibrary  library;
+	return  library;
+}
+
+
+// コンストラクタ
+MotionLibrary::MotionLibrary()
+{
+}
+
+
+// デストラクタ
+MotionLibrary::~MotionLibrary()
+{
+	motions.clear();
+	hierarchies.clear();
+
+	unordered_map< string, Skeleton * >::iterator  i;
+	for ( i = skeletons.begin(); i != skeletons.end(); i++ )
+		delete  i->second;
+	skeletons.clear();
+}
+
+
+//
+//  BVHファイルから動作データを取得
+//
+MotionHandle  MotionLibrary::LoadMotion( const char * bvh_file_name, MotionStorageEnum storage )
+{
+	// 保持方法が異なる動作データは、別の動作データとして管理する
+	string  key = GetLibraryKey( bvh_file_name );
+	if ( storage == MOTION_STORAGE_LAZY )
+		key.append( "\n(lazy)" );
+	else if ( storage == MOTION_STORAGE_COMPRESSED )
+		key.append( "\n(compressed)" );
+
+	// 読み込み済みの動作データがあれば返す
+	{
+		lock_guard< mutex >  lock( library_mutex );
+		map< string, MotionHandle >::iterator  i = motions.find( key );
+		if ( i != motions.end() )
+			return  i->second;
+	}
+
+	// BVHファイルを読み込んで動作データ（＋骨格モデル）を生成（読み込み中は他のファイルの読み込みを妨げないよう排他制御の外で行う）
+	Motion *  new_motion = NULL;
+	if ( storage == MOTION_STORAGE_LAZY )
+		new_motion = LoadAndCoustructLazyBVHMotion( bvh_file_name );
+	else if ( storage == MOTION_STORAGE_COMPRESSED )
+		new_motion = LoadAndCoustructCompressedBVHMotion( bvh_file_name );
+	else
+		new_motion = LoadAndCoustructBVHMotion( bvh_file_name );
+	if ( !new_motion )
+		return  MotionHandle();
+
+	// 骨格モデルを登録して、同一の骨格モデルが登録済みであればそれを参照するように変更
+	// （姿勢を必要に応じて生成する場合は、生成済みの姿勢を破棄して、以降は登録済みの骨格モデルで生成する）
+	const Skeleton *  body = RegisterSkeleton( (Skeleton *) new_motion->body );
+	new_motion->body = body;
+	if ( new_motion->frame_cache )
+		new_motion->frame_cache->Clear();
+	if ( new_motion->frames )
+	{
+		for ( int i = 0; i < new_motion->num_frames; i++ )
+			new_motion->frames[ i ].body = body;
+	}
+
+	// 動作データを登録（他のスレッドが同じファイルを先に読み込んでいた場合は、そちらを使用する）
+	lock_guard< mutex >  lock( library_mutex );
+	map< string, MotionHandle >::iterator  i = motions.find( key );
+	if ( i != motions.end() )
+	{
+		delete  new_motion;
+		return  i->second;
+	}
+	MotionHandle  handle( new_motion );
+	motions[ key ] = handle;
+	return  handle;
+}
+
+
+//
+//  BVHファイルの階層構造を取得
+//
+shared_ptr< const BVH >  MotionLibrary::LoadHierarchy( const char * bvh_file_name )
+{
+	string  key = GetLibraryKey( bvh_file_name );
+
+	// 読み込み済みの階層構造があれば返す
+	{
+		lock_guard< mutex >  lock( library_mutex );
+		map< string, shared_ptr< const BVH > >::iterator  i = hierarchies.find( key );
+		if ( i != hierarchies.end() )
+			return  i->second;
+	}
+
+	// BVHファイルの階層構造のみを読み込み（モーションデータは読み込まない）
+	MappedFile  file;
+	if ( !file.Open( bvh_file_name ) )
+		return  shared_ptr< const BVH >();
+	shared_ptr< BVH >  bvh( new BVH() );
+	int  num_frames;
+	size_t  header_size;
+	if ( !bvh->LoadHeader( bvh_file_name, file.GetData(), file.GetSize(), num_frames, header_size ) )
+		return  shared_ptr< const BVH >();
+
+	// 階層構造を登録
+	lock_guard< mutex >  lock( library_mutex );
+	map< string, shared_ptr< const BVH > >::iterator  i = hierarchies.find( key );
+	if ( i != hierarchies.end() )
+		return  i->second;
+	hierarchies[ key ] = bvh;
+	return  bvh;
+}
+
+
+//
+//  骨格モデルを登録
+//
+const Skeleton *  MotionLibrary::RegisterSkeleton( Skeleton * body )
+{
+	if ( !body )
+		return  NULL;
+
+	string  key = GetSkeletonKey( body );
+
+	lock_guard< mutex >  lock( library_mutex );
+
+	// 同一の骨格モデルが登録済みであれば、入力された骨格モデルを削除して、登録済みの骨格モデルを返す
+	unordered_map< string, Skeleton * >::iterator  i = skeletons.find( key );
+	if ( i != skeletons.end() )
+	{
+		if ( i->second != body )
+			delete  body;
+		return  i->second;
+	}
+
+	// 新しい骨格モデルを登録
+	skeletons[ key ] = body;
+	return  body;
+}
+
+
+//
+//  利用されていない動作データ・階層構造を解放
+//  （骨格モデルは姿勢などから参照されている可能性があるため解放しない）
+//
+void  MotionLibrary::ReleaseUnused()
+{
+	lock_guard< mutex >  lock( library_mutex );
+
+	map< string, MotionHandle >::iterator  m = motions.begin();
+	while ( m != motions.end() )
+	{
+		if ( m->second.use_count() == 1 )
+			m = motions.erase( m );
+		else
+			m ++;
+	}
+
+	map< string, shared_ptr< const BVH > >::iterator  h = hierarchies.begin();
+	while ( h != hierarchies.end() )
+	{
+		if ( h->second.use_count() == 1 )
+			h = hierarchies.erase( h );
+		else
+			h ++;
+	}
+}
+
+
+//
+//  読み込み済みの動作データ数・骨格モデル数を取得
+//
+int  MotionLibrary::GetNumMotions()
+{
+	lock_guard< mutex >  lock( library_mutex );
+	return  motions.size();
+}
+
+int  MotionLibrary::GetNumSkeletons()
+{
+	lock_guard< mutex >  lock( library_mutex );
+	return  skeletons.size();
+}
+
+
+//
+//  ファイル名を正規化（絶対パスに変換し、"." や ".." を取り除く）
+//
+string  MotionLibrary::GetLibraryKey( const char * file_name )
+{
+	error_code  ec;
+	filesystem::path  path = filesystem::absolute( filesystem::path( file_name ), ec );
+	if ( ec )
+		return  file_name;
+	return  path.lexically_normal().string();
+}
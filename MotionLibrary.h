@@ -0,0 +1,97 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作ライブラリ（動作データ・骨格モデルの共有管理）
+**/
+
+#ifndef  _MOTION_LIBRARY_H_
+#define  _MOTION_LIBRARY_H_
+
+
+#include <memory>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+
+#include "SimpleHuman.h"
+
+class  BVH;
+
+
+// 動作データの参照（参照カウント付き、全ての参照が解放されたら動作データを削除する）
+typedef  shared_ptr< Motion >  MotionHandle;
+
+// 動作データの保持方法
+enum  MotionStorageEnum
+{
+	MOTION_STORAGE_DECODED,     // 全フレームの姿勢を保持
+	MOTION_STORAGE_LAZY,        // チャンネルの値を保持し、姿勢は必要に応じて生成
+	MOTION_STORAGE_COMPRESSED   // 圧縮したデータを保持し、姿勢は必要に応じて生成
+};
+
+
+//
+//  動作ライブラリ（プロセス全体で１つ）
+//  （各BVHファイルを一度だけ読み込み、同じファイルの動作データは共有する）
+//  （階層構造が同一の骨格モデルは１つにまとめ、全ての動作データ・姿勢で同じ骨格モデルを参照する）
+//  （骨格モデルはライブラリが所有するため、利用側で削除してはならない）
+//  （共有される動作データは変更しないこと。変更する場合はコピーを作成して使用する）
+//
+class  MotionLibrary
+{
+  protected:
+	// 排他制御（複数のスレッドからの読み込みに対応）
+	mutex  library_mutex;
+
+	// 読み込み済みの動作データ [ファイル名]
+	map< string, MotionHandle >  motions;
+
+	// 読み込み済みのBVHファイルの階層構造（モーションデータは持たない） [ファイル名]
+	map< string, shared_ptr< const BVH > >  hierarchies;
+
+	// 登録済みの骨格モデル [骨格モデルの階層構造・接続位置を表す文字列]
+	unordered_map< string, Skeleton * >  skeletons;
+
+  public:
+	// ライブラリを取得
+	static MotionLibrary &  GetInstance();
+
+	// デストラクタ
+	~MotionLibrary();
+
+	// BVHファイルから動作データを取得（未読み込みの場合は読み込む、失敗した場合は空の参照を返す）
+	// （MOTION_STORAGE_DECODED 以外の場合は、姿勢を必要に応じて生成する動作データとして読み込む。frames は使用できない）
+	MotionHandle  LoadMotion( const char * bvh_file_name, MotionStorageEnum storage = MOTION_STORAGE_DECODED );
+
+	// BVHファイルの階層構造を取得（未読み込みの場合は読み込む、失敗した場合は空の参照を返す）
+	shared_ptr< const BVH >  LoadHierarchy( const char * bvh_file_name );
+
+	// 骨格モデルを登録（同一の骨格モデルが登録済みであればそれを返し、入力された骨格モデルは削除する）
+	const Skeleton *  RegisterSkeleton( Skeleton * body );
+
+	// 利用されていない（ライブラリ以外に参照がない）動作データ・階層構造を解放
+	void  ReleaseUnused();
+
+	// 読み込み済みの動作データ数・骨格モデル数を取得
+	int  GetNumMotions();
+	int  GetNumSkeletons();
+
+  protected:
+	// コンストラクタ（GetInstance() からのみ生成）
+	MotionLibrary();
+
+	// ファイル名を正規化（同じファイルは同じ名前になるようにする）
+	static string  GetLibraryKey( const char * file_name );
+
+  private:
+	// コピーは禁止
+	MotionLibrary( const MotionLibrary & );
+	MotionLibrary &  operator=( const MotionLibrary & );
+};
+
+
+#endif // _MOTION_LIBRARY_H_
@@ -37,11 +37,7 @@ MotionPlaybackApp::MotionPlaybackApp()
 //
 MotionPlaybackApp::~MotionPlaybackApp()
 {
-	// 骨格・動作・姿勢の削除
-	if ( motion && motion->body )
-		delete  motion->body;
-	if ( motion )
-		delete  motion;
+	// 姿勢の削除（動作データ・骨格モデルは動作ライブラリが管理する）
 	if ( curr_posture )
 		delete  curr_posture;
 }
@@ -183,23 +179,20 @@ void  MotionPlaybackApp::Animation( float delta )
 //
 void  MotionPlaybackApp::LoadBVH( const char * file_name )
 {
-	// BVHファイルを読み込んで動作データ（＋骨格モデル）を生成
-	Motion *  new_motion = LoadAndCoustructBVHMotion( file_name );
+	// 動作ライブラリから動作データを取得（同じファイルは一度だけ読み込み、同じ骨格モデルは共有される）
+	MotionHandle  new_motion = MotionLibrary::GetInstance().LoadMotion( file_name );
 	
 	// BVHファイルの読み込みに失敗したら終了
 	if ( !new_motion )
 		return;
 
-	// 現在使用している骨格・動作・姿勢を削除
-	if ( motion && motion->body )
-		delete  motion->body;
-	if ( motion )
-		delete  motion;
+	// 現在使用している姿勢を削除（動作データ・骨格モデルは動作ライブラリが管理する）
 	if ( curr_posture )
 		delete  curr_posture;
 
 	// 動作再生に使用する動作・姿勢を初期化
-	motion = new_motion;
+	motion_handle = new_motion;
+	motion = motion_handle.get();
 	curr_posture = new Posture( motion->body );
 
 	// 動作再生開始
@@ -15,6 +15,7 @@
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
 #include "SimpleHumanGLUT.h"
+#include "MotionLibrary.h"
 
 
 //
@@ -28,6 +29,9 @@ class  MotionPlaybackApp : public GLUTBaseApp
 	// 動作データ
 	Motion *  motion;
 
+	// 動作データの参照（動作ライブラリから取得した動作データを保持する）
+	MotionHandle  motion_handle;
+
   protected:
 	// 動作再生のための変数
 
@@ -0,0 +1,209 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データの複数フレームの順運動学計算（全フレーム・全体節のグローバルな位置・向きの表）
+**/
+
+
+#include "MotionTransformTable.h"
+#include "LazyMotion.h"
+#include "ParallelFor.h"
+#include "PosturePool.h"
+
+
+
+// 順運動学計算で、１つのスレッドがまとめて処理するフレーム数
+static const int  transform_table_chunk_size = 32;
+
+
+
+//
+//  動作データの各フレームの全体節・全関節のグローバルな位置・向き
+//
+
+// コンストラクタ
+MotionTransformTable::MotionTransformTable()
+{
+	num_frames = 0;
+	num_segments = 0;
+	num_joints = 0;
+}
+
+
+//
+//  計算済みの値を削除
+//
+void  MotionTransformTable::Clear()
+{
+	lock_guard< mutex >  lock( table_mutex );
+
+	num_frames = 0;
+	num_segments = 0;
+	num_joints = 0;
+
+	vector< float > *  arrays[] = { &segment_pos_x, &segment_pos_y, &segment_pos_z,
+		&segment_ori_x, &segment_ori_y, &segment_ori_z, &segment_ori_w, &joint_pos_x, &joint_pos_y, &joint_pos_z };
+	for ( int i = 0; i < (int)( sizeof( arrays ) / sizeof( arrays[ 0 ] ) ); i++ )
+		vector< float >().swap( *arrays[ i ] );
+	vector< char >().swap( computed_frames );
+}
+
+
+//
+//  計算済みの値を取得
+//
+
+void  MotionTransformTable::GetSegmentPosition( int frame_no, int segment_no, Point3f & pos ) const
+{
+	size_t  i = (size_t) frame_no * num_segments + segment_no;
+	pos.set( segment_pos_x[ i ], segment_pos_y[ i ], segment_pos_z[ i ] );
+}
+
+void  MotionTransformTable::GetSegmentOrientation( int frame_no, int segment_no, Quat4f & ori ) const
+{
+	size_t  i = (size_t) frame_no * num_segments + segment_no;
+	ori.set( segment_ori_x[ i ], segment_ori_y[ i ], segment_ori_z[ i ], segment_ori_w[ i ] );
+}
+
+void  MotionTransformTable::GetJointPosition( int frame_no, int joint_no, Point3f & pos ) const
+{
+	size_t  i = (size_t) frame_no * num_joints + joint_no;
+	pos.set( joint_pos_x[ i ], joint_pos_y[ i ], joint_pos_z[ i ] );
+}
+
+void  MotionTransformTable::GetSegmentFrame( int frame_no, int segment_no, Matrix4f & frame ) const
+{
+	size_t  i = (size_t) frame_no * num_segments + segment_no;
+	Quat4f  ori( segment_ori_x[ i ], segment_ori_y[ i ], segment_ori_z[ i ], segment_ori_w[ i ] );
+	Matrix3f  rot;
+	rot.set( ori );
+	frame.set( rot, Vector3f( segment_pos_x[ i ], segment_pos_y[ i ], segment_pos_z[ i ] ), 1.0f );
+}
+
+
+//
+//  指定範囲のフレームを計算
+//
+void  MotionTransformTable::Compute( const Motion * motion, int frame_begin, int frame_end )
+{
+	lock_guard< mutex >  lock( table_mutex );
+
+	// 最初の計算時に全フレーム分の領域を確保
+	if ( num_frames != motion->num_frames )
+	{
+		num_frames = motion->num_frames;
+		num_segments = motion->body->num_segments;
+		num_joints = motion->body->num_joints;
+
+		size_t  num_segment_values = (size_t) num_frames * num_segments;
+		size_t  num_joint_values = (size_t) num_frames * num_joints;
+		segment_pos_x.assign( num_segment_values, 0.0f );
+		segment_pos_y.assign( num_segment_values, 0.0f );
+		segment_pos_z.assign( num_segment_values, 0.0f );
+		segment_ori_x.assign( num_segment_values, 0.0f );
+		segment_ori_y.assign( num_segment_values, 0.0f );
+		segment_ori_z.assign( num_segment_values, 0.0f );
+		segment_ori_w.assign( num_segment_values, 1.0f );
+		joint_pos_x.assign( num_joint_values, 0.0f );
+		joint_pos_y.assign( num_joint_values, 0.0f );
+		joint_pos_z.assign( num_joint_values, 0.0f );
+		computed_frames.assign( num_frames, 0 );
+	}
+
+	// 計算済みのフレームが範囲の両端にあれば範囲を狭める
+	while ( ( frame_begin < frame_end ) && computed_frames[ frame_begin ] )
+		frame_begin ++;
+	while ( ( frame_begin < frame_end ) && computed_frames[ frame_end - 1 ] )
+		frame_end --;
+	if ( frame_begin >= frame_end )
+		return;
+
+	// 一定フレーム数ずつ並列に計算
+	ParallelFor( frame_begin, frame_end, transform_table_chunk_size, [ & ]( int begin, int end )
+	{
+		// 順運動学計算の結果を格納する配列（スレッドごとに再利用する）
+		static thread_local vector< Matrix4f >  seg_frames;
+		static thread_local vector< Point3f >  joi_positions;
+
+		// 姿勢を必要に応じて生成する場合は、キャッシュを通さずに作業用の姿勢に生成
+		// （他のスレッドの取得によってキャッシュの姿勢が置き換えられないようにする）
+		PooledPosture  decoded_posture( motion->body );
+
+		Matrix3f  rot;
+		Quat4f  q;
+		for ( int i = begin; i < end; i++ )
+		{
+			if ( computed_frames[ i ] )
+				continue;
+
+			const Posture *  posture;
+			if ( motion->frame_decoder )
+			{
+				motion->frame_decoder->DecodeFrame( i, *decoded_posture );
+				posture = &*decoded_posture;
+			}
+			else
+			{
+				posture = &motion->frames[ i ];
+			}
+
+			// 順運動学計算
+			ForwardKinematics( *posture, seg_frames, joi_positions );
+
+			// 体節の位置・向きを設定
+			size_t  base = (size_t) i * num_segments;
+			for ( int j = 0; j < num_segments; j++ )
+			{
+				const Matrix4f &  frame = seg_frames[ j ];
+				segment_pos_x[ base + j ] = frame.m03;
+				segment_pos_y[ base + j ] = frame.m13;
+				segment_pos_z[ base + j ] = frame.m23;
+				frame.getRotationScale( &rot );
+				q.set( rot );
+				segment_ori_x[ base + j ] = q.x;
+				segment_ori_y[ base + j ] = q.y;
+				segment_ori_z[ base + j ] = q.z;
+				segment_ori_w[ base + j ] = q.w;
+			}
+
+			// 関節の位置を設定
+			base = (size_t) i * num_joints;
+			for ( int j = 0; j < num_joints; j++ )
+			{
+				joint_pos_x[ base + j ] = joi_positions[ j ].x;
+				joint_pos_y[ base + j ] = joi_positions[ j ].y;
+				joint_pos_z[ base + j ] = joi_positions[ j ].z;
+			}
+
+			computed_frames[ i ] = 1;
+		}
+	} );
+}
+
+
+
+//
+//  動作データの指定範囲のフレームの順運動学計算を行い、全体節・全関節の位置・向きの表を取得
+//
+const MotionTransformTable *  ForwardKinematicsBatch( const Motion * motion, int frame_begin, int frame_end )
+{
+	if ( !motion || !motion->body || !motion->transform_table || ( motion->num_frames <= 0 ) )
+		return  NULL;
+	if ( !motion->frames && !motion->frame_decoder )
+		return  NULL;
+
+	// 範囲をフレーム数に合わせて補正
+	if ( frame_begin < 0 )
+		frame_begin = 0;
+	if ( frame_end > motion->num_frames )
+		frame_end = motion->num_frames;
+
+	// 未計算のフレームを計算
+	motion->transform_table->Compute( motion, frame_begin, frame_end );
+
+	return  motion->transform_table;
+}
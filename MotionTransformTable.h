@@ -0,0 +1,97 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作データの複数フレームの順運動学計算（全フレーム・全体節のグローバルな位置・向きの表）
+**/
+
+#ifndef  _MOTION_TRANSFORM_TABLE_H_
+#define  _MOTION_TRANSFORM_TABLE_H_
+
+
+#include <mutex>
+#include <Quat4.h>
+
+#include "SimpleHuman.h"
+
+
+//
+//  動作データの各フレームの全体節・全関節のグローバルな位置・向き
+//  （要素ごとに全フレーム分を連続した配列で保持する。ある部位の全フレームの値を順に参照する処理に向く）
+//  （動作データごとに１つ保持し、ForwardKinematicsBatch() で計算したフレームの値を複数の処理で共有する）
+//
+class  MotionTransformTable
+{
+  public:
+	// フレーム数・体節数・関節数（未計算の場合は 0）
+	int  num_frames;
+	int  num_segments;
+	int  num_joints;
+
+	// 体節の位置 [フレーム番号×体節数＋体節番号]
+	vector< float >  segment_pos_x;
+	vector< float >  segment_pos_y;
+	vector< float >  segment_pos_z;
+
+	// 体節の向き（四元数表現）[フレーム番号×体節数＋体節番号]
+	vector< float >  segment_ori_x;
+	vector< float >  segment_ori_y;
+	vector< float >  segment_ori_z;
+	vector< float >  segment_ori_w;
+
+	// 関節の位置 [フレーム番号×関節数＋関節番号]
+	vector< float >  joint_pos_x;
+	vector< float >  joint_pos_y;
+	vector< float >  joint_pos_z;
+
+  protected:
+	// 排他制御（複数のスレッドからの計算に対応）
+	mutex  table_mutex;
+
+	// 各フレームが計算済みかどうか [フレーム番号]
+	vector< char >  computed_frames;
+
+  public:
+	// コンストラクタ
+	MotionTransformTable();
+
+	// 計算済みの値を削除（動作データの姿勢を変更した時に呼び出す）
+	void  Clear();
+
+	// 指定フレームが計算済みかどうかを判定
+	bool  IsComputed( int frame_no ) const { return  ( frame_no >= 0 ) && ( frame_no < num_frames ) && computed_frames[ frame_no ]; }
+
+	// 計算済みの値を取得
+	void  GetSegmentPosition( int frame_no, int segment_no, Point3f & pos ) const;
+	void  GetSegmentOrientation( int frame_no, int segment_no, Quat4f & ori ) const;
+	void  GetJointPosition( int frame_no, int joint_no, Point3f & pos ) const;
+	void  GetSegmentFrame( int frame_no, int segment_no, Matrix4f & frame ) const;
+
+  protected:
+	// 指定範囲のフレームを計算（計算済みのフレームは省略）
+	void  Compute( const Motion * motion, int frame_begin, int frame_end );
+
+	friend const MotionTransformTable *  ForwardKinematicsBatch( const Motion * motion, int frame_begin, int frame_end );
+
+  private:
+	// コピーは禁止
+	MotionTransformTable( const MotionTransformTable & );
+	MotionTransformTable &  operator=( const MotionTransformTable & );
+};
+
+
+// 動作データの指定範囲のフレーム [frame_begin, frame_end) の順運動学計算を行い、全体節・全関節の位置・向きの表を取得
+// （結果は動作データに保持され、計算済みのフレームは再計算しない。複数のフレームを並列に計算する）
+const MotionTransformTable *  ForwardKinematicsBatch( const Motion * motion, int frame_begin, int frame_end );
+
+// 動作データの全フレームの順運動学計算を行い、全体節・全関節の位置・向きの表を取得
+inline const MotionTransformTable *  ForwardKinematicsBatch( const Motion * motion )
+{
+	return  ForwardKinematicsBatch( motion, 0, motion ? motion->num_frames : 0 );
+}
+
+
+#endif // _MOTION_TRANSFORM_TABLE_H_
@@ -14,6 +14,7 @@
 
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
+#include "MotionLibrary.h"
 
 
 //
@@ -24,6 +25,9 @@ struct  MotionInfo
 	// 動作情報
 	Motion *  motion;
 
+	// 動作情報の参照（動作ライブラリから取得した動作データを保持する）
+	MotionHandle  motion_handle;
+
 	// 動作の開始・終了時刻（動作のローカル時間）
 	float  begin_time;
 	float  end_time;
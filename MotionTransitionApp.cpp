@@ -14,6 +14,8 @@
 #include "MotionTransition.h"
 #include "MotionTransitionApp.h"
 #include "BVH.h"
+#include "MotionLibrary.h"
+#include "LazyMotion.h"
 #include "Timeline.h"
 
 // 標準算術関数・定数の定義
@@ -63,8 +65,13 @@ const Skeleton *  LoadSampleMotions( vector< MotionInfo * > &  motion_list, cons
 	// 動作データの読み込み、動作情報の設定
 	for ( int i=0; i<num_motions; i++ )
 	{
-		// BVHファイルを読み込んで動作データ（＋骨格モデル）を生成
-		Motion *  new_motion = LoadAndCoustructBVHMotion( sample_motions[ i ], body );
+		// 動作ライブラリから動作データを取得（同じファイルは一度だけ読み込み、同じ骨格モデルは共有される）
+		// （多数の動作データを保持できるよう、姿勢は再生時に必要なフレームのみ生成する）
+		MotionHandle  new_motion = MotionLibrary::GetInstance().LoadMotion( sample_motions[ i ], MOTION_STORAGE_LAZY );
+
+		// 骨格モデルが指定されていて、取得した動作データの骨格モデルと異なる場合は、指定された骨格モデルで読み込み直す
+		if ( new_motion && body && ( new_motion->body != body ) )
+			new_motion = MotionHandle( LoadAndCoustructLazyBVHMotion( sample_motions[ i ], body ) );
 
 		// 動作データの読み込みに失敗したらスキップ
 		if ( !new_motion )
@@ -76,7 +83,8 @@ const Skeleton *  LoadSampleMotions( vector< MotionInfo * > &  motion_list, cons
 
 		// 動作のメタ情報の設定
 		info = new MotionInfo();
-		InitMotionInfo( info, new_motion );
+		InitMotionInfo( info, new_motion.get() );
+		info->motion_handle = new_motion;
 		for ( int j = 0; j < num_keytimes; j++ )
 			info->keytimes.push_back( sample_keytimes[ i ][ j ] );
 		info->begin_time = info->keytimes[ 0 ];
@@ -123,18 +131,14 @@ MotionTransitionApp::MotionTransitionApp()
 //
 MotionTransitionApp::~MotionTransitionApp()
 {
-	for ( int i=0; motion_list.size(); i++ )
-	{
-		delete  motion_list[ i ]->motion;
+	// 動作データ・骨格モデルは動作ライブラリが管理するため、動作情報のみを削除
+	for ( int i=0; i<(int)motion_list.size(); i++ )
 		delete  motion_list[ i ];
-	}
 	motion_list.clear();
 
 	if ( transition )
 		delete  transition;
 
-	if ( curr_posture->body )
-		delete  curr_posture->body;
 	if ( curr_posture )
 		delete  curr_posture;
 
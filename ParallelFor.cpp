@@ -0,0 +1,317 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  スレッドプールによる並列処理
+**/
+
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <exception>
+
+#include "ParallelFor.h"
+
+using namespace  std;
+
+
+
+//
+//  並列処理のためのスレッドプール
+//
+class  WorkerPool
+{
+  protected:
+	// ワーカースレッド
+	vector< thread >  workers;
+
+	// ワーカースレッドへの通知のための同期オブジェクト
+	mutex  pool_mutex;
+	condition_variable  work_condition;
+	condition_variable  done_condition;
+
+	// 実行中の処理（世代番号が変わったら新しい処理を開始する）
+	const function< void ( int, int ) > *  job_func;
+	int  job_begin;
+	int  job_end;
+	int  job_chunk_size;
+	int  job_num_chunks;
+	unsigned int  job_generation;
+	atomic< int >  next_chunk;
+
+	// 処理中のワーカースレッド数
+	int  num_active_workers;
+
+	// 処理中に最初に発生した例外（全スレッドの終了後に呼び出し元のスレッドで投げ直す）
+	exception_ptr  job_exception;
+
+	// 終了フラグ
+	bool  is_quit;
+
+  public:
+	// 同時に１つの処理のみを受け付けるための排他制御
+	mutex  job_mutex;
+
+  public:
+	// コンストラクタ・デストラクタ
+	WorkerPool( int num_workers );
+	~WorkerPool();
+
+	// ワーカースレッド数を取得
+	int  GetNumWorkers() const { return  workers.size(); }
+
+	// 処理を並列実行
+	void  Run( int begin, int end, int chunk_size, const function< void ( int, int ) > & func );
+
+  protected:
+	// ワーカースレッドの処理
+	void  WorkerMain();
+
+	// 処理の未実行のブロックを順に実行
+	void  ProcessChunks( const function< void ( int, int ) > & func, int begin, int end, int chunk_size, int num_chunks );
+};
+
+
+// 現在のスレッドが並列処理の実行中かどうかのフラグ（入れ子の並列処理は逐次実行する）
+static thread_local bool  in_parallel_region = false;
+
+// 並列処理に使用するスレッド数の設定（0 の場合はハードウェアのスレッド数）
+static int  num_worker_threads_setting = 0;
+
+// スレッドプール（最初の並列処理の実行時に生成）
+static WorkerPool *  worker_pool = NULL;
+
+// スレッドプールの生成・破棄のための排他制御
+static mutex  worker_pool_mutex;
+
+
+//
+//  並列処理の実行中のフラグを設定し、スコープを抜ける時に元に戻す（例外で抜ける場合も含む）
+//
+class  ParallelRegionGuard
+{
+  protected:
+	bool  prev_in_parallel_region;
+
+  public:
+	ParallelRegionGuard() { prev_in_parallel_region = in_parallel_region; in_parallel_region = true; }
+	~ParallelRegionGuard() { in_parallel_region = prev_in_parallel_region; }
+};
+
+
+
+// コンストラクタ
+WorkerPool::WorkerPool( int num_workers )
+{
+	job_func = NULL;
+	job_begin = 0;
+	job_end = 0;
+	job_chunk_size = 1;
+	job_num_chunks = 0;
+	job_generation = 0;
+	next_chunk = 0;
+	num_active_workers = 0;
+	is_quit = false;
+
+	for ( int i = 0; i < num_workers; i++ )
+		workers.push_back( thread( &WorkerPool::WorkerMain, this ) );
+}
+
+// デストラクタ
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard< mutex >  lock( pool_mutex );
+		is_quit = true;
+	}
+	work_condition.notify_all();
+	for ( int i = 0; i < (int) workers.size(); i++ )
+		workers[ i ].join();
+}
+
+
+//
+//  処理を並列実行
+//  （処理中に例外が発生した場合は、全ワーカースレッドの終了を待ってから、最初の例外を呼び出し元に投げ直す）
+//
+void  WorkerPool::Run( int begin, int end, int chunk_size, const function< void ( int, int ) > & func )
+{
+	int  num_chunks = ( end - begin + chunk_size - 1 ) / chunk_size;
+
+	// ワーカースレッドに処理を通知
+	{
+		lock_guard< mutex >  lock( pool_mutex );
+		job_func = &func;
+		job_begin = begin;
+		job_end = end;
+		job_chunk_size = chunk_size;
+		job_num_chunks = num_chunks;
+		next_chunk = 0;
+		job_generation ++;
+	}
+	work_condition.notify_all();
+
+	// 呼び出し元のスレッドも処理を行う
+	ProcessChunks( func, begin, end, chunk_size, num_chunks );
+
+	// 全ワーカースレッドの処理の終了を待つ
+	exception_ptr  exception;
+	{
+		unique_lock< mutex >  lock( pool_mutex );
+		done_condition.wait( lock, [ this ]{ return  num_active_workers == 0; } );
+		job_func = NULL;
+		exception = job_exception;
+		job_exception = NULL;
+	}
+
+	// 処理中に発生した例外を投げ直す
+	if ( exception )
+		rethrow_exception( exception );
+}
+
+
+//
+//  処理の未実行のブロックを順に実行
+//  （例外が発生した場合は、最初の例外を記録して残りのブロックの処理を打ち切る。例外はこの関数の外には投げない）
+//
+void  WorkerPool::ProcessChunks( const function< void ( int, int ) > & func, int begin, int end, int chunk_size, int num_chunks )
+{
+	ParallelRegionGuard  guard;
+	while ( true )
+	{
+		int  chunk = next_chunk.fetch_add( 1 );
+		if ( chunk >= num_chunks )
+			break;
+		int  chunk_begin = begin + chunk * chunk_size;
+		int  chunk_end = ( chunk_begin + chunk_size < end ) ? chunk_begin + chunk_size : end;
+		try
+		{
+			func( chunk_begin, chunk_end );
+		}
+		catch ( ... )
+		{
+			lock_guard< mutex >  lock( pool_mutex );
+			if ( !job_exception )
+				job_exception = current_exception();
+			next_chunk = num_chunks;
+			break;
+		}
+	}
+}
+
+
+//
+//  ワーカースレッドの処理
+//
+void  WorkerPool::WorkerMain()
+{
+	unsigned int  last_generation = 0;
+
+	while ( true )
+	{
+		const function< void ( int, int ) > *  func;
+		int  begin, end, chunk_size, num_chunks;
+
+		// 新しい処理の通知を待つ
+		{
+			unique_lock< mutex >  lock( pool_mutex );
+			work_condition.wait( lock, [ & ]{ return  is_quit || ( ( job_func != NULL ) && ( job_generation != last_generation ) ); } );
+			if ( is_quit )
+				return;
+			last_generation = job_generation;
+			func = job_func;
+			begin = job_begin;
+			end = job_end;
+			chunk_size = job_chunk_size;
+			num_chunks = job_num_chunks;
+			num_active_workers ++;
+		}
+
+		// 未実行のブロックを処理
+		ProcessChunks( *func, begin, end, chunk_size, num_chunks );
+
+		// 処理の終了を通知
+		{
+			lock_guard< mutex >  lock( pool_mutex );
+			num_active_workers --;
+		}
+		done_condition.notify_all();
+	}
+}
+
+
+
+//
+//  範囲を分割して並列に処理
+//
+void  ParallelFor( int begin, int end, int chunk_size, const function< void ( int, int ) > & func )
+{
+	if ( end <= begin )
+		return;
+	if ( chunk_size < 1 )
+		chunk_size = 1;
+
+	// スレッドプールを取得（必要であれば生成）し、処理の実行権を確保
+	WorkerPool *  pool = NULL;
+	unique_lock< mutex >  job_lock;
+	if ( !in_parallel_region && ( end - begin > chunk_size ) )
+	{
+		lock_guard< mutex >  lock( worker_pool_mutex );
+		if ( !worker_pool && ( GetNumWorkerThreads() > 1 ) )
+			worker_pool = new WorkerPool( GetNumWorkerThreads() - 1 );
+		if ( worker_pool )
+		{
+			job_lock = unique_lock< mutex >( worker_pool->job_mutex, try_to_lock );
+			if ( job_lock.owns_lock() )
+				pool = worker_pool;
+		}
+	}
+
+	// スレッドプールが使用できる場合は並列に処理
+	if ( pool )
+	{
+		pool->Run( begin, end, chunk_size, func );
+		return;
+	}
+
+	// 逐次処理
+	for ( int i = begin; i < end; i += chunk_size )
+		func( i, ( i + chunk_size < end ) ? i + chunk_size : end );
+}
+
+
+//
+//  並列処理に使用するスレッド数を設定
+//
+void  SetNumWorkerThreads( int num_threads )
+{
+	lock_guard< mutex >  lock( worker_pool_mutex );
+	num_worker_threads_setting = ( num_threads > 0 ) ? num_threads : 0;
+
+	// 既存のスレッドプールは実行中の処理の終了を待ってから破棄し、次の並列処理の実行時に生成し直す
+	if ( worker_pool )
+	{
+		worker_pool->job_mutex.lock();
+		worker_pool->job_mutex.unlock();
+		delete  worker_pool;
+		worker_pool = NULL;
+	}
+}
+
+
+//
+//  並列処理に使用するスレッド数を取得
+//
+int  GetNumWorkerThreads()
+{
+	if ( num_worker_threads_setting > 0 )
+		return  num_worker_threads_setting;
+	int  num_threads = thread::hardware_concurrency();
+	return  ( num_threads > 0 ) ? num_threads : 1;
+}
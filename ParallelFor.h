@@ -0,0 +1,34 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  スレッドプールによる並列処理
+**/
+
+#ifndef  _PARALLEL_FOR_H_
+#define  _PARALLEL_FOR_H_
+
+
+#include <functional>
+
+
+//
+//  範囲 [begin, end) を chunk_size 個ずつのブロックに分割し、スレッドプールで並列に処理する
+//  （各ブロックの処理 func( block_begin, block_end ) は互いに独立である必要がある）
+//  （処理がすべて終了するまで呼び出し元に戻らない。呼び出し元のスレッドもブロックの処理を行う）
+//  （並列処理の内部から呼び出された場合や、他のスレッドが並列処理中の場合は、逐次処理を行う）
+//  （func が例外を投げた場合は、残りのブロックの処理を打ち切り、全スレッドの終了後に最初の例外を呼び出し元に投げ直す）
+//
+void  ParallelFor( int begin, int end, int chunk_size, const std::function< void ( int, int ) > & func );
+
+// 並列処理に使用するスレッド数を設定（呼び出し元のスレッドを含む、0 の場合はハードウェアのスレッド数、1 の場合は逐次処理）
+void  SetNumWorkerThreads( int num_threads );
+
+// 並列処理に使用するスレッド数を取得
+int  GetNumWorkerThreads();
+
+
+#endif // _PARALLEL_FOR_H_
@@ -0,0 +1,87 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  一時的な姿勢の再利用（スレッドごとの姿勢のプール）
+**/
+
+
+#include "PosturePool.h"
+
+
+
+//
+//  現在のスレッドのプールを取得
+//
+PosturePool &  PosturePool::GetInstance()
+{
+	static thread_local PosturePool  pool;
+	return  pool;
+}
+
+
+// コンストラクタ
+PosturePool::PosturePool()
+{
+}
+
+
+// デストラクタ
+PosturePool::~PosturePool()
+{
+	for ( int i = 0; i < (int) free_postures.size(); i++ )
+		delete  free_postures[ i ].posture;
+}
+
+
+//
+//  指定の骨格モデルの姿勢を取得
+//  （関節数が同じ姿勢を、関節の回転の配列を確保し直さずに再利用する）
+//
+Posture *  PosturePool::Acquire( const Skeleton * body )
+{
+	int  num_joints = body ? body->num_joints : 0;
+	for ( int i = (int) free_postures.size() - 1; i >= 0; i-- )
+	{
+		if ( free_postures[ i ].num_joints != num_joints )
+			continue;
+
+		Posture *  posture = free_postures[ i ].posture;
+		free_postures[ i ] = free_postures.back();
+		free_postures.pop_back();
+
+		// 関節の回転の配列の要素数は同じため、骨格モデルのみを設定する
+		// （返却前の骨格モデルは削除されている可能性があるため、Init() で参照させない）
+		posture->body = body;
+		return  posture;
+	}
+
+	// 再利用できる姿勢がなければ新しく生成
+	return  body ? new Posture( body ) : new Posture();
+}
+
+
+//
+//  姿勢を返却
+//  （関節数は姿勢が記録している所有する配列の要素数を使い、骨格モデルは参照しない）
+//
+void  PosturePool::Release( Posture * posture )
+{
+	if ( !posture )
+		return;
+
+	// 外部の領域を参照している姿勢は再利用できないため削除
+	if ( posture->joint_rotations && !posture->owns_joint_rotations )
+	{
+		delete  posture;
+		return;
+	}
+
+	FreePosture  free_posture;
+	free_posture.posture = posture;
+	free_posture.num_joints = posture->num_owned_joints;
+	free_postures.push_back( free_posture );
+}
@@ -0,0 +1,87 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  一時的な姿勢の再利用（スレッドごとの姿勢のプール）
+**/
+
+#ifndef  _POSTURE_POOL_H_
+#define  _POSTURE_POOL_H_
+
+
+#include "SimpleHuman.h"
+
+
+//
+//  一時的な姿勢を再利用するためのプール
+//  （毎フレームの計算で使用する作業用の姿勢を、関節の回転の配列を確保し直さずに再利用する）
+//  （プールはスレッドごとに用意されるため、排他制御は不要。取得したスレッドで返却すること）
+//  （返却後に骨格モデルが削除されても良いように、姿勢の骨格モデルは参照せず、返却時の関節数で再利用する姿勢を判定する）
+//
+class  PosturePool
+{
+  protected:
+	// 返却された姿勢と、返却時の関節数（関節の回転の配列の要素数）
+	struct  FreePosture
+	{
+		Posture *  posture;
+		int  num_joints;
+	};
+
+	// 返却された姿勢
+	vector< FreePosture >  free_postures;
+
+  public:
+	// 現在のスレッドのプールを取得
+	static PosturePool &  GetInstance();
+
+	// 指定の骨格モデルの姿勢を取得（姿勢の内容は不定）
+	Posture *  Acquire( const Skeleton * body );
+
+	// 姿勢を返却
+	void  Release( Posture * posture );
+
+	// 保持している姿勢の数を取得
+	int  GetNumFreePostures() const { return  (int) free_postures.size(); }
+
+  protected:
+	// コンストラクタ・デストラクタ
+	PosturePool();
+	~PosturePool();
+
+  private:
+	// コピーは禁止
+	PosturePool( const PosturePool & );
+	PosturePool &  operator=( const PosturePool & );
+};
+
+
+//
+//  プールから取得した一時的な姿勢（スコープを抜けると自動的にプールに返却する）
+//
+class  PooledPosture
+{
+  protected:
+	// プールから取得した姿勢
+	Posture *  posture;
+
+  public:
+	// コンストラクタ・デストラクタ
+	PooledPosture( const Skeleton * body ) { posture = PosturePool::GetInstance().Acquire( body ); }
+	~PooledPosture() { PosturePool::GetInstance().Release( posture ); }
+
+	// 姿勢の参照
+	Posture &  operator*() const { return  *posture; }
+	Posture *  operator->() const { return  posture; }
+
+  private:
+	// コピーは禁止
+	PooledPosture( const PooledPosture & );
+	PooledPosture &  operator=( const PooledPosture & );
+};
+
+
+#endif // _POSTURE_POOL_H_
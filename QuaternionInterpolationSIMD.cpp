@@ -0,0 +1,208 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  SIMD命令を使用した複数の四元数の補間（球面線形補間の近似）
+**/
+
+
+#include "QuaternionInterpolationSIMD.h"
+
+// 標準算術関数
+#include <math.h>
+
+// SIMD命令（SSE2）を使用
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __SSE2__ )
+	#define  USE_SSE2_QUATERNION_INTERPOLATION
+	#include <emmintrin.h>
+#endif
+
+
+
+//
+//  球面線形補間の重みの計算に使用する多項式の係数
+//  （逆余弦関数 acos(x) ≒ sqrt(1 - x) (a0 + a1 x + … + a7 x^7)、0 ≦ x ≦ 1、誤差 2e-8 以下（Abramowitz & Stegun 4.4.46））
+//  （正弦関数 sin(x) ≒ x - x^3/3! + … - x^11/11!、0 ≦ x ≦ π/2、誤差 6e-8 以下）
+//
+static const float  acos_coef[ 8 ] = { 1.5707963050f, -0.2145988016f, 0.0889789874f, -0.0501743046f, 0.0308918810f, -0.0170881256f, 0.0066700901f, -0.0012624911f };
+static const float  sin_coef[ 5 ] = { -1.0f / 6.0f, 1.0f / 120.0f, -1.0f / 5040.0f, 1.0f / 362880.0f, -1.0f / 39916800.0f };
+
+// ２つの四元数の間の角度がこれ以下の場合は、線形補間の重みを使用（sin の除算を避ける）
+static const float  min_sin_angle = 1.0e-5f;
+
+
+//
+//  多項式による逆余弦関数・正弦関数の近似（逐次計算）
+//
+
+static inline float  ApproxAcos( float x )
+{
+	float  p = acos_coef[ 7 ];
+	for ( int i = 6; i >= 0; i-- )
+		p = p * x + acos_coef[ i ];
+	return  sqrtf( 1.0f - x ) * p;
+}
+
+static inline float  ApproxSin( float x )
+{
+	float  x2 = x * x;
+	float  p = sin_coef[ 4 ];
+	for ( int i = 3; i >= 0; i-- )
+		p = p * x2 + sin_coef[ i ];
+	return  x + x * x2 * p;
+}
+
+
+//
+//  １組の四元数を補間（逐次計算）
+//
+static inline void  InterpolateQuaternion( const Quat4f & q0, const Quat4f & q1, float t, Quat4f & q )
+{
+	// 内積から２つの四元数の間の角度を計算（内積が負であれば最短経路となるように符号を反転）
+	float  ca = q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w;
+	float  d = fabsf( ca );
+	if ( d > 1.0f )
+		d = 1.0f;
+	float  angle = ApproxAcos( d );
+	float  sin_angle = ApproxSin( angle );
+
+	// 球面線形補間の重みを計算
+	float  w0, w1;
+	if ( sin_angle > min_sin_angle )
+	{
+		w0 = ApproxSin( ( 1.0f - t ) * angle ) / sin_angle;
+		w1 = ApproxSin( t * angle ) / sin_angle;
+	}
+	else
+	{
+		w0 = 1.0f - t;
+		w1 = t;
+	}
+	if ( ca < 0.0f )
+		w1 = -w1;
+
+	// 重み付きの和を計算
+	float  x = w0 * q0.x + w1 * q1.x;
+	float  y = w0 * q0.y + w1 * q1.y;
+	float  z = w0 * q0.z + w1 * q1.z;
+	float  w = w0 * q0.w + w1 * q1.w;
+
+	// 近似の誤差を除くために正規化
+	float  inv_len = 1.0f / sqrtf( x * x + y * y + z * z + w * w );
+	q.x = x * inv_len;
+	q.y = y * inv_len;
+	q.z = z * inv_len;
+	q.w = w * inv_len;
+}
+
+
+#ifdef  USE_SSE2_QUATERNION_INTERPOLATION
+
+//
+//  多項式による逆余弦関数・正弦関数の近似（SSE2、４つの値を同時に計算）
+//
+
+static inline __m128  ApproxAcos4( __m128 x )
+{
+	__m128  p = _mm_set1_ps( acos_coef[ 7 ] );
+	for ( int i = 6; i >= 0; i-- )
+		p = _mm_add_ps( _mm_mul_ps( p, x ), _mm_set1_ps( acos_coef[ i ] ) );
+	return  _mm_mul_ps( _mm_sqrt_ps( _mm_sub_ps( _mm_set1_ps( 1.0f ), x ) ), p );
+}
+
+static inline __m128  ApproxSin4( __m128 x )
+{
+	__m128  x2 = _mm_mul_ps( x, x );
+	__m128  p = _mm_set1_ps( sin_coef[ 4 ] );
+	for ( int i = 3; i >= 0; i-- )
+		p = _mm_add_ps( _mm_mul_ps( p, x2 ), _mm_set1_ps( sin_coef[ i ] ) );
+	return  _mm_add_ps( x, _mm_mul_ps( _mm_mul_ps( x, x2 ), p ) );
+}
+
+
+//
+//  ４組の四元数を補間（SSE2）
+//  （４つの四元数を転置して成分ごとのレジスタに並べ、４組を同時に計算する）
+//
+static inline void  InterpolateQuaternions4( const Quat4f * q0, const Quat4f * q1, __m128 t, Quat4f * q )
+{
+	// ４つの四元数を読み込んで転置（x, y, z, w の各成分のレジスタにする）
+	__m128  x0 = _mm_loadu_ps( &q0[ 0 ].x ), y0 = _mm_loadu_ps( &q0[ 1 ].x ), z0 = _mm_loadu_ps( &q0[ 2 ].x ), w0 = _mm_loadu_ps( &q0[ 3 ].x );
+	__m128  x1 = _mm_loadu_ps( &q1[ 0 ].x ), y1 = _mm_loadu_ps( &q1[ 1 ].x ), z1 = _mm_loadu_ps( &q1[ 2 ].x ), w1 = _mm_loadu_ps( &q1[ 3 ].x );
+	_MM_TRANSPOSE4_PS( x0, y0, z0, w0 );
+	_MM_TRANSPOSE4_PS( x1, y1, z1, w1 );
+
+	// 内積から２つの四元数の間の角度を計算（内積が負であれば最短経路となるように符号を反転）
+	const __m128  sign_mask = _mm_set1_ps( -0.0f );
+	const __m128  one = _mm_set1_ps( 1.0f );
+	__m128  ca = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x0, x1 ), _mm_mul_ps( y0, y1 ) ), _mm_add_ps( _mm_mul_ps( z0, z1 ), _mm_mul_ps( w0, w1 ) ) );
+	__m128  d = _mm_min_ps( _mm_andnot_ps( sign_mask, ca ), one );
+	__m128  angle = ApproxAcos4( d );
+	__m128  sin_angle = ApproxSin4( angle );
+
+	// 球面線形補間の重みを計算（角度が小さい組は線形補間の重みを使用）
+	__m128  inv_sin_angle = _mm_div_ps( one, _mm_max_ps( sin_angle, _mm_set1_ps( min_sin_angle ) ) );
+	__m128  s0 = _mm_mul_ps( ApproxSin4( _mm_mul_ps( _mm_sub_ps( one, t ), angle ) ), inv_sin_angle );
+	__m128  s1 = _mm_mul_ps( ApproxSin4( _mm_mul_ps( t, angle ) ), inv_sin_angle );
+	__m128  use_slerp = _mm_cmpgt_ps( sin_angle, _mm_set1_ps( min_sin_angle ) );
+	s0 = _mm_or_ps( _mm_and_ps( use_slerp, s0 ), _mm_andnot_ps( use_slerp, _mm_sub_ps( one, t ) ) );
+	s1 = _mm_or_ps( _mm_and_ps( use_slerp, s1 ), _mm_andnot_ps( use_slerp, t ) );
+	s1 = _mm_xor_ps( s1, _mm_and_ps( ca, sign_mask ) );
+
+	// 重み付きの和を計算
+	__m128  x = _mm_add_ps( _mm_mul_ps( s0, x0 ), _mm_mul_ps( s1, x1 ) );
+	__m128  y = _mm_add_ps( _mm_mul_ps( s0, y0 ), _mm_mul_ps( s1, y1 ) );
+	__m128  z = _mm_add_ps( _mm_mul_ps( s0, z0 ), _mm_mul_ps( s1, z1 ) );
+	__m128  w = _mm_add_ps( _mm_mul_ps( s0, w0 ), _mm_mul_ps( s1, w1 ) );
+
+	// 近似の誤差を除くために正規化
+	__m128  len = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_add_ps( _mm_mul_ps( z, z ), _mm_mul_ps( w, w ) ) ) );
+	__m128  inv_len = _mm_div_ps( one, len );
+	x = _mm_mul_ps( x, inv_len );
+	y = _mm_mul_ps( y, inv_len );
+	z = _mm_mul_ps( z, inv_len );
+	w = _mm_mul_ps( w, inv_len );
+
+	// 転置して４つの四元数に戻して書き込み
+	_MM_TRANSPOSE4_PS( x, y, z, w );
+	_mm_storeu_ps( &q[ 0 ].x, x );
+	_mm_storeu_ps( &q[ 1 ].x, y );
+	_mm_storeu_ps( &q[ 2 ].x, z );
+	_mm_storeu_ps( &q[ 3 ].x, w );
+}
+
+#endif // USE_SSE2_QUATERNION_INTERPOLATION
+
+
+//
+//  複数の四元数の組を補間
+//
+void  InterpolateQuaternions( const Quat4f * q0, const Quat4f * q1, float ratio, Quat4f * q, int count )
+{
+	int  i = 0;
+#ifdef  USE_SSE2_QUATERNION_INTERPOLATION
+	__m128  t = _mm_set1_ps( ratio );
+	for ( ; i + 4 <= count; i += 4 )
+		InterpolateQuaternions4( &q0[ i ], &q1[ i ], t, &q[ i ] );
+#endif
+	for ( ; i < count; i++ )
+		InterpolateQuaternion( q0[ i ], q1[ i ], ratio, q[ i ] );
+}
+
+
+//
+//  複数の四元数の組を、組ごとの重みで補間
+//
+void  InterpolateQuaternions( const Quat4f * q0, const Quat4f * q1, const float * ratios, Quat4f * q, int count )
+{
+	int  i = 0;
+#ifdef  USE_SSE2_QUATERNION_INTERPOLATION
+	for ( ; i + 4 <= count; i += 4 )
+		InterpolateQuaternions4( &q0[ i ], &q1[ i ], _mm_loadu_ps( &ratios[ i ] ), &q[ i ] );
+#endif
+	for ( ; i < count; i++ )
+		InterpolateQuaternion( q0[ i ], q1[ i ], ratios[ i ], q[ i ] );
+}
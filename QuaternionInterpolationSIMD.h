@@ -0,0 +1,33 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  SIMD命令を使用した複数の四元数の補間（球面線形補間の近似）
+**/
+
+#ifndef  _QUATERNION_INTERPOLATION_SIMD_H_
+#define  _QUATERNION_INTERPOLATION_SIMD_H_
+
+
+#include <Quat4.h>
+
+#include "SimpleHuman.h"
+
+
+//
+//  複数の四元数の組を補間（q[i] = slerp( q0[i], q1[i], ratio )、最短経路で補間）
+//  （球面線形補間の重みに使う逆余弦関数・正弦関数を多項式で近似し、結果を正規化する）
+//  （重みは [0, 1] の範囲とする。倍精度で計算した球面線形補間との回転の誤差は 1e-6 rad 以下（単精度の Quat4f::interpolate と同程度））
+//  （４組ずつSIMDレジスタに並べて計算する。SSE2 が使えない環境では同じ計算を逐次的に行う）
+//  （出力先は入力と同じ配列でも良い。入力の四元数は単位四元数とする）
+//
+void  InterpolateQuaternions( const Quat4f * q0, const Quat4f * q1, float ratio, Quat4f * q, int count );
+
+// 複数の四元数の組を、組ごとの重みで補間（ratios[i] が q[i] の重み）
+void  InterpolateQuaternions( const Quat4f * q0, const Quat4f * q1, const float * ratios, Quat4f * q, int count );
+
+
+#endif // _QUATERNION_INTERPOLATION_SIMD_H_
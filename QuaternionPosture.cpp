@@ -0,0 +1,221 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  四元数表現の姿勢（回転行列と四元数の変換を省略した姿勢の補間・変形）
+**/
+
+
+#include "QuaternionPosture.h"
+#include "LazyMotion.h"
+#include "PosturePool.h"
+#include "QuaternionInterpolationSIMD.h"
+
+
+
+//
+//  関節の回転を四元数で表した姿勢
+//
+
+// コンストラクタ
+QuaternionPosture::QuaternionPosture()
+{
+	body = NULL;
+	root_pos.set( 0.0f, 0.0f, 0.0f );
+	root_ori.set( 0.0f, 0.0f, 0.0f, 1.0f );
+}
+
+QuaternionPosture::QuaternionPosture( const Skeleton * b ) : QuaternionPosture()
+{
+	Init( b );
+}
+
+
+//
+//  初期化
+//
+void  QuaternionPosture::Init( const Skeleton * b )
+{
+	body = b;
+	root_pos.set( 0.0f, 0.0f, 0.0f );
+	root_ori.set( 0.0f, 0.0f, 0.0f, 1.0f );
+	joint_rotations.assign( b ? b->num_joints : 0, Quat4f( 0.0f, 0.0f, 0.0f, 1.0f ) );
+}
+
+
+//
+//  回転行列表現の姿勢から設定
+//
+void  QuaternionPosture::Set( const Posture & p )
+{
+	body = p.body;
+	root_pos = p.root_pos;
+	root_ori.set( p.root_ori );
+
+	int  num_joints = body ? body->num_joints : 0;
+	joint_rotations.resize( num_joints );
+	for ( int i = 0; i < num_joints; i++ )
+		joint_rotations[ i ].set( p.joint_rotations[ i ] );
+}
+
+
+//
+//  回転行列表現の姿勢に変換
+//
+void  QuaternionPosture::GetPosture( Posture & p ) const
+{
+	if ( !body )
+		return;
+	if ( p.body != body )
+		p.Init( body );
+
+	p.root_pos = root_pos;
+	p.root_ori.set( root_ori );
+	for ( int i = 0; i < body->num_joints; i++ )
+		p.joint_rotations[ i ].set( joint_rotations[ i ] );
+}
+
+
+
+//
+//  動作データの各フレームの四元数表現の姿勢
+//
+
+// コンストラクタ
+MotionQuaternionFrames::MotionQuaternionFrames()
+{
+}
+
+
+//
+//  変換済みの姿勢を削除
+//
+void  MotionQuaternionFrames::Clear()
+{
+	lock_guard< mutex >  lock( frames_mutex );
+
+	vector< QuaternionPosture >().swap( frames );
+	vector< char >().swap( converted_frames );
+}
+
+
+//
+//  指定フレームの姿勢を取得
+//  （保持している姿勢は Clear() やフレーム数の変更で削除されるため、ポインタは返さずに排他制御の中でコピーする）
+//
+bool  MotionQuaternionFrames::GetFrame( const Motion * motion, int no, QuaternionPosture & p )
+{
+	if ( !motion || !motion->body || ( no < 0 ) || ( no >= motion->num_frames ) )
+		return  false;
+	if ( !motion->frames && !motion->frame_decoder )
+		return  false;
+
+	lock_guard< mutex >  lock( frames_mutex );
+
+	// フレーム数が変わっていれば領域を確保し直す
+	if ( (int) frames.size() != motion->num_frames )
+	{
+		frames.assign( motion->num_frames, QuaternionPosture() );
+		converted_frames.assign( motion->num_frames, 0 );
+	}
+
+	// 変換されていなければ変換
+	QuaternionPosture &  frame = frames[ no ];
+	if ( !converted_frames[ no ] )
+	{
+
+		// 姿勢を必要に応じて生成する場合は、キャッシュを通さずに作業用の姿勢に生成してから変換
+		if ( motion->frame_decoder )
+		{
+			PooledPosture  decoded_posture( motion->body );
+			motion->frame_decoder->DecodeFrame( no, *decoded_posture );
+			frame.Set( *decoded_posture );
+		}
+		else
+		{
+			frame.Set( motion->frames[ no ] );
+		}
+		converted_frames[ no ] = 1;
+	}
+
+	// 呼び出し側の姿勢にコピー
+	p = frame;
+	return  true;
+}
+
+
+
+//
+//  ２つの位置を補間
+//
+static inline void  InterpolatePosition( const Point3f & v0, const Point3f & v1, float ratio, Point3f & v )
+{
+	Vector3f  d;
+	d.sub( v1, v0 );
+	d.scaleAdd( ratio, d, v0 );
+	v.set( d );
+}
+
+
+//
+//  姿勢補間（２つの姿勢を四元数表現のまま補間）
+//
+void  PostureInterpolation( const QuaternionPosture & p0, const QuaternionPosture & p1, float ratio, QuaternionPosture & p )
+{
+	// ２つの姿勢の骨格モデルが異なる場合は終了
+	if ( p0.body != p1.body )
+		return;
+
+	// 骨格モデルを取得
+	const Skeleton *  body = p0.body;
+	if ( !body )
+		return;
+	p.body = body;
+	p.joint_rotations.resize( body->num_joints );
+
+	// ２つの姿勢の各関節の回転をまとめて補間
+	if ( body->num_joints > 0 )
+		InterpolateQuaternions( &p0.joint_rotations.front(), &p1.joint_rotations.front(), ratio, &p.joint_rotations.front(), body->num_joints );
+
+	// ２つの姿勢のルートの向きを補間
+	InterpolateQuaternions( &p0.root_ori, &p1.root_ori, ratio, &p.root_ori, 1 );
+
+	// ２つの姿勢のルートの位置を補間
+	InterpolatePosition( p0.root_pos, p1.root_pos, ratio, p.root_pos );
+}
+
+
+//
+//  姿勢補間（２つの姿勢を補間して、回転行列表現の姿勢に出力）
+//  （四元数から回転行列への変換のみを行い、回転行列から四元数への変換は行わない）
+//
+void  PostureInterpolation( const QuaternionPosture & p0, const QuaternionPosture & p1, float ratio, Posture & p )
+{
+	// ２つの姿勢の骨格モデルが異なる場合は終了
+	if ( ( p0.body != p1.body ) || ( p0.body != p.body ) )
+		return;
+
+	// 骨格モデルを取得
+	const Skeleton *  body = p0.body;
+	if ( !body )
+		return;
+
+	// ２つの姿勢の各関節の回転・ルートの向きをまとめて補間（補間結果の配列はスレッドごとに再利用する）
+	static thread_local vector< Quat4f >  rotations;
+	const int  num_joints = body->num_joints;
+	rotations.resize( num_joints + 1 );
+	if ( num_joints > 0 )
+		InterpolateQuaternions( &p0.joint_rotations.front(), &p1.joint_rotations.front(), ratio, &rotations.front(), num_joints );
+	InterpolateQuaternions( &p0.root_ori, &p1.root_ori, ratio, &rotations[ num_joints ], 1 );
+
+	// 回転行列に変換
+	for ( int i = 0; i < num_joints; i++ )
+		p.joint_rotations[ i ].set( rotations[ i ] );
+	p.root_ori.set( rotations[ num_joints ] );
+
+	// ２つの姿勢のルートの位置を補間
+	InterpolatePosition( p0.root_pos, p1.root_pos, ratio, p.root_pos );
+}
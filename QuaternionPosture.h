@@ -0,0 +1,99 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  四元数表現の姿勢（回転行列と四元数の変換を省略した姿勢の補間・変形）
+**/
+
+#ifndef  _QUATERNION_POSTURE_H_
+#define  _QUATERNION_POSTURE_H_
+
+
+#include <mutex>
+#include <Quat4.h>
+
+#include "SimpleHuman.h"
+
+
+//
+//  関節の回転を四元数で表した姿勢
+//  （姿勢の補間・変形は四元数で行うため、回転行列から四元数への変換を毎回行わずに済む）
+//  （回転行列は、描画や順運動学計算のために Posture に変換する時にのみ計算する）
+//
+class  QuaternionPosture
+{
+  public:
+	// 骨格モデル
+	const Skeleton *  body;
+
+	// ルートの位置
+	Point3f  root_pos;
+
+	// ルートの向き（四元数表現）
+	Quat4f  root_ori;
+
+	// 各関節の相対回転（四元数表現）[関節番号]
+	vector< Quat4f >  joint_rotations;
+
+  public:
+	// コンストラクタ
+	QuaternionPosture();
+	QuaternionPosture( const Skeleton * b );
+
+	// 初期化（全関節の回転を無回転とする）
+	void  Init( const Skeleton * b );
+
+	// 回転行列表現の姿勢から設定
+	void  Set( const Posture & p );
+
+	// 回転行列表現の姿勢に変換（出力先の姿勢の領域は再利用される）
+	void  GetPosture( Posture & p ) const;
+};
+
+
+//
+//  動作データの各フレームの四元数表現の姿勢
+//  （動作データごとに１つ保持し、取得したフレームのみを変換して保持する）
+//  （保持している姿勢は Clear() やフレーム数の変更で削除されるため、取得時には排他制御の中で呼び出し側の姿勢にコピーする）
+//
+class  MotionQuaternionFrames
+{
+  protected:
+	// 排他制御（複数のスレッドからの取得に対応）
+	mutex  frames_mutex;
+
+	// 各フレームの姿勢 [フレーム番号]
+	vector< QuaternionPosture >  frames;
+
+	// 各フレームが変換済みかどうか [フレーム番号]
+	vector< char >  converted_frames;
+
+  public:
+	// コンストラクタ
+	MotionQuaternionFrames();
+
+	// 変換済みの姿勢を削除（動作データの姿勢を変更した時に呼び出す）
+	void  Clear();
+
+	// 指定フレームの姿勢を呼び出し側の姿勢にコピーして取得（変換されていなければ変換する、取得できなければ false を返す）
+	// （出力先の姿勢の領域は再利用されるため、同じ姿勢に繰り返し取得しても領域は確保し直さない）
+	bool  GetFrame( const Motion * motion, int no, QuaternionPosture & p );
+
+  private:
+	// コピーは禁止
+	MotionQuaternionFrames( const MotionQuaternionFrames & );
+	MotionQuaternionFrames &  operator=( const MotionQuaternionFrames & );
+};
+
+
+// 姿勢補間（２つの姿勢を四元数表現のまま補間）
+void  PostureInterpolation( const QuaternionPosture & p0, const QuaternionPosture & p1, float ratio, QuaternionPosture & p );
+
+// 姿勢補間（２つの姿勢を補間して、回転行列表現の姿勢に出力）
+void  PostureInterpolation( const QuaternionPosture & p0, const QuaternionPosture & p1, float ratio, Posture & p );
+
+
+#endif // _QUATERNION_POSTURE_H_
@@ -9,6 +9,16 @@
 // ヘッダファイルのインクルード
 #include "SimpleHuman.h"
 #include "bvh.h"
+#include "MotionCache.h"
+#include "ParallelFor.h"
+#include "EulerRotation.h"
+#include "LazyMotion.h"
+#include "MotionTransformTable.h"
+#include "ForwardKinematicsSIMD.h"
+#include "QuaternionPosture.h"
+#include "PosturePool.h"
+#include "QuaternionInterpolationSIMD.h"
+#include "JointPathTable.h"
 
 // OpenGL + GLUT を使用
 #include <gl/glut.h>
@@ -17,12 +27,27 @@
 #define  _USE_MATH_DEFINES
 #include <math.h>
 
+// 境界を揃えたメモリ確保
+#include <new>
+
+// 姿勢の領域の確保回数のカウント
+#include <atomic>
+
+// 影の描画処理の指定
+#include <functional>
+
 
 // グローバル変数の定義
 
 // BVHファイルの位置情報に適用するスケーリング比率（デフォルトでは cm→m への変換）
 const float  bvh_scale = 0.01f;
 
+// BVH動作から動作データを生成する時に、１つのスレッドがまとめて処理するフレーム数
+const int  bvh_decode_chunk_size = 64;
+
+// 動作データの全フレームの関節の回転を格納する領域の境界（キャッシュラインのサイズ）
+static const size_t  motion_frame_alignment = 64;
+
 
 
 //
@@ -35,6 +60,8 @@ Skeleton::Skeleton()
 	segments = NULL;
 	num_joints = 0;
 	joints = NULL;
+	rest_lowest_height = 0.0f;
+	joint_path_table = new JointPathTable( this );
 }
 
 Skeleton::Skeleton( int s, int j )
@@ -48,6 +75,98 @@ Skeleton::Skeleton( int s, int j )
 	joints = new Joint*[ num_joints ];
 	for ( int i = 0; i < num_joints; i++ )
 		joints[ i ] = NULL;
+	rest_lowest_height = 0.0f;
+	joint_path_table = new JointPathTable( this );
+}
+
+//
+//  体節の接続情報を初期化
+//  （ルート体節から深さ優先で体節をたどり、各体節をルート側の体節よりも後に並べる）
+//  （深さ優先の順に並べることで、各体節より末端側の体節は、その体節の直後に連続して並ぶ）
+//
+void  Skeleton::InitTopology()
+{
+	segment_links.clear();
+	joint_links.assign( num_joints, -1 );
+	joint_path_table->Clear();
+	if ( ( num_segments <= 0 ) || !segments || !segments[ 0 ] )
+		return;
+	segment_links.reserve( num_segments - 1 );
+
+	// 各体節の接続情報の番号（ルート体節は -2、-1 は未到達）
+	vector< int >  segment_link_nos( num_segments, -1 );
+	segment_link_nos[ 0 ] = -2;
+
+	// 各体節の接続情報のルート側の体節の接続情報の番号（ルート体節は -1）
+	vector< int >  parent_link_nos;
+	parent_link_nos.reserve( num_segments - 1 );
+
+	// 探索中の体節（スタック）
+	vector< int >  stack;
+	stack.push_back( 0 );
+	while ( !stack.empty() )
+	{
+		const Segment *  segment = segments[ stack.back() ];
+		stack.pop_back();
+
+		// 接続関節の順に処理されるよう、逆順にスタックに追加
+		for ( int j = segment->num_joints - 1; j >= 0; j-- )
+		{
+			// 次の関節・次の体節を取得
+			const Joint *  joint = segment->joints[ j ];
+			const Segment *  next_segment = ( joint->segments[ 0 ] != segment ) ? joint->segments[ 0 ] : joint->segments[ 1 ];
+
+			// 到達済みの体節（ルート側の体節）はスキップ
+			if ( !next_segment || ( segment_link_nos[ next_segment->index ] != -1 ) )
+				continue;
+			segment_link_nos[ next_segment->index ] = -3;
+			stack.push_back( next_segment->index );
+		}
+
+		// ルート体節には接続情報はない
+		if ( segment->index == 0 )
+			continue;
+
+		// ルート側の体節と接続する関節（ルート体節以外の体節の 0 番目の接続関節）
+		const Joint *  joint = segment->joints[ 0 ];
+		const Segment *  parent_segment = ( joint->segments[ 0 ] != segment ) ? joint->segments[ 0 ] : joint->segments[ 1 ];
+		int  parent_joint_no = 0;
+		while ( ( parent_joint_no < parent_segment->num_joints ) && ( parent_segment->joints[ parent_joint_no ] != joint ) )
+			parent_joint_no ++;
+
+		// 接続情報を追加
+		SegmentLink  link;
+		link.segment = segment->index;
+		link.parent_segment = parent_segment->index;
+		link.joint = joint->index;
+		link.parent_offset.set( parent_segment->joint_positions[ parent_joint_no ] );
+		link.offset.set( segment->joint_positions[ 0 ] );
+		link.subtree_end = 0;
+
+		segment_link_nos[ segment->index ] = segment_links.size();
+		parent_link_nos.push_back( segment_link_nos[ parent_segment->index ] );
+		joint_links[ joint->index ] = segment_links.size();
+		segment_links.push_back( link );
+	}
+
+	// 各体節より末端側の体節の接続情報の範囲を計算（末端側から順に、ルート側の体節の範囲を広げる）
+	for ( int i = 0; i < (int) segment_links.size(); i++ )
+		segment_links[ i ].subtree_end = i + 1;
+	for ( int i = (int) segment_links.size() - 1; i >= 0; i-- )
+	{
+		int  parent = parent_link_nos[ i ];
+		if ( ( parent >= 0 ) && ( segment_links[ parent ].subtree_end < segment_links[ i ].subtree_end ) )
+			segment_links[ parent ].subtree_end = segment_links[ i ].subtree_end;
+	}
+
+	// 全関節の回転が単位行列の姿勢での、最も低い体節の y座標を計算（InitPosture() で使用）
+	Posture  rest_posture( this );
+	vector< Matrix4f >  seg_frame_array;
+	ForwardKinematics( rest_posture, seg_frame_array );
+	rest_lowest_height = 0.0f;
+	for ( int i = 0; i < num_segments; i++ )
+		if ( rest_lowest_height > seg_frame_array[ i ].m13 )
+			rest_lowest_height = seg_frame_array[ i ].m13;
 }
 
 Skeleton::~Skeleton()
@@ -76,6 +195,7 @@ Skeleton::~Skeleton()
 		}
 		delete[]  joints;
 	}
+	delete  joint_path_table;
 }
 
 
@@ -83,12 +203,31 @@ Skeleton::~Skeleton()
 //  人体モデルの姿勢を表す構造体
 //
 
+// 姿勢の関節の回転の配列を確保した回数（定常状態で確保が発生していないかの確認用）
+static atomic< long long >  posture_allocation_count( 0 );
+
+// 姿勢の関節の回転の配列を確保（確保した回数を記録）
+static Matrix3f *  AllocJointRotations( int num_joints )
+{
+	posture_allocation_count ++;
+	return  new Matrix3f[ num_joints ];
+}
+
+// 姿勢の関節の回転の配列を確保した回数（全スレッドの合計）を取得
+long long  GetPostureAllocationCount()
+{
+	return  posture_allocation_count;
+}
+
+
 Posture::Posture()
 {
 	body = NULL;
 	root_pos.set( 0.0f, 0.0f, 0.0f );
 	root_ori.setIdentity();
 	joint_rotations = NULL;
+	owns_joint_rotations = false;
+	num_owned_joints = 0;
 }
 
 Posture::Posture( const Skeleton * b )
@@ -97,7 +236,9 @@ Posture::Posture( const Skeleton * b )
 	root_pos.set( 0.0f, 0.0f, 0.0f );
 	root_ori.setIdentity();
 
-	joint_rotations = new Matrix3f[ body->num_joints ];
+	joint_rotations = AllocJointRotations( body->num_joints );
+	owns_joint_rotations = true;
+	num_owned_joints = body->num_joints;
 	for ( int i = 0; i < body->num_joints; i++ )
 		joint_rotations[ i ].setIdentity();
 }
@@ -108,23 +249,58 @@ Posture::Posture( const Posture & p )
 	root_pos = p.root_pos;
 	root_ori = p.root_ori;
 
-	joint_rotations = new Matrix3f[ body->num_joints ];
+	joint_rotations = NULL;
+	owns_joint_rotations = false;
+	num_owned_joints = 0;
+	if ( !body || !p.joint_rotations )
+		return;
+
+	joint_rotations = AllocJointRotations( body->num_joints );
+	owns_joint_rotations = true;
+	num_owned_joints = body->num_joints;
 	for ( int i = 0; i < body->num_joints; i++ )
 		joint_rotations[ i ] = p.joint_rotations[ i ];
 }
 
-Posture & Posture::operator=( const Posture & p )
+Posture::Posture( Posture && p )
 {
-	if ( !p.body || !p.joint_rotations )
-		return  *this;
+	body = p.body;
+	root_pos = p.root_pos;
+	root_ori = p.root_ori;
 
-	if ( body != p.body )
+	// 移動元が所有する領域はそのまま引き継ぎ、他の姿勢の領域を参照している場合はコピーする
+	joint_rotations = NULL;
+	owns_joint_rotations = false;
+	num_owned_joints = 0;
+	if ( !body || !p.joint_rotations )
+		return;
+
+	if ( p.owns_joint_rotations )
 	{
-		body = p.body;
-		if ( joint_rotations )
-			delete[]  joint_rotations;
-		joint_rotations = new Matrix3f[ body->num_joints ];
+		joint_rotations = p.joint_rotations;
+		owns_joint_rotations = true;
+		num_owned_joints = p.num_owned_joints;
+		p.joint_rotations = NULL;
+		p.owns_joint_rotations = false;
+		p.num_owned_joints = 0;
+		p.body = NULL;
 	}
+	else
+	{
+		joint_rotations = AllocJointRotations( body->num_joints );
+		owns_joint_rotations = true;
+		num_owned_joints = body->num_joints;
+		for ( int i = 0; i < body->num_joints; i++ )
+			joint_rotations[ i ] = p.joint_rotations[ i ];
+	}
+}
+
+Posture & Posture::operator=( const Posture & p )
+{
+	if ( !p.body || !p.joint_rotations || ( &p == this ) )
+		return  *this;
+
+	PrepareJointRotations( p.body );
 
 	root_pos = p.root_pos;
 	root_ori = p.root_ori;
@@ -134,26 +310,94 @@ Posture & Posture::operator=( const Posture & p )
 	return  *this;
 }
 
+Posture & Posture::operator=( Posture && p )
+{
+	if ( !p.body || !p.joint_rotations || ( &p == this ) )
+		return  *this;
+
+	// 移動先が他の姿勢の領域を参照している場合や、移動元が領域を所有していない場合はコピーする
+	// （動作データのフレームへの代入は、動作データの領域に書き込む必要がある）
+	if ( ( joint_rotations && !owns_joint_rotations ) || !p.owns_joint_rotations )
+		return  operator=( (const Posture &) p );
+
+	// 配列を交換（移動元の姿勢が削除される時に、元の配列も削除される）
+	const Skeleton *  prev_body = body;
+	Matrix3f *  prev_rotations = joint_rotations;
+	int  prev_num_owned_joints = num_owned_joints;
+	body = p.body;
+	root_pos = p.root_pos;
+	root_ori = p.root_ori;
+	joint_rotations = p.joint_rotations;
+	owns_joint_rotations = true;
+	num_owned_joints = p.num_owned_joints;
+	p.body = prev_rotations ? prev_body : NULL;
+	p.joint_rotations = prev_rotations;
+	p.owns_joint_rotations = ( prev_rotations != NULL );
+	p.num_owned_joints = prev_rotations ? prev_num_owned_joints : 0;
+
+	return  *this;
+}
+
 void  Posture::Init( const Skeleton * b )
 {
-	body = b;
+	PrepareJointRotations( b );
+
 	root_pos.set( 0.0f, 0.0f, 0.0f );
 	root_ori.setIdentity();
 
-	if ( joint_rotations )
+	for ( int i = 0; i < body->num_joints; i++ )
+		joint_rotations[ i ].setIdentity();
+}
+
+void  Posture::InitView( const Skeleton * b, Matrix3f * rotations )
+{
+	if ( joint_rotations && owns_joint_rotations )
 		delete[]  joint_rotations;
-		
-	joint_rotations = new Matrix3f[ body->num_joints ];
+
+	body = b;
+	root_pos.set( 0.0f, 0.0f, 0.0f );
+	root_ori.setIdentity();
+
+	joint_rotations = rotations;
+	owns_joint_rotations = false;
+	num_owned_joints = 0;
 	for ( int i = 0; i < body->num_joints; i++ )
 		joint_rotations[ i ].setIdentity();
 }
 
 Posture::~Posture()
 {
-	if ( joint_rotations )
+	if ( joint_rotations && owns_joint_rotations )
 		delete[]  joint_rotations;
 }
 
+//
+//  指定の骨格モデルの関節の回転の配列を用意
+//  （所有する配列の関節数が同じであれば再利用する。外部の領域は同じ骨格モデルの場合のみそのまま使用する）
+//  （所有する配列の関節数は記録した値を使い、削除済みの可能性がある以前の骨格モデルは参照しない）
+//
+void  Posture::PrepareJointRotations( const Skeleton * b )
+{
+	bool  reusable = false;
+	if ( joint_rotations )
+	{
+		if ( owns_joint_rotations )
+			reusable = ( num_owned_joints == b->num_joints );
+		else
+			reusable = ( body == b );
+	}
+
+	if ( !reusable )
+	{
+		if ( joint_rotations && owns_joint_rotations )
+			delete[]  joint_rotations;
+		joint_rotations = AllocJointRotations( b->num_joints );
+		owns_joint_rotations = true;
+		num_owned_joints = b->num_joints;
+	}
+	body = b;
+}
+
 
 //
 //  人体モデルの動作を表すクラス
@@ -165,6 +409,11 @@ Motion::Motion()
 	num_frames = 0;
 	interval = 0.033f;
 	frames = NULL;
+	frame_rotations = NULL;
+	frame_decoder = NULL;
+	frame_cache = NULL;
+	transform_table = new MotionTransformTable();
+	quaternion_frames = new MotionQuaternionFrames();
 }
 
 Motion::Motion( const Skeleton * b, int n ) : Motion()
@@ -172,58 +421,205 @@ Motion::Motion( const Skeleton * b, int n ) : Motion()
 	Init( b, n );
 }
 
-Motion::Motion( const Motion & m )
+Motion::Motion( const Motion & m ) : Motion()
 {
 	body = m.body;
 	num_frames = m.num_frames;
 	interval = m.interval;
 
-	frames = num_frames ? new Posture[ num_frames ] : NULL;
-	for ( int i = 0; i < num_frames; i++ )
-		frames[ i ] = m.frames[ i ];
+	CopyFrames( m );
 }
 
 Motion & Motion::operator=( const Motion & m )
 {
+	if ( &m == this )
+		return  *this;
+
+	ClearLazy();
+
+	FreeFrames();
+
 	body = m.body;
 	num_frames = m.num_frames;
 	interval = m.interval;
 
-	if ( frames )
-		delete[]  frames;
-
-	frames = num_frames ? new Posture[ num_frames ] : NULL;
-	for ( int i = 0; i < num_frames; i++ )
-		frames[ i ] = m.frames[ i ];
+	CopyFrames( m );
 
 	return  *this;
 }
 
 void  Motion::Init( const Skeleton * b, int n )
 {
+	ClearLazy();
+
+	FreeFrames();
+
 	body = b;
 	num_frames = n;
 
+	AllocFrames();
+}
+
+void  Motion::InitLazy( const Skeleton * b, int n, MotionFrameDecoder * decoder, int cache_size )
+{
+	ClearLazy();
+
+	FreeFrames();
+
+	body = b;
+	num_frames = n;
+
+	frame_decoder = decoder;
+	frame_cache = new MotionFrameCache( cache_size );
+}
+
+Motion::~Motion()
+{
+	ClearLazy();
+	FreeFrames();
+	delete  transform_table;
+	delete  quaternion_frames;
+}
+
+void  Motion::AllocFrames()
+{
+	if ( num_frames <= 0 )
+		return;
+
+	// 全フレームの関節の相対回転を、キャッシュラインに揃えた１つの領域に確保
+	// （フレーム順に連続して格納されるため、全フレームを順に処理する時のメモリアクセスが連続となる）
+	size_t  num_rotations = (size_t) num_frames * body->num_joints;
+	frame_rotations = (Matrix3f *) ::operator new[]( ( num_rotations > 0 ? num_rotations : 1 ) * sizeof( Matrix3f ), align_val_t( motion_frame_alignment ) );
+	for ( size_t i = 0; i < num_rotations; i++ )
+		new ( &frame_rotations[ i ] ) Matrix3f();
+
+	// 各フレームの姿勢は、確保した領域を参照する
 	frames = new Posture[ num_frames ];
 	for ( int i = 0; i < num_frames; i++ )
-		frames[ i ].Init( body );
+		frames[ i ].InitView( body, &frame_rotations[ (size_t) i * body->num_joints ] );
 }
 
-Motion::~Motion()
+void  Motion::FreeFrames()
 {
+	// 姿勢を変更するため、順運動学計算の結果・四元数表現の姿勢も削除
+	ClearTransformTable();
+	ClearQuaternionFrames();
+
 	if ( frames )
 		delete[]  frames;
+	frames = NULL;
+
+	if ( frame_rotations )
+		::operator delete[]( frame_rotations, align_val_t( motion_frame_alignment ) );
+	frame_rotations = NULL;
+}
+
+void  Motion::CopyFrames( const Motion & m )
+{
+	// 姿勢を必要に応じて生成する動作データのコピーは、全フレームの姿勢を生成して保持する
+	AllocFrames();
+	if ( m.frame_cache )
+	{
+		for ( int i = 0; i < num_frames; i++ )
+			m.frame_cache->GetPosture( &m, i, frames[ i ] );
+	}
+	else
+	{
+		for ( int i = 0; i < num_frames; i++ )
+			frames[ i ] = m.frames[ i ];
+	}
+}
+
+void  Motion::ClearTransformTable()
+{
+	if ( transform_table )
+		transform_table->Clear();
+}
+
+void  Motion::ClearQuaternionFrames()
+{
+	if ( quaternion_frames )
+		quaternion_frames->Clear();
+}
+
+int  Motion::GetFrameNo( float time ) const
+{
+	if ( ( interval <= 0.0f ) || ( num_frames <= 0 ) )
+		return  0;
+
+	int  no = time / interval;
+	if ( no <= 0 )
+		no = 0;
+	else if ( no >= num_frames )
+		no = num_frames - 1;
+	return  no;
+}
+
+// フレーム番号を範囲内に補正
+static inline int  ClampFrameNo( int no, int num_frames )
+{
+	if ( no >= num_frames )
+		no = num_frames - 1;
+	if ( no <= 0 )
+		no = 0;
+	return  no;
+}
+
+const MotionTransformTable *  Motion::GetGlobalTransforms( int frame_no ) const
+{
+	if ( num_frames <= 0 )
+		return  NULL;
+
+	// 未計算であれば、指定フレームのみを計算
+	frame_no = ClampFrameNo( frame_no, num_frames );
+	return  ForwardKinematicsBatch( this, frame_no, frame_no + 1 );
+}
+
+bool  Motion::GetGlobalJointPosition( int frame_no, int joint_no, Point3f & pos ) const
+{
+	const MotionTransformTable *  table = GetGlobalTransforms( frame_no );
+	if ( !table || ( joint_no < 0 ) || ( joint_no >= table->num_joints ) )
+		return  false;
+	table->GetJointPosition( ClampFrameNo( frame_no, num_frames ), joint_no, pos );
+	return  true;
+}
+
+bool  Motion::GetGlobalSegmentPosition( int frame_no, int segment_no, Point3f & pos ) const
+{
+	const MotionTransformTable *  table = GetGlobalTransforms( frame_no );
+	if ( !table || ( segment_no < 0 ) || ( segment_no >= table->num_segments ) )
+		return  false;
+	table->GetSegmentPosition( ClampFrameNo( frame_no, num_frames ), segment_no, pos );
+	return  true;
+}
+
+void  Motion::ClearLazy()
+{
+	if ( frame_cache )
+		delete  frame_cache;
+	frame_cache = NULL;
+
+	if ( frame_decoder )
+		delete  frame_decoder;
+	frame_decoder = NULL;
 }
 
 Posture *  Motion::GetFrame( int no ) const 
 {
-	if ( !frames )
+	if ( num_frames <= 0 )
 		return  NULL;
 
 	if ( no <= 0 )
-		return & frames[ 0 ]; 
+		no = 0;
 	else if ( no >= num_frames )
-		return & frames[ num_frames - 1 ]; 
+		no = num_frames - 1;
+
+	// 姿勢を必要に応じて生成する場合は、キャッシュから取得
+	if ( frame_cache )
+		return  frame_cache->GetFrame( this, no );
+
+	if ( !frames )
+		return  NULL;
 
 	return & frames[ no ]; 
 }
@@ -238,12 +634,121 @@ Posture *  Motion::GetFrameTime( float time ) const
 
 void  Motion::GetPosture( float time, Posture & p ) const
 {
+	// 姿勢を必要に応じて生成する場合は、キャッシュの姿勢が置き換えられないように、排他制御の中でコピーする
+	if ( frame_cache )
+	{
+		if ( ( interval <= 0.0f ) || ( num_frames <= 0 ) )
+			return;
+		int  no = time / interval;
+		if ( no <= 0 )
+			no = 0;
+		else if ( no >= num_frames )
+			no = num_frames - 1;
+		frame_cache->GetPosture( this, no, p );
+		return;
+	}
+
 	Posture *  frame = GetFrameTime( time );
 	if ( !frame )
 		return;
 	p = *frame;
 }
 
+void  Motion::SampleInterpolated( float time, Posture & p ) const
+{
+	if ( ( interval <= 0.0f ) || ( num_frames <= 0 ) || !body )
+		return;
+
+	// 前後のフレーム番号と補間の比率を計算（範囲外の時刻は最初・最後のフレームとする）
+	float  frame_time = time / interval;
+	int  no = (int) floor( frame_time );
+	float  ratio = frame_time - no;
+	if ( no < 0 )
+	{
+		no = 0;
+		ratio = 0.0f;
+	}
+	else if ( no >= num_frames - 1 )
+	{
+		no = num_frames - 1;
+		ratio = 0.0f;
+	}
+
+	// 出力先の姿勢を初期化（同じ関節数であれば領域は再利用される）
+	if ( p.body != body )
+		p.Init( body );
+
+	// 姿勢を必要に応じて生成する場合は、キャッシュの姿勢が置き換えられないように、排他制御の中で補間する
+	if ( frame_cache )
+	{
+		frame_cache->GetInterpolatedPosture( this, no, no + 1, ratio, p );
+		return;
+	}
+
+	if ( !frames )
+		return;
+	if ( ratio > 0.0f )
+	{
+		// 変換済みの四元数表現の姿勢を補間（各フレームの回転行列から四元数への変換は最初の１回のみ）
+		// （取得用の姿勢はスレッドごとに再利用する）
+		static thread_local QuaternionPosture  q0, q1;
+		if ( GetQuaternionFrame( no, q0 ) && GetQuaternionFrame( no + 1, q1 ) )
+			PostureInterpolation( q0, q1, ratio, p );
+		else
+			PostureInterpolation( frames[ no ], frames[ no + 1 ], ratio, p );
+	}
+	else
+		p = frames[ no ];
+}
+
+void  Motion::SampleInterpolated( float time, QuaternionPosture & p ) const
+{
+	if ( ( interval <= 0.0f ) || ( num_frames <= 0 ) || !body )
+		return;
+
+	// 前後のフレーム番号と補間の比率を計算（範囲外の時刻は最初・最後のフレームとする）
+	float  frame_time = time / interval;
+	int  no = (int) floor( frame_time );
+	float  ratio = frame_time - no;
+	if ( no < 0 )
+	{
+		no = 0;
+		ratio = 0.0f;
+	}
+	else if ( no >= num_frames - 1 )
+	{
+		no = num_frames - 1;
+		ratio = 0.0f;
+	}
+
+	// 姿勢を必要に応じて生成する場合は、変換済みの姿勢を保持せずに、補間した姿勢を変換
+	// （全フレームの四元数表現の姿勢を保持すると、姿勢を必要に応じて生成する利点が失われるため）
+	if ( frame_cache )
+	{
+		PooledPosture  interpolated_posture( body );
+		frame_cache->GetInterpolatedPosture( this, no, no + 1, ratio, *interpolated_posture );
+		p.Set( *interpolated_posture );
+		return;
+	}
+
+	if ( ratio > 0.0f )
+	{
+		// 取得用の姿勢はスレッドごとに再利用する
+		static thread_local QuaternionPosture  q0, q1;
+		if ( GetQuaternionFrame( no, q0 ) && GetQuaternionFrame( no + 1, q1 ) )
+			PostureInterpolation( q0, q1, ratio, p );
+	}
+	else
+		GetQuaternionFrame( no, p );
+}
+
+bool  Motion::GetQuaternionFrame( int no, QuaternionPosture & p ) const
+{
+	if ( !quaternion_frames )
+		return  false;
+	return  quaternion_frames->GetFrame( this, no, p );
+}
+
 
 //
 //  人体モデルのキーフレーム動作を表すクラス
@@ -417,13 +922,21 @@ void  InitPosture( Posture & posture, const Skeleton * body )
 
 	// 適当な腰の高さを計算・設定
 	//（最も低い関節の y座標が 0になるように腰の高さを設定）
-	//（本来は、一度計算した高さを記録しておくようにすれば、毎回計算する必要はない）
-	vector< Matrix4f >  seg_frame_array;
-	ForwardKinematics( posture, seg_frame_array );
+	//（体節の接続情報を初期化した骨格では、初期化時に計算した高さを使用する）
 	float  root_height = 0.0f;
-	for ( int i = 0; i < posture.body->num_segments; i++ )
-		if ( root_height > seg_frame_array[ i ].m13 )
-			root_height = seg_frame_array[ i ].m13;
+	const Skeleton *  body_info = posture.body;
+	if ( (int) body_info->segment_links.size() + 1 == body_info->num_segments )
+	{
+		root_height = body_info->rest_lowest_height;
+	}
+	else
+	{
+		vector< Matrix4f >  seg_frame_array;
+		ForwardKinematics( posture, seg_frame_array );
+		for ( int i = 0; i < posture.body->num_segments; i++ )
+			if ( root_height > seg_frame_array[ i ].m13 )
+				root_height = seg_frame_array[ i ].m13;
+	}
 	posture.root_pos.y = - root_height + 0.05f; // 適当なマージンを加算
 }
 
@@ -431,7 +944,7 @@ void  InitPosture( Posture & posture, const Skeleton * body )
 //
 //  BVH動作から骨格モデルを生成
 //
-Skeleton *  CoustructBVHSkeleton( class BVH * bvh )
+Skeleton *  CoustructBVHSkeleton( const class BVH * bvh )
 {
 	// 引数チェック
 	if ( !bvh || !bvh->IsLoadSuccess() || ( bvh->GetNumJoint() == 0 ) )
@@ -532,6 +1045,9 @@ Skeleton *  CoustructBVHSkeleton( class BVH * bvh )
 		}
 	}
 
+	// 順運動学計算のための体節の接続情報を初期化
+	body->InitTopology();
+
 	// 生成した骨格モデルを返す
 	return  body;
 }
@@ -559,9 +1075,18 @@ Motion *  CoustructBVHMotion( class BVH * bvh, const Skeleton * bvh_body )
 	motion->interval = bvh->GetInterval();
 	motion->name = bvh->GetMotionName();
 
+	// チャンネルと姿勢の対応情報（関節ごとの回転順序）を最初に一度だけ判定
+	BVHChannelLayout  layout;
+	InitBVHChannelLayout( bvh, layout );
+
 	// 各フレームの姿勢をBVH動作から取得
-	for ( int i = 0; i < num_frames; i++ )
-		GetBVHPosture( bvh, i, motion->frames[ i ] );
+	// （各フレームの計算は独立しているため、フレームを一定数ずつのブロックに分けて複数のスレッドで分担する）
+	// （各フレームの結果は逐次処理と同一になる。スレッド数は SetNumWorkerThreads() で設定する）
+	ParallelFor( 0, num_frames, bvh_decode_chunk_size, [ & ]( int begin, int end )
+	{
+		for ( int i = begin; i < end; i++ )
+			DecodeBVHPosture( layout, bvh->GetFrameData( i ), motion->frames[ i ] );
+	} );
 
 	// 生成した動作データを返す
 	return  motion;
@@ -573,7 +1098,20 @@ Motion *  CoustructBVHMotion( class BVH * bvh, const Skeleton * bvh_body )
 //
 Motion *  LoadAndCoustructBVHMotion( const char * bvh_file_name, const Skeleton * bvh_body )
 {
+	Motion *  motion = NULL;
+
+	// 有効なキャッシュファイルがあれば、キャッシュから動作データを読み込み
+	if ( use_motion_cache )
+	{
+		motion = LoadMotionCache( bvh_file_name, bvh_body );
+		if ( motion )
+			return  motion;
+	}
+
 	// BVH動作データを読み込み
+	// （ファイルをメモリにマッピングして、その場で解析する。一定フレーム数ずつ読み込む BVHStream と比べて、
+	//    読み込み中はファイル全体のチャンネルの値を保持するが、読み込みは高速となる。
+	//    BVHStream は、動作データ全体を保持しない解析処理のみで使用する）
 	BVH  bvh( bvh_file_name );
 
 	// 読み込みに失敗したら終了
@@ -581,7 +1119,11 @@ Motion *  LoadAndCoustructBVHMotion( const char * bvh_file_name, const Skeleton
 		return  NULL;
 
 	// BVH動作から骨格モデルと動作データを生成
-	Motion *  motion = CoustructBVHMotion( &bvh, bvh_body );
+	motion = CoustructBVHMotion( &bvh, bvh_body );
+
+	// 次回の読み込みのためにキャッシュファイルを保存
+	if ( motion && use_motion_cache )
+		SaveMotionCache( bvh_file_name, motion );
 
 	// 生成した動作データを返す
 	return  motion;
@@ -589,27 +1131,83 @@ Motion *  LoadAndCoustructBVHMotion( const char * bvh_file_name, const Skeleton
 
 
 //
-//  BVH動作の関節回転を計算（オイラー角表現から回転行列表現に変換）
+//  BVH動作のチャンネルと姿勢の対応情報を初期化（関節ごとの回転順序を判定）
+//
+void  InitBVHChannelLayout( const BVH * bvh, BVHChannelLayout & layout )
+{
+	layout.num_channels = bvh->GetNumChannel();
+	layout.root_pos_channels[ 0 ] = layout.root_pos_channels[ 1 ] = layout.root_pos_channels[ 2 ] = -1;
+	layout.joints.resize( bvh->GetNumJoint() );
+	layout.rotation_channels.clear();
+
+	for ( int i = 0; i < bvh->GetNumJoint(); i++ )
+	{
+		const BVH::Joint *  bvh_joint = bvh->GetJoint( i );
+		BVHChannelLayout::JointRotation &  rotation = layout.joints[ i ];
+
+		// 回転のチャンネルを順に取得（ルート関節の位置のチャンネルも取得）
+		rotation.first = layout.rotation_channels.size();
+		rotation.num_channels = 0;
+		for ( int j = 0; j < (int) bvh_joint->channels.size(); j++ )
+		{
+			const BVH::Channel *  channel = bvh_joint->channels[ j ];
+			switch ( channel->type )
+			{
+			  case BVH::X_POSITION:
+			  case BVH::Y_POSITION:
+			  case BVH::Z_POSITION:
+				if ( i == 0 )
+					layout.root_pos_channels[ channel->type - BVH::X_POSITION ] = channel->index;
+				break;
+			  case BVH::X_ROTATION:
+			  case BVH::Y_ROTATION:
+			  case BVH::Z_ROTATION:
+				if ( rotation.num_channels < 6 )
+				{
+					rotation.axes[ rotation.num_channels ++ ] = channel->type - BVH::X_ROTATION;
+					layout.rotation_channels.push_back( channel->index );
+				}
+				break;
+			}
+		}
+
+		// ３軸の回転であれば回転順序を判定（それ以外の場合は各軸の回転を順に掛ける）
+		if ( rotation.num_channels == 3 )
+			rotation.order = GetEulerOrder( rotation.axes[ 0 ], rotation.axes[ 1 ], rotation.axes[ 2 ] );
+		else
+			rotation.order = EULER_UNKNOWN;
+	}
+}
+
+
+//
+//  BVH動作の関節回転を計算（各軸の回転の sin, cos から回転行列を計算）
 //
-void  ComputeBVHJointRotation( int num_channels, const BVH::Channel * const * channels, const float * angles, Matrix3f & rot )
+static void  ComputeBVHJointRotation( const BVHChannelLayout::JointRotation & rotation, const float * s, const float * c, Matrix3f & rot )
 {
+	// 回転順序が判定済みであれば、回転順序ごとに特殊化した計算を使用
+	if ( rotation.order != EULER_UNKNOWN )
+	{
+		EulerToMatrix( (EulerOrder) rotation.order, s, c, rot );
+		return;
+	}
+
+	// それ以外の場合は、各軸の回転行列を順に掛ける
 	Matrix3f  axis_rot;
 	rot.setIdentity();
-	for ( int i = 0; i < num_channels; i++ )
+	for ( int i = 0; i < rotation.num_channels; i++ )
 	{
-		switch ( channels[ i ]->type )
+		switch ( rotation.axes[ i ] )
 		{
-		  case BVH::X_ROTATION:
-			axis_rot.rotX( angles[ i ] );
+		  case 0:
+			axis_rot = Matrix3f( 1.0f, 0.0f, 0.0f,  0.0f, c[ i ], -s[ i ],  0.0f, s[ i ], c[ i ] );
 			break;
-		  case BVH::Y_ROTATION:
-			axis_rot.rotY( angles[ i ] );
+		  case 1:
+			axis_rot = Matrix3f( c[ i ], 0.0f, s[ i ],  0.0f, 1.0f, 0.0f,  -s[ i ], 0.0f, c[ i ] );
 			break;
-		  case BVH::Z_ROTATION:
-			axis_rot.rotZ( angles[ i ] );
+		  case 2:
+			axis_rot = Matrix3f( c[ i ], -s[ i ], 0.0f,  s[ i ], c[ i ], 0.0f,  0.0f, 0.0f, 1.0f );
 			break;
-		  default:
-			axis_rot.setIdentity();
 		}
 		rot.mul( rot, axis_rot );
 	}
@@ -617,78 +1215,72 @@ void  ComputeBVHJointRotation( int num_channels, const BVH::Channel * const * ch
 
 
 //
-//  BVH動作から姿勢を取得
+//  BVH動作の１フレーム分のチャンネルの値から姿勢を取得
 //
-void  GetBVHPosture( const BVH * bvh, int frame_no, Posture & posture )
+void  DecodeBVHPosture( const BVHChannelLayout & layout, const double * channel_values, Posture & posture )
 {
-	if ( !bvh || !bvh->IsLoadSuccess() || !posture.body )
-		return;
-	if ( bvh->GetNumJoint() < posture.body->num_joints )
+	if ( !posture.body || ( (int) layout.joints.size() < posture.body->num_joints + 1 ) )
 		return;
 
 	const Skeleton *  body = posture.body;
-	Vector3f  root_pos;
-	Matrix3f  rot;
-	BVH::Channel *  root_rot_channels[ 3 ];
-	const BVH::Joint *  bvh_joint = NULL;
-	int  num_channels = 0;
-	float  angles[ 6 ];
-
-	// ルート関節の位置・向きを取得
-	const BVH::Joint *  bvh_root = bvh->GetJoint( 0 );
-	int  c = 0;
-	for ( int j = 0; j < bvh_root->channels.size(); j++ )
+	const int  num_rotations = layout.rotation_channels.size();
+
+	// 全関節の回転角度（ラジアン）の sin, cos をまとめて計算
+	const int  max_stack_rotations = 512;
+	float  stack_buffer[ max_stack_rotations * 3 ];
+	vector< float >  heap_buffer;
+	float *  angles = stack_buffer;
+	if ( num_rotations > max_stack_rotations )
 	{
-		switch ( bvh_root->channels[ j ]->type )
-		{
-			case BVH::X_POSITION:
-			root_pos.x = bvh->GetMotion( frame_no, bvh_root->channels[ j ]->index );
-			break;
-			case BVH::Y_POSITION:
-			root_pos.y = bvh->GetMotion( frame_no, bvh_root->channels[ j ]->index );
-			break;
-			case BVH::Z_POSITION:
-			root_pos.z = bvh->GetMotion( frame_no, bvh_root->channels[ j ]->index );
-			break;
-			case BVH::X_ROTATION:
-			root_rot_channels[ c++ ] = bvh_root->channels[ j ];
-			break;
-			case BVH::Y_ROTATION:
-			root_rot_channels[ c++ ] = bvh_root->channels[ j ];
-			break;
-			case BVH::Z_ROTATION:
-			root_rot_channels[ c++ ] = bvh_root->channels[ j ];
-			break;
-		}
+		heap_buffer.resize( num_rotations * 3 );
+		angles = &heap_buffer.front();
 	}
-	if ( c == 3 )
+	float *  s = angles + num_rotations;
+	float *  c = s + num_rotations;
+	for ( int i = 0; i < num_rotations; i++ )
+		angles[ i ] = (float)( channel_values[ layout.rotation_channels[ i ] ] * ( M_PI / 180.0 ) );
+	SinCosArray( angles, s, c, num_rotations );
+
+	// ルート関節の位置を設定
+	Vector3f  root_pos( 0.0f, 0.0f, 0.0f );
+	for ( int i = 0; i < 3; i++ )
 	{
-		for ( int j = 0; j < 3; j++ )
-			angles[ j ] = bvh->GetMotion( frame_no, root_rot_channels[ j ]->index ) * M_PI / 180.0f;
-		ComputeBVHJointRotation( 3, root_rot_channels, angles, rot );
+		if ( layout.root_pos_channels[ i ] >= 0 )
+			( &root_pos.x )[ i ] = channel_values[ layout.root_pos_channels[ i ] ];
 	}
-	else
-		rot.setIdentity();
-
-	// ルート関節の位置・向きを設定
 	root_pos.scale( bvh_scale );
 	posture.root_pos = root_pos;
-	posture.root_ori = rot;
 
-	// 各関節の回転を取得
+	// ルート関節の向きを設定（３軸の回転がない場合は回転なし）
+	const BVHChannelLayout::JointRotation &  root = layout.joints[ 0 ];
+	if ( root.num_channels == 3 )
+		ComputeBVHJointRotation( root, s + root.first, c + root.first, posture.root_ori );
+	else
+		posture.root_ori.setIdentity();
+
+	// 各関節の回転を設定
 	for ( int i = 0; i < body->num_joints; i++ )
 	{
-		bvh_joint = bvh->GetJoint( i + 1 );
-		num_channels = bvh_joint->channels.size();
+		const BVHChannelLayout::JointRotation &  rotation = layout.joints[ i + 1 ];
+		ComputeBVHJointRotation( rotation, s + rotation.first, c + rotation.first, posture.joint_rotations[ i ] );
+	}
+}
 
-		// 関節の回転を取得
-		for ( int j = 0; j  <num_channels; j++ )
-			angles[ j ] = bvh->GetMotion( frame_no, bvh_joint->channels[ j ]->index ) * M_PI / 180.0f;
-		ComputeBVHJointRotation( num_channels, &bvh_joint->channels.front(), angles, rot );
 
-		// 関節の回転を設定
-		posture.joint_rotations[ i ] = rot;
-	}
+//
+//  BVH動作から姿勢を取得
+//
+void  GetBVHPosture( const BVH * bvh, int frame_no, Posture & posture )
+{
+	if ( !bvh || !bvh->IsLoadSuccess() || !posture.body )
+		return;
+	if ( bvh->GetNumJoint() < posture.body->num_joints )
+		return;
+
+	// チャンネルと姿勢の対応情報を取得して、指定フレームの姿勢を取得
+	BVHChannelLayout  layout;
+	InitBVHChannelLayout( bvh, layout );
+	DecodeBVHPosture( layout, bvh->GetFrameData( frame_no ), posture );
 }
 
 
@@ -793,6 +1385,79 @@ void  ForwardKinematicsIteration(
 }
 
 
+//
+//  体節の接続情報を使った順運動学計算（接続情報の範囲 [link_begin, link_end) の順に各体節の変換行列を計算）
+//
+void  ForwardKinematicsLinks( const Posture & posture, int link_begin, int link_end, Matrix4f * seg_frame_array, Point3f * joi_pos_array )
+{
+	const vector< SegmentLink > &  links = posture.body->segment_links;
+
+	// 計算用のベクトル・行列
+	Matrix3f  parent_rot, rot;
+	Vector3f  pos, offset;
+
+	for ( int i = link_begin; i < link_end; i++ )
+	{
+		const SegmentLink &  link = links[ i ];
+		const Matrix4f &  parent_frame = seg_frame_array[ link.parent_segment ];
+
+		// ルート側の体節の座標系から、接続関節の位置を計算
+		parent_frame.getRotationScale( &parent_rot );
+		parent_rot.transform( link.parent_offset, &pos );
+		pos.x += parent_frame.m03;
+		pos.y += parent_frame.m13;
+		pos.z += parent_frame.m23;
+
+		// 関節の位置を設定
+		if ( joi_pos_array )
+			joi_pos_array[ link.joint ].set( pos );
+
+		// 関節の回転行列をかける
+		rot.mul( parent_rot, posture.joint_rotations[ link.joint ] );
+
+		// 関節の座標系から、体節の座標系への平行移動をかける
+		rot.transform( link.offset, &offset );
+		pos.sub( offset );
+
+		// 体節の変換行列を設定
+		seg_frame_array[ link.segment ].set( rot, pos, 1.0f );
+	}
+}
+
+
+//
+//  順運動学計算の方法の設定
+//
+
+// 順運動学計算の方法
+static atomic< int >  forward_kinematics_engine( FK_ENGINE_MATRIX );
+
+void  SetForwardKinematicsEngine( ForwardKinematicsEngineEnum engine )
+{
+	forward_kinematics_engine = engine;
+}
+
+ForwardKinematicsEngineEnum  GetForwardKinematicsEngine()
+{
+	return  (ForwardKinematicsEngineEnum) forward_kinematics_engine.load();
+}
+
+
+//
+//  順運動学計算のための反復計算（体節の接続情報が初期化されていない骨格では、再帰呼び出しにより計算）
+//
+static void  ForwardKinematicsAllSegments( const Posture & posture, Matrix4f * seg_frame_array, Point3f * joi_pos_array = NULL )
+{
+	const Skeleton *  body = posture.body;
+	if ( (int) body->segment_links.size() + 1 != body->num_segments )
+		ForwardKinematicsIteration( body->segments[ 0 ], NULL, posture, seg_frame_array, joi_pos_array );
+	else if ( forward_kinematics_engine == FK_ENGINE_AFFINE_SIMD )
+		ForwardKinematicsAffine( posture, 0, (int) body->segment_links.size(), seg_frame_array, joi_pos_array );
+	else
+		ForwardKinematicsLinks( posture, 0, (int) body->segment_links.size(), seg_frame_array, joi_pos_array );
+}
+
+
 //
 //  順運動学計算
 //
@@ -806,7 +1471,34 @@ void  ForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame
 	seg_frame_array[ 0 ].set( posture.root_ori, posture.root_pos, 1.0f );
 
 	// Forward Kinematics 計算のための反復計算（ルート体節から末端体節に向かって繰り返し計算）
-	ForwardKinematicsIteration( posture.body->segments[ 0 ], NULL, posture, &seg_frame_array.front(), &joi_pos_array.front() );
+	ForwardKinematicsAllSegments( posture, &seg_frame_array.front(), &joi_pos_array.front() );
+}
+
+
+//
+//  指定関節より末端側の体節・関節のみの順運動学計算
+//  （指定関節の回転のみを変更した場合、他の体節・関節は変化しないため、計算済みの結果を使用して末端側のみを再計算する）
+//  （結果は全身の順運動学計算と同じ。ForwardKinematics() と同じ計算方法を使用し、体節の接続情報が初期化されていない骨格では全身を計算する）
+//
+void  ForwardKinematicsSubtree( const Posture & posture, int joint_no, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array )
+{
+	const Skeleton *  body = posture.body;
+	if ( ( (int) body->segment_links.size() + 1 != body->num_segments ) || ( joint_no < 0 ) || ( joint_no >= (int) body->joint_links.size() ) ||
+		( (int) seg_frame_array.size() != body->num_segments ) || ( (int) joi_pos_array.size() != body->num_joints ) )
+	{
+		ForwardKinematics( posture, seg_frame_array, joi_pos_array );
+		return;
+	}
+
+	// 指定関節で接続する体節と、その末端側の体節の接続情報の範囲を計算
+	int  link_no = body->joint_links[ joint_no ];
+	if ( link_no < 0 )
+		return;
+	int  link_end = body->segment_links[ link_no ].subtree_end;
+	if ( forward_kinematics_engine == FK_ENGINE_AFFINE_SIMD )
+		ForwardKinematicsAffine( posture, link_no, link_end, &seg_frame_array.front(), &joi_pos_array.front() );
+	else
+		ForwardKinematicsLinks( posture, link_no, link_end, &seg_frame_array.front(), &joi_pos_array.front() );
 }
 
 
@@ -822,7 +1514,7 @@ void  ForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame
 	seg_frame_array[ 0 ].set( posture.root_ori, posture.root_pos, 1.0f );
 
 	// Forward Kinematics 計算のための反復計算（ルート体節から末端体節に向かって繰り返し計算）
-	ForwardKinematicsIteration( posture.body->segments[ 0 ], NULL, posture, &seg_frame_array.front() );
+	ForwardKinematicsAllSegments( posture, &seg_frame_array.front() );
 }
 
 
@@ -839,27 +1531,28 @@ void  PostureInterpolation( const Posture & p0, const Posture & p1, float ratio,
 	const Skeleton *  body = p0.body;
 
 	// 計算用変数
-	Quat4f  q0, q1, q;
 	Vector3f  v0, v1, v;
 
-	// ２つの姿勢の各関節の回転を補間
-	for ( int i = 0; i < body->num_joints; i++ )
+	// ２つの姿勢の各関節の回転とルートの向きを四元数に変換（変換用の配列はスレッドごとに再利用する）
+	static thread_local vector< Quat4f >  rotations0, rotations1;
+	const int  num_joints = body->num_joints;
+	rotations0.resize( num_joints + 1 );
+	rotations1.resize( num_joints + 1 );
+	for ( int i = 0; i < num_joints; i++ )
 	{
-		q0.set( p0.joint_rotations[ i ] );
-		q1.set( p1.joint_rotations[ i ] );
-		if ( q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w < 0 )
-			q1.negate( q1 );
-		q.interpolate( q0, q1, ratio );
-		p.joint_rotations[ i ].set( q );
+		rotations0[ i ].set( p0.joint_rotations[ i ] );
+		rotations1[ i ].set( p1.joint_rotations[ i ] );
 	}
+	rotations0[ num_joints ].set( p0.root_ori );
+	rotations1[ num_joints ].set( p1.root_ori );
 
-	// ２つの姿勢のルートの向きを補間
-	q0.set( p0.root_ori );
-	q1.set( p1.root_ori );
-	if ( q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w < 0 )
-		q1.negate( q1 );
-	q.interpolate( q0, q1, ratio );
-	p.root_ori.set( q );
+	// 全ての回転をまとめて補間
+	InterpolateQuaternions( &rotations0.front(), &rotations1.front(), ratio, &rotations0.front(), num_joints + 1 );
+
+	// ２つの姿勢の各関節の回転・ルートの向きを設定
+	for ( int i = 0; i < num_joints; i++ )
+		p.joint_rotations[ i ].set( rotations0[ i ] );
+	p.root_ori.set( rotations0[ num_joints ] );
 
 	// ２つの姿勢のルートの位置を補間
 	v0.set( p0.root_pos );
@@ -996,26 +1689,18 @@ void  DrawBone( float x0, float y0, float z0, float x1, float y1, float z1, floa
 
 
 //
-//  姿勢の描画（スティックフィギュアで描画）
+//  各体節の描画（各体節の位置・向きを指定）
 //
-void  DrawPosture( const Posture & posture )
+static void  DrawSegments( const Skeleton * body, const Matrix4f * seg_frame_array )
 {
-	if ( !posture.body )
-		return;
-
-	// 順運動学計算
-	vector< Matrix4f >  seg_frame_array;
-	vector< Point3f >  joi_pos_array;
-	ForwardKinematics( posture, seg_frame_array, joi_pos_array );
-
 	float  radius = 0.05f;
 	Matrix4f  mat;
 	Vector3f  v1, v2;
 
 	// 各体節の描画
-	for ( int i = 0; i < seg_frame_array.size(); i++ )
+	for ( int i = 0; i < body->num_segments; i++ )
 	{
-		const Segment *  segment = posture.body->segments[i];
+		const Segment *  segment = body->segments[i];
 		const int  num_joints = segment->num_joints;
 
 		// 体節の中心の位置・向きを基準とする変換行列を適用
@@ -1063,7 +1748,47 @@ void  DrawPosture( const Posture & posture )
 //
 //  姿勢の描画（スティックフィギュアで描画）
 //
-void  DrawPostureShadow( const Posture & posture, const Vector3f & light_dir, const Color4f & color )
+void  DrawPosture( const Posture & posture )
+{
+	if ( !posture.body )
+		return;
+
+	// 順運動学計算
+	vector< Matrix4f >  seg_frame_array;
+	vector< Point3f >  joi_pos_array;
+	ForwardKinematics( posture, seg_frame_array, joi_pos_array );
+
+	// 各体節の描画
+	DrawSegments( posture.body, &seg_frame_array.front() );
+}
+
+
+//
+//  動作データのフレームの姿勢の描画（順運動学計算の結果の表を使用して描画）
+//  （同じフレームを繰り返し描画する場合や、解析処理で計算済みのフレームでは、順運動学計算を省略できる）
+//
+void  DrawMotionFrame( const Motion & motion, int frame_no )
+{
+	const MotionTransformTable *  table = motion.GetGlobalTransforms( frame_no );
+	if ( !table )
+		return;
+	frame_no = ClampFrameNo( frame_no, motion.num_frames );
+
+	// 計算済みの各体節の位置・向きを取得
+	static vector< Matrix4f >  seg_frame_array;
+	seg_frame_array.resize( table->num_segments );
+	for ( int i = 0; i < table->num_segments; i++ )
+		table->GetSegmentFrame( frame_no, i, seg_frame_array[ i ] );
+
+	// 各体節の描画
+	DrawSegments( motion.body, &seg_frame_array.front() );
+}
+
+
+//
+//  影の描画（地面に投影する変換行列を設定して、指定の描画処理を呼び出す）
+//
+static void  DrawShadow( const Vector3f & light_dir, const Color4f & color, const function< void () > & draw )
 {
 	// 現在の描画設定を取得（描画終了後に元の設定に戻すため）
 	GLboolean  b_cull_face, b_blend, b_lighting, b_stencil;
@@ -1104,7 +1829,7 @@ void  DrawPostureShadow( const Posture & posture, const Vector3f & light_dir, co
 
 	// 姿勢の描画（スティックフィギュアで描画）
 	glColor4f( color.x, color.y, color.z, color.w );
-	DrawPosture( posture );
+	draw();
 
 	// 一時保存しておいた変換行列を復元
 	glPopMatrix();
@@ -1121,3 +1846,23 @@ void  DrawPostureShadow( const Posture & posture, const Vector3f & light_dir, co
 }
 
 
+//
+//  姿勢の描画（スティックフィギュアで描画）
+//
+void  DrawPostureShadow( const Posture & posture, const Vector3f & light_dir, const Color4f & color )
+{
+	DrawShadow( light_dir, color, [ & ]() { DrawPosture( posture ); } );
+}
+
+
+//
+//  動作データのフレームの姿勢の影の描画（順運動学計算の結果の表を使用して描画）
+//
+void  DrawMotionFrameShadow( const Motion & motion, int frame_no, const Vector3f & light_dir, const Color4f & color )
+{
+	DrawShadow( light_dir, color, [ & ]() { DrawMotionFrame( motion, frame_no ); } );
+}
+
+
+
+
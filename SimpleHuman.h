@@ -71,6 +71,29 @@ struct  Joint
 };
 
 
+//
+//  順運動学計算のための体節の接続情報
+//
+struct  SegmentLink
+{
+	// 体節番号・ルート側の体節番号
+	int  segment;
+	int  parent_segment;
+
+	// ルート側の体節と接続する関節番号
+	int  joint;
+
+	// 関節の位置（ルート側の体節のローカル座標系）
+	Vector3f  parent_offset;
+
+	// 関節の位置（体節のローカル座標系）
+	Vector3f  offset;
+
+	// この体節より末端側の体節の接続情報の終了番号（この体節と末端側の体節は [この接続情報の番号, subtree_end) に並ぶ）
+	int  subtree_end;
+};
+
+
 //
 //  人体モデルの骨格を表すクラス
 //
@@ -89,12 +112,28 @@ class  Skeleton
 	// 体節の配列 [体節番号]
 	Joint **  joints;
 
+	// ルート体節以外の各体節の接続情報（ルート体節から末端体節に向かう順に並べたもの、InitTopology() で設定）
+	// （順運動学計算では、この順に計算することで、再帰呼び出しや接続関係の探索を行わずに全体節を計算できる）
+	vector< SegmentLink >  segment_links;
+
+	// 各関節を末端側の体節に接続する接続情報の番号 [関節番号]
+	vector< int >  joint_links;
+
+	// 全関節の回転が単位行列の姿勢で、ルートを原点とした時の最も低い体節の y座標（InitTopology() で設定）
+	float  rest_lowest_height;
+
+	// 逆運動学計算のための関節のパスの表（支点関節・末端関節の組ごとに探索したパスを保持）
+	class JointPathTable *  joint_path_table;
+
 
   public:
 	// コンストラクタ・デストラクタ
 	Skeleton();
 	Skeleton( int s, int j );
 	~Skeleton();
+
+	// 体節の接続情報を初期化（全ての体節・関節を設定した後に呼び出す）
+	void  InitTopology();
 };
 
 
@@ -116,17 +155,33 @@ class  Posture
 	// 各関節の相対回転（回転行列表現）[関節番号]
 	Matrix3f *  joint_rotations;
 
+	// 各関節の相対回転の配列を姿勢が所有しているかどうか（動作データの姿勢は動作データの領域を参照する）
+	bool  owns_joint_rotations;
+
+	// 所有している配列の要素数（所有していない場合は 0）
+	// （姿勢が骨格モデルより後まで残る場合もあるため、配列の再利用の判定には骨格モデルを参照しない）
+	int  num_owned_joints;
+
 
   public:
 	// コンストラクタ・デストラクタ
 	Posture();
 	Posture( const Skeleton * b );
 	Posture( const Posture & p );
+	Posture( Posture && p );
 	Posture &operator=( const Posture & p );
+	Posture &operator=( Posture && p );
 	~Posture();
 
 	// 初期化
 	void  Init( const Skeleton * b );
+
+	// 外部の領域を各関節の相対回転の配列として初期化（領域は削除しない）
+	void  InitView( const Skeleton * b, Matrix3f * rotations );
+
+  protected:
+	// 指定の骨格モデルの関節の回転の配列を用意（確保済みの配列が使える場合は再利用）
+	void  PrepareJointRotations( const Skeleton * b );
 };
 
 
@@ -146,10 +201,25 @@ class  Motion
 	float  interval;
 
 	// 全フレームの姿勢 [フレーム番号]
+	// （姿勢を必要に応じて生成する場合は NULL となるため、GetFrame() 等を使用する）
 	Posture *  frames;
 
+	// 全フレームの関節の相対回転を連続して格納する領域 [フレーム番号×関節数＋関節番号]
+	// （各フレームの姿勢の joint_rotations はこの領域を参照する）
+	Matrix3f *  frame_rotations;
+
 	// 動作名
 	string  name;
+
+	// 姿勢を必要に応じて生成する場合の、姿勢の生成方法と生成済みの姿勢のキャッシュ（InitLazy() で設定）
+	class MotionFrameDecoder *  frame_decoder;
+	class MotionFrameCache *  frame_cache;
+
+	// 順運動学計算の結果を全フレーム分保持する表（ForwardKinematicsBatch() で計算したフレームの値を保持）
+	class MotionTransformTable *  transform_table;
+
+	// 各フレームの四元数表現の姿勢（GetQuaternionFrame() で取得したフレームの姿勢を保持）
+	class MotionQuaternionFrames *  quaternion_frames;
 	
 
   public:
@@ -163,13 +233,61 @@ class  Motion
 	// 初期化
 	void  Init( const Skeleton * b, int n );
 
+	// 姿勢を必要に応じて生成する動作データとして初期化（decoder は動作データが削除する）
+	void  InitLazy( const Skeleton * b, int n, class MotionFrameDecoder * decoder, int cache_size );
+
+	// 姿勢を必要に応じて生成する動作データかどうかを判定
+	bool  IsLazy() const { return  frame_decoder != NULL; }
+
 	// 動作の長さを取得
 	float  GetDuration() const { return  num_frames * interval; }
 
 	// 姿勢を取得
+	// （姿勢を必要に応じて生成する場合、GetFrame() の姿勢はキャッシュ内の姿勢のため、
+	//   他のフレームを取得すると内容が置き換わることがある。保持する場合は GetPosture() でコピーを取得する）
 	Posture *  GetFrame( int no ) const;
 	Posture *  GetFrameTime( float time ) const;
 	void  GetPosture( float time, Posture & p ) const;
+
+	// 指定フレームの姿勢をコピーせずに参照（フレーム番号は範囲内に補正、フレーム数が 0 の場合は使用不可）
+	// （姿勢を必要に応じて生成する場合の注意は GetFrame() と同じ）
+	const Posture &  SampleView( int no ) const { return  *GetFrame( no ); }
+
+	// 指定時刻の姿勢を前後のフレームの姿勢の補間により取得（呼び出し側の姿勢の領域に書き込む）
+	void  SampleInterpolated( float time, Posture & p ) const;
+	void  SampleInterpolated( float time, class QuaternionPosture & p ) const;
+
+	// 指定フレームの四元数表現の姿勢を呼び出し側の姿勢にコピーして取得（変換済みの姿勢は動作データに保持され、再変換しない）
+	// （姿勢の補間・変形で、回転行列から四元数への変換を毎回行わずに済む。フレーム番号が範囲外の場合は false）
+	bool  GetQuaternionFrame( int no, class QuaternionPosture & p ) const;
+
+	// 順運動学計算の結果の表を削除（各フレームの姿勢を直接変更した場合に呼び出す）
+	void  ClearTransformTable();
+
+	// 四元数表現の姿勢を削除（各フレームの姿勢を直接変更した場合に呼び出す）
+	void  ClearQuaternionFrames();
+
+	// 指定時刻のフレーム番号を取得（GetFrameTime() で取得されるフレームの番号）
+	int  GetFrameNo( float time ) const;
+
+	// 指定フレームの関節・体節のグローバルな位置を取得
+	// （順運動学計算の結果の表に保持され、同じフレームの位置は再計算しない。フレーム番号は範囲内に補正）
+	bool  GetGlobalJointPosition( int frame_no, int joint_no, Point3f & pos ) const;
+	bool  GetGlobalSegmentPosition( int frame_no, int segment_no, Point3f & pos ) const;
+
+	// 指定フレームの順運動学計算の結果を取得（計算されていなければ計算する）
+	const class MotionTransformTable *  GetGlobalTransforms( int frame_no ) const;
+
+  protected:
+	// 全フレームの姿勢の領域を確保・削除
+	void  AllocFrames();
+	void  FreeFrames();
+
+	// 全フレームの姿勢をコピー
+	void  CopyFrames( const Motion & m );
+
+	// 姿勢を必要に応じて生成するための情報を削除
+	void  ClearLazy();
 };
 
 
@@ -214,15 +332,57 @@ class  KeyframeMotion
 };
 
 
+//
+//  BVH動作のチャンネルと姿勢の対応情報（関節ごとの回転順序を読み込み時に一度だけ判定しておく）
+//
+struct  BVHChannelLayout
+{
+	// 関節の回転のチャンネル情報
+	struct  JointRotation
+	{
+		// 回転順序（EulerOrder、３軸の回転でない場合は EULER_UNKNOWN）
+		int  order;
+
+		// 回転のチャンネル数・回転軸（0:X, 1:Y, 2:Z）
+		int  num_channels;
+		int  axes[ 6 ];
+
+		// rotation_channels 中の先頭の要素番号
+		int  first;
+	};
+
+	// 全チャンネル数
+	int  num_channels;
+
+	// ルート関節の位置のチャンネル番号 [X,Y,Z]（チャンネルがない場合は -1）
+	int  root_pos_channels[ 3 ];
+
+	// 各関節の回転のチャンネル情報 [BVHの関節番号（0番目はルート）]
+	vector< JointRotation >  joints;
+
+	// 全関節の回転のチャンネル番号（関節ごとにチャンネルの順に並べたもの）
+	vector< int >  rotation_channels;
+};
+
+
 //
 //  人体モデルの骨格・姿勢・動作の基本処理
 //
 
+// BVHファイルの位置情報に適用するスケーリング比率
+extern const float  bvh_scale;
+
+// BVH動作から動作データを生成する時に、１つのスレッドがまとめて処理するフレーム数
+extern const int  bvh_decode_chunk_size;
+
+// 姿勢の関節の回転の配列を確保した回数（全スレッドの合計）を取得
+long long  GetPostureAllocationCount();
+
 // 姿勢の初期化（適当な腰の高さを計算・設定）
 void  InitPosture( Posture & posture, const Skeleton * body = NULL );
 
 // BVH動作から骨格モデルを生成
-Skeleton *  CoustructBVHSkeleton( class BVH * bvh );
+Skeleton *  CoustructBVHSkeleton( const class BVH * bvh );
 
 // BVH動作から動作データ（＋骨格モデル）を生成
 Motion *  CoustructBVHMotion( class BVH * bvh, const Skeleton * bvh_body = NULL );
@@ -233,6 +393,12 @@ Motion *  LoadAndCoustructBVHMotion( const char * bvh_file_name, const Skeleton
 // BVH動作から姿勢を取得
 void  GetBVHPosture( const class BVH * bvh, int frame_no, Posture & posture );
 
+// BVH動作のチャンネルと姿勢の対応情報を初期化（関節ごとの回転順序を判定）
+void  InitBVHChannelLayout( const class BVH * bvh, BVHChannelLayout & layout );
+
+// BVH動作の１フレーム分のチャンネルの値から姿勢を取得
+void  DecodeBVHPosture( const BVHChannelLayout & layout, const double * channel_values, Posture & posture );
+
 // 骨格モデルから体節を名前で探索
 int  FindSegment( const Skeleton * body, const char * segment_name );
 
@@ -245,6 +411,23 @@ void  ForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame
 // 順運動学計算
 void  ForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array );
 
+// 指定関節より末端側のみの順運動学計算（指定関節の回転のみを変更した時に、計算済みの順運動学計算の結果を更新）
+void  ForwardKinematicsSubtree( const Posture & posture, int joint_no, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array );
+
+// 体節の接続情報を使った順運動学計算（接続情報の範囲 [link_begin, link_end) の体節を計算、ルート側の体節の変換行列は計算済みであること）
+void  ForwardKinematicsLinks( const Posture & posture, int link_begin, int link_end, Matrix4f * seg_frame_array, Point3f * joi_pos_array = NULL );
+
+// 順運動学計算の方法
+enum  ForwardKinematicsEngineEnum
+{
+	FK_ENGINE_MATRIX,       // 回転行列・変換行列による計算（デフォルト）
+	FK_ENGINE_AFFINE_SIMD   // アフィン変換（3×4行列）による SIMD 命令を使った計算
+};
+
+// 順運動学計算の方法を設定・取得（全スレッドの ForwardKinematics() に適用、比較計測用）
+void  SetForwardKinematicsEngine( ForwardKinematicsEngineEnum engine );
+ForwardKinematicsEngineEnum  GetForwardKinematicsEngine();
+
 // 姿勢補間（２つの姿勢を補間）
 void  PostureInterpolation( const Posture & p0, const Posture & p1, float ratio, Posture & p );
 
@@ -265,8 +448,14 @@ void  DrawBone( float x0, float y0, float z0, float x1, float y1, float z1, floa
 // 姿勢の描画（スティックフィギュアで描画）
 void  DrawPosture( const Posture & posture );
 
+// 動作データのフレームの姿勢の描画（順運動学計算の結果の表を使用して描画）
+void  DrawMotionFrame( const Motion & motion, int frame_no );
+
 // 姿勢の影の描画（スティックフィギュアで描画）
 void  DrawPostureShadow( const Posture & posture, const Vector3f & light_dir, const Color4f & color );
 
+// 動作データのフレームの姿勢の影の描画（順運動学計算の結果の表を使用して描画）
+void  DrawMotionFrameShadow( const Motion & motion, int frame_no, const Vector3f & light_dir, const Color4f & color );
+
 
 #endif // _SIMPLE_HUMAN_H_